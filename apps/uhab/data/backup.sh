@@ -1,3 +1,2 @@
 #/bin/sh
-zip -r -q -9 backup.pkg conf icons images
-
+zip -r -q -9 backup.pkg conf icons images -x "conf/cache/*"
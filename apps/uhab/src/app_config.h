@@ -34,6 +34,7 @@ extern void uhab_system_shutdown(void);
 #define ENABLE_TRACE_CONFIG         1
 #define ENABLE_TRACE_BUS            1
 #define ENABLE_TRACE_BUS_CHANGES    1
+#define ENABLE_TRACE_TIMER          1
 #define ENABLE_TRACE_UIPROVIDER     1
 #define ENABLE_TRACE_REST_API       1
 
@@ -79,12 +80,84 @@ extern void uhab_system_shutdown(void);
 
 #define CFG_HTTPD_MAXNUM_CONNECTIONS          10
 
-/** BUS events queue size */
+/** BUS events ring size of the telemetry and interactive lane (power of 2) */
 #define CFG_UHAB_BUS_QUEUE_SIZE           1024
+#define CFG_UHAB_BUS_INTERACTIVE_QUEUE_SIZE  128
+
+/** BUS interactive lane default block timeout [ms] */
+#define CFG_UHAB_BUS_BLOCK_TIMEOUT        1000
+
+/** Max. events processed by one bus ring drain */
+#define CFG_UHAB_BUS_DRAIN_BATCH          32
+
+/** Max. number of items updated by one bus batch */
+#define CFG_UHAB_BUS_MAX_BATCH            64
+
+/** BUS changes journal size (power of 2) and max. changes returned by one REST request */
+#define CFG_UHAB_BUS_JOURNAL_SIZE         256
+#define CFG_UHAB_BUS_MAX_CHANGES          64
+
+/** BUS waitstates wakeups coalescing window [ms], 0 disables coalescing */
+#define CFG_UHAB_BUS_WAITSTATE_COALESCE   50
+
+/** BUS min. contact click timer timeout [ms], inputs debounce time */
+#define CFG_UHAB_BUS_CLICK_MIN_TIMEOUT    50
+
+/** Initial size of the repository items hash index (power of 2) */
+#define CFG_UHAB_REPOSITORY_INDEX_SIZE    256
+
+/** Max length of the item tag name */
+#define CFG_UHAB_REPOSITORY_TAG_SIZE      32
+
+/** Number of items in one chunk of the items table */
+#define CFG_UHAB_ITEMS_CHUNK_SIZE         64
+
+/** Persistent item states flush period [ms] */
+#define CFG_UHAB_PERSIST_FLUSH_PERIOD     10000
+
+/** History raw samples segment size [bytes], segments and rollup records per item and tier */
+#define CFG_UHAB_HISTORY_SEGMENT_SIZE     512
+#define CFG_UHAB_HISTORY_SEGMENTS         16
+#define CFG_UHAB_HISTORY_ROLLUPS          288
+
+/** History rollup tiers periods [s], every period is a multiple of the previous one (5 min for 1 day, 1 hour for 12 days, 1 day for 9 months) */
+#define CFG_UHAB_HISTORY_ROLLUP_TIERS     3
+#define CFG_UHAB_HISTORY_ROLLUP_PERIODS   { 300, 3600, 86400 }
+
+/** History samples queue size (power of 2), writer poll and file sync periods [ms] */
+#define CFG_UHAB_HISTORY_QUEUE_SIZE       4096
+#define CFG_UHAB_HISTORY_POLL_PERIOD      20
+#define CFG_UHAB_HISTORY_SYNC_PERIOD      60000
+
+/** History query buckets (default count and max. count) */
+#define CFG_UHAB_HISTORY_BUCKETS          100
+#define CFG_UHAB_HISTORY_MAX_BUCKETS      1000
+
+/** Number of timers added to the timer service pool when it is empty */
+#define CFG_UHAB_TIMER_POOL_GROW          32
+
+/** Max. number of javascript timer objects */
+#define CFG_UHAB_JSCRIPT_MAX_TIMERS       256
+
+/** BUS worker threads (default and max. configurable count) */
+#define CFG_UHAB_BUS_NUM_WORKERS          1
+#define CFG_UHAB_BUS_MAX_WORKERS          8
 
 /** XML parser buffer size */
 #define CFG_XML_BUFSIZE                   8192
 
+/** Config XML reader read buffer, parser stack and element attributes size */
+#define CFG_UHAB_CONFIG_XML_READ_SIZE     512
+#define CFG_UHAB_CONFIG_XML_STACK_SIZE    256
+#define CFG_UHAB_CONFIG_XML_ATTRS_SIZE    1024
+
+/** Items files loader threads (default and max. configurable count) */
+#define CFG_UHAB_CONFIG_LOAD_THREADS      4
+#define CFG_UHAB_CONFIG_MAX_LOAD_THREADS  8
+
+/** Config objects arena block size */
+#define CFG_UHAB_ARENA_BLOCK_SIZE         4096
+
 /** Max double value number */
 #define CFG_MAX_DOUBLE_VALUE              100000000000.0
 
@@ -94,6 +167,13 @@ extern void uhab_system_shutdown(void);
 #define CFG_SYSTEM_CONFIG_KEY_BUS_LONGCLICK_TMLEN              "bus.longclick_timelen"
 #define CFG_SYSTEM_CONFIG_KEY_BUS_LONGPRESS_TMLEN              "bus.longpress_timelen"
 #define CFG_SYSTEM_CONFIG_KEY_BUS_WAITCHANGES_TIMEOUT          "bus.waitstate_changes_timeout"
+#define CFG_SYSTEM_CONFIG_KEY_BUS_WAITSTATE_COALESCE           "bus.waitstate_coalesce_ms"
+#define CFG_SYSTEM_CONFIG_KEY_BUS_WORKERS                      "bus.workers"
+#define CFG_SYSTEM_CONFIG_KEY_BUS_COALESCE                     "bus.coalesce"
+#define CFG_SYSTEM_CONFIG_KEY_BUS_LANE_OVERFLOW                "bus.%s.overflow"
+#define CFG_SYSTEM_CONFIG_KEY_BUS_LANE_BLOCK_TIMEOUT           "bus.%s.block_timeout"
+#define CFG_SYSTEM_CONFIG_KEY_PERSIST_FLUSH_PERIOD             "persist.flush_period"
+#define CFG_SYSTEM_CONFIG_KEY_CONFIG_LOAD_THREADS              "config.load_threads"
 
 #define CFG_BINDING_MAXNUM_ARGS            16
 #define CFG_UHAB_HTTP_QUEUE_SIZE           64
@@ -104,9 +184,21 @@ extern void uhab_system_shutdown(void);
 #define CFG_INIT_THREAD_STACK_SIZE         (32 * 1024)
 #define CFG_INIT_THREAD_PRIORITY           osPriorityNormal
 
+#define CFG_TIMER_THREAD_STACK_SIZE        2048
+#define CFG_TIMER_THREAD_PRIORITY          osPriorityAboveNormal
+
 #define CFG_BUS_THREAD_STACK_SIZE          2048
 #define CFG_BUS_THREAD_PRIORITY            osPriorityNormal
 
+#define CFG_CONFIG_LOAD_THREAD_STACK_SIZE  2048
+#define CFG_CONFIG_LOAD_THREAD_PRIORITY    osPriorityNormal
+
+#define CFG_PERSIST_THREAD_STACK_SIZE      2048
+#define CFG_PERSIST_THREAD_PRIORITY        osPriorityNormal
+
+#define CFG_HISTORY_THREAD_STACK_SIZE      2048
+#define CFG_HISTORY_THREAD_PRIORITY        osPriorityNormal
+
 #define CFG_MODBUS_THREAD_STACK_SIZE       2048
 #define CFG_MODBUS_THREAD_PRIORITY         osPriorityNormal
 
@@ -154,14 +246,20 @@ extern void uhab_system_shutdown(void);
 
 #define CFG_UHAB_RULES_CFG_DIR            CFG_UHAB_ROOT_FS "/conf/rules"
 #define CFG_UHAB_RULES_CFG_FILENAME       CFG_UHAB_RULES_CFG_DIR "/%s.rules"
-#define CFG_UHAB_RULES_JSCRIPT_FILENAME   "/tmp/uhab-rules.js"
+#define CFG_UHAB_RULES_JSCRIPT_FILENAME   CFG_UHAB_CONFIG_CACHE_DIR "/uhab-rules.js"
 
 #define CFG_UHAB_SITEMAP_CFG_DIR          CFG_UHAB_ROOT_FS "/conf/sitemaps"
 #define CFG_UHAB_SITEMAP_CFG_FILENAME     CFG_UHAB_ROOT_FS "/conf/sitemaps/%s.sitemap"
 
+#define CFG_UHAB_CONFIG_CACHE_DIR         CFG_UHAB_ROOT_FS "/conf/cache"
+#define CFG_UHAB_CONFIG_CACHE_FILENAME    CFG_UHAB_CONFIG_CACHE_DIR "/%s.bin"
+
 #define CFG_UHAB_UPGRADE_FILENAME         CFG_UHAB_ROOT_FS "/upgrade.pkg"
 #define CFG_UHAB_BACKUP_FILENAME          CFG_UHAB_ROOT_FS  "/backup.pkg"
 
+#define CFG_UHAB_PERSIST_FILENAME         CFG_UHAB_ROOT_FS "/item_state.dat"
+#define CFG_UHAB_HISTORY_FILENAME         CFG_UHAB_ROOT_FS "/item_history.dat"
+
 #define CFG_UHAB_ICONS_DIR                CFG_UHAB_ROOT_FS "/icons"
 #define CFG_UHAB_ICON_FILENAME            CFG_UHAB_ICONS_DIR "/%s.png"
 
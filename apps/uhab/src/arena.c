@@ -0,0 +1,105 @@
+/**
+ * \file arena.c       \brief uHAB arena allocator of the config lifetime objects
+ *
+ * Config objects (items strings, rules, actions, widgets, mappings) live until the config is
+ * unloaded. They are taken from the arena blocks by bumping the block offset, which avoids
+ * heap fragmentation by many small allocations. Arena is not locked, it is used by one loader.
+ */
+
+#include "uhab.h"
+
+TRACE_TAG(arena);
+#if !ENABLE_TRACE_CONFIG
+#include "trace_undef.h"
+#endif
+
+/** Allocation alignment */
+#define ARENA_ALIGN(_size)    (((_size) + sizeof(double) - 1) & ~(sizeof(double) - 1))
+
+
+/** Initialize empty arena */
+void uhab_arena_init(uhab_arena_t *arena, const char *name)
+{
+   os_memset(arena, 0, sizeof(uhab_arena_t));
+   arena->name = name;
+}
+
+/** Free all arena objects */
+void uhab_arena_free(uhab_arena_t *arena)
+{
+   uhab_arena_block_t *block;
+
+   if (arena->blocks_count > 0)
+   {
+      TRACE("Arena %s: %d objects, used: %d  allocated: %d in %d blocks", arena->name, arena->allocs,
+            arena->used, arena->allocated, arena->blocks_count);
+   }
+
+   while ((block = arena->blocks) != NULL)
+   {
+      arena->blocks = block->next;
+      os_free(block);
+   }
+
+   uhab_arena_init(arena, arena->name);
+}
+
+/** Alloc zeroed object in the arena */
+void *uhab_arena_alloc(uhab_arena_t *arena, uint32_t size)
+{
+   void *ptr;
+   uint32_t bsize;
+   uhab_arena_block_t *block;
+
+   size = ARENA_ALIGN(size);
+
+   if ((block = arena->blocks) == NULL || block->size - block->used < size)
+   {
+      // Large object gets its own block, the current block is kept for the next objects
+      bsize = (size > CFG_UHAB_ARENA_BLOCK_SIZE / 4) ? size : CFG_UHAB_ARENA_BLOCK_SIZE;
+
+      if ((block = os_malloc(sizeof(uhab_arena_block_t) + bsize)) == NULL)
+      {
+         TRACE_ERROR("Alloc arena %s block, size: %d", arena->name, bsize);
+         return NULL;
+      }
+      block->size = bsize;
+      block->used = 0;
+
+      if (bsize == size && arena->blocks != NULL)
+      {
+         block->next = arena->blocks->next;
+         arena->blocks->next = block;
+      }
+      else
+      {
+         block->next = arena->blocks;
+         arena->blocks = block;
+      }
+
+      arena->allocated += bsize;
+      arena->blocks_count++;
+   }
+
+   ptr = (uint8_t *)block->data + block->used;
+   block->used += size;
+
+   arena->used += size;
+   arena->allocs++;
+
+   os_memset(ptr, 0, size);
+
+   return ptr;
+}
+
+/** Duplicate string in the arena */
+char *uhab_arena_strdup(uhab_arena_t *arena, const char *str)
+{
+   int len = strlen(str) + 1;
+   char *dup;
+
+   if ((dup = uhab_arena_alloc(arena, len)) != NULL)
+      memcpy(dup, str, len);
+
+   return dup;
+}
@@ -0,0 +1,50 @@
+/**
+ * \file arena.h       \brief uHAB arena allocator of the config lifetime objects
+ */
+
+#ifndef __UHAB_ARENA_H
+#define __UHAB_ARENA_H
+
+
+/** Arena memory block */
+typedef struct uhab_arena_block
+{
+   struct uhab_arena_block *next;
+   uint32_t size;
+   uint32_t used;
+
+   /** Block data, aligned to double */
+   double data[];
+
+} uhab_arena_block_t;
+
+
+/** Arena, objects are not freed one by one, all arena blocks are freed at once */
+typedef struct
+{
+   const char *name;
+   uhab_arena_block_t *blocks;
+
+   /** Statistics */
+   uint32_t used;
+   uint32_t allocated;
+   uint32_t allocs;
+   uint32_t blocks_count;
+
+} uhab_arena_t;
+
+
+/** Initialize empty arena */
+void uhab_arena_init(uhab_arena_t *arena, const char *name);
+
+/** Free all arena objects */
+void uhab_arena_free(uhab_arena_t *arena);
+
+/** Alloc zeroed object in the arena */
+void *uhab_arena_alloc(uhab_arena_t *arena, uint32_t size);
+
+/** Duplicate string in the arena */
+char *uhab_arena_strdup(uhab_arena_t *arena, const char *str);
+
+
+#endif // __UHAB_ARENA_H
@@ -13,21 +13,9 @@ static const uhab_rule_action_definition_t uhab_rule_action_def[] =
    {NULL}
 };
 
-uhab_rule_action_t *uhab_rule_action_alloc(void)
+uhab_rule_action_t *uhab_rule_action_alloc(uhab_arena_t *arena)
 {
-   uhab_rule_action_t *action;
-   
-   if ((action = os_malloc(sizeof(uhab_rule_action_t))) != NULL)
-   {
-      os_memset(action, 0, sizeof(uhab_rule_action_t));
-   }
-   
-   return action;
-}
-
-void uhab_rule_action_free(uhab_rule_action_t *action)
-{
-   os_free(action);
+   return uhab_arena_alloc(arena, sizeof(uhab_rule_action_t));
 }
 
 
@@ -47,11 +47,8 @@ typedef struct uhab_rule_action
 } uhab_rule_action_t;
 
 
-/** Alloc rule action */
-uhab_rule_action_t *uhab_rule_action_alloc(void);
-
-/** Free rule action */
-void uhab_rule_action_free(uhab_rule_action_t *action);
+/** Alloc rule action in the config arena */
+uhab_rule_action_t *uhab_rule_action_alloc(uhab_arena_t *arena);
 
 /** Get rule action definition */
 const uhab_rule_action_definition_t *uhab_rule_action_get_definition(const char *name);
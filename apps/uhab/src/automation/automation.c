@@ -12,17 +12,22 @@ TRACE_TAG(automation);
 
 // Prototypes:
 static void uhab_automation_cleanup(uhab_automation_t *au);
+static void release_rules(uhab_automation_t *au);
+static int execute_rules(uhab_rule_event_t event, uhab_item_t *item, uhab_item_state_t *newstate);
 
 
 int uhab_automation_init(uhab_automation_t *au)
 {
    DIR *d = NULL;
    struct dirent *dir;
+   hal_time_t start_time = hal_time_ms();
+   int count = 0;
    char path[255];
 
    os_memset(au, 0, sizeof(uhab_automation_t));
 
    LIST_STRUCT_INIT(au, scripts);
+   uhab_arena_init(&au->arena, "rules");
 
    // Create process mutex
    if ((au->mutex = osMutexCreate(NULL)) == NULL)
@@ -49,9 +54,12 @@ int uhab_automation_init(uhab_automation_t *au)
             TRACE_ERROR("Load automation rules: %s", path);
             throw_exception(fail_readdir);
          }
+         count++;
       }
    }
 
+   TRACE("Rules: %d files loaded in %d ms", count, (int)(hal_time_ms() - start_time));
+
    // Initialize javascript interpreter
    if (uhab_jscript_init(au) != 0)
    {
@@ -73,6 +81,7 @@ fail_jscript_init:
 fail_readdir:
    closedir(d);
 fail_opendir:
+   release_rules(au);
    osMutexDelete(au->mutex);
 fail_mutex:
    return -1;
@@ -87,6 +96,7 @@ int uhab_automation_deinit(uhab_automation_t *au)
    if (au->mutex != NULL)
       osMutexDelete(au->mutex);
 
+   uhab_arena_free(&au->arena);
    os_memset(au, 0, sizeof(uhab_automation_t));
 
    TRACE("Deinit");
@@ -97,7 +107,6 @@ int uhab_automation_deinit(uhab_automation_t *au)
 int uhab_automation_process_event(uhab_automation_t *au, uhab_rule_event_t event, uhab_item_t *item, uhab_item_state_t *newstate)
 {
    int res = 0;
-   uhab_rule_t *rule;
 
    if (!au->initialized)
    {
@@ -105,12 +114,71 @@ int uhab_automation_process_event(uhab_automation_t *au, uhab_rule_event_t event
       return -1;
    }
 
+   // Item without rules updates its JS state property only, it is guarded by the jscript lock
+   if (!uhab_automation_has_rules(item))
+      return uhab_jscript_update(item, newstate);
+
    osMutexWait(au->mutex, osWaitForever);
 
    // Update state property only
    res += uhab_jscript_update(item, newstate);
 
    // Execute rule by event type
+   res += execute_rules(event, item, newstate);
+
+   osMutexRelease(au->mutex);
+
+   return res;
+}
+
+/** Process batch of events, rules see the new states of all batch items */
+int uhab_automation_process_batch(uhab_automation_t *au, const uhab_rule_event_t events[], uhab_item_t * const items[], uhab_item_state_t newstates[], int count)
+{
+   int ix, res = 0;
+
+   if (!au->initialized)
+   {
+      TRACE_ERROR("Automation does not initialized");
+      return -1;
+   }
+
+   for (ix = 0; ix < count && !uhab_automation_has_rules(items[ix]); ix++);
+
+   // Batch without rules updates the JS state properties only
+   if (ix == count)
+   {
+      for (ix = 0; ix < count; ix++)
+         res += uhab_jscript_update(items[ix], &newstates[ix]);
+
+      return res;
+   }
+
+   osMutexWait(au->mutex, osWaitForever);
+
+   // Update state property of all batch items first
+   for (ix = 0; ix < count; ix++)
+      res += uhab_jscript_update(items[ix], &newstates[ix]);
+
+   // Execute rules by event type
+   for (ix = 0; ix < count; ix++)
+      res += execute_rules(events[ix], items[ix], &newstates[ix]);
+
+   osMutexRelease(au->mutex);
+
+   return res;
+}
+
+int uhab_automation_has_rules(const uhab_item_t *item)
+{
+   return list_head(item->automation.rules) != NULL;
+}
+
+/** Execute item rules by event type */
+static int execute_rules(uhab_rule_event_t event, uhab_item_t *item, uhab_item_state_t *newstate)
+{
+   int res = 0;
+   uhab_rule_t *rule;
+
    for (rule = list_head(item->automation.rules); rule != NULL; rule = list_item_next(rule))
    {
       if (rule->event == event || ((rule->event == UHAB_RULE_EVENT_CHANGED) && (event & UHAB_RULE_EVENT_CHANGED)))
@@ -122,8 +190,6 @@ int uhab_automation_process_event(uhab_automation_t *au, uhab_rule_event_t event
       }
    }
 
-   osMutexRelease(au->mutex);
-
    return res;
 }
 
@@ -144,3 +210,19 @@ static void uhab_automation_cleanup(uhab_automation_t *au)
       os_free(script);
    }
 }
+
+/** Release rules of the failed init, rules are detached from the items and freed with the scripts */
+static void release_rules(uhab_automation_t *au)
+{
+   uhab_item_id_t id;
+   uhab_item_t *item;
+
+   for (id = 0; id < uhab_item_get_max_id(); id++)
+   {
+      if ((item = uhab_item_get(id)) != NULL)
+         list_init(item->automation.rules);
+   }
+
+   uhab_automation_cleanup(au);
+   uhab_arena_free(&au->arena);
+}
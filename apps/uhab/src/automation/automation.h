@@ -25,6 +25,9 @@ typedef struct
    
    /** Process mutex */
    osMutexId mutex;
+
+   /** Rules and actions config */
+   uhab_arena_t arena;
    
 } uhab_automation_t;
 
@@ -35,8 +38,14 @@ int uhab_automation_init(uhab_automation_t *au);
 /** Deinitialize automation module */
 int uhab_automation_deinit(uhab_automation_t *au);
 
+/** Item has automation rules, events of other items don't take the automation lock */
+int uhab_automation_has_rules(const uhab_item_t *item);
+
 /** Process event rule handler */
 int uhab_automation_process_event(uhab_automation_t *au, uhab_rule_event_t event, uhab_item_t *item, uhab_item_state_t *newstate);
 
+/** Process batch of events, rules see the new states of all batch items */
+int uhab_automation_process_batch(uhab_automation_t *au, const uhab_rule_event_t events[], uhab_item_t * const items[], uhab_item_state_t newstates[], int count);
+
 
 #endif // __UHAB_AUTOMATION_H
\ No newline at end of file
@@ -23,6 +23,7 @@ static osMutexId jscript_mutex;
 int uhab_jscript_init(uhab_automation_t *au)
 {
    v7_val_t result;
+   hal_time_t start_time;
 
    // Generate javascript rules
    if (uhab_jscript_generate(au, CFG_UHAB_RULES_JSCRIPT_FILENAME) != 0)
@@ -66,6 +67,7 @@ int uhab_jscript_init(uhab_automation_t *au)
    uhab_jscript_lock();
    
    // Exec rules script
+   start_time = hal_time_ms();
    if (v7_exec_file(v7, CFG_UHAB_RULES_JSCRIPT_FILENAME, &result) != V7_OK)
    {
       TRACE_ERROR("Evaluation error");
@@ -74,6 +76,8 @@ int uhab_jscript_init(uhab_automation_t *au)
    }
 
    uhab_jscript_unlock();
+
+   TRACE("Javascript rules executed in %d ms", (int)(hal_time_ms() - start_time));
    
    TRACE("Javascript engine init");
   
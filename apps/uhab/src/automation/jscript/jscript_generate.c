@@ -11,11 +11,19 @@ TRACE_GROUP(automation);
 
 #define ACTION_TIMER_FMTNAME  "timer%p"
 
+/** Generator version, generated file of the other version is not reused */
+#define JSCRIPT_GENERATE_VERSION    1
+
 // Prototypes:
 static int generate_rule_action(FILE *fs, uhab_rule_t *rule, uhab_rule_action_t *action);
+static int set_rules_functions(void);
+static int set_rule_function(uhab_item_t *item, uhab_rule_t *rule, char *buf, int bufsize);
+static void sources_key(char *buf, int bufsize);
+static void scan_sources(const char *dirname, const char *ext, uint32_t *mtime, uint32_t *count, uint32_t *size);
+static int is_generated(const char *jscript_filename, const char *key);
 
 
-/** Generate javascript functions */
+/** Generate javascript functions, file generated from the same sources is reused */
 int uhab_jscript_generate(uhab_automation_t *au, const char *jscript_filename)
 {
    FILE *fs;
@@ -24,17 +32,31 @@ int uhab_jscript_generate(uhab_automation_t *au, const char *jscript_filename)
    uhab_rule_action_t *action, *prev_action;
    uint8_t timer_def;
    uhab_automation_script_t *script;
+   hal_time_t start_time = hal_time_ms();
+   char key[128];
+   char path[255];
    char buf[255];
-   
-   // Create javascript rules file
-   if ((fs = fopen(jscript_filename, "w")) == NULL)
+
+   sources_key(key, sizeof(key));
+
+   if (is_generated(jscript_filename, key))
    {
-      TRACE_ERROR("Can't create javascript rules file", jscript_filename);
+      TRACE("Reuse jscript rules file: %s", jscript_filename);
+      return set_rules_functions();
+   }
+
+   // Create javascript rules file, it replaces the previous one when complete
+   mkdir(CFG_UHAB_CONFIG_CACHE_DIR, 0755);
+   snprintf(path, sizeof(path), "%s.tmp", jscript_filename);
+   if ((fs = fopen(path, "w")) == NULL)
+   {
+      TRACE_ERROR("Can't create javascript rules file %s", path);
       throw_exception(fail_create);
    }
    
    TRACE("Generate jscript rules file: %s", jscript_filename);
    
+   fprintf(fs, "%s", key);
    fprintf(fs, "//\n");
    fprintf(fs, "// Generated javascript items rules, don't edit this file !\n");
    fprintf(fs, "//\n\n");
@@ -61,7 +83,7 @@ int uhab_jscript_generate(uhab_automation_t *au, const char *jscript_filename)
    }
    
    // Items
-   for (item = list_head(repository.items); item != NULL; item = list_item_next(item))
+   for (item = uhab_item_first(); item != NULL; item = uhab_item_next(item))
    {
       // Rules
       for (rule = list_head(item->automation.rules); rule != NULL; rule = list_item_next(rule))
@@ -110,8 +132,7 @@ int uhab_jscript_generate(uhab_automation_t *au, const char *jscript_filename)
          }
 
          // Generate javascript function
-         snprintf(buf, sizeof(buf), "%s_%s_event", item->name, rule->evtdef->name);
-         if ((rule->jscript_function = os_strdup(buf)) == NULL)
+         if (set_rule_function(item, rule, buf, sizeof(buf)) != 0)
               throw_exception(fail_generate);
 
          fprintf(fs, "function %s() {\n", buf);    
@@ -130,12 +151,20 @@ int uhab_jscript_generate(uhab_automation_t *au, const char *jscript_filename)
       }
    }
    
-   fclose(fs);
+   if (fclose(fs) != 0 || rename(path, jscript_filename) != 0)
+   {
+      TRACE_ERROR("Write javascript rules file %s", jscript_filename);
+      throw_exception(fail_write);
+   }
+
+   TRACE("Jscript rules generated in %d ms", (int)(hal_time_ms() - start_time));
    
    return 0;
 
 fail_generate:
    fclose(fs);
+fail_write:
+   unlink(path);
 fail_create:
    return -1;
 }
@@ -172,3 +201,96 @@ static int generate_rule_action(FILE *fs, uhab_rule_t *rule, uhab_rule_action_t
 
    return 0;
 }
+
+/** Set javascript functions names of all rules */
+static int set_rules_functions(void)
+{
+   uhab_item_t *item;
+   uhab_rule_t *rule;
+   char buf[255];
+
+   for (item = uhab_item_first(); item != NULL; item = uhab_item_next(item))
+   {
+      for (rule = list_head(item->automation.rules); rule != NULL; rule = list_item_next(rule))
+      {
+         if (set_rule_function(item, rule, buf, sizeof(buf)) != 0)
+            return -1;
+      }
+   }
+
+   return 0;
+}
+
+/** Set javascript function name of the rule to the rule and buffer */
+static int set_rule_function(uhab_item_t *item, uhab_rule_t *rule, char *buf, int bufsize)
+{
+   snprintf(buf, bufsize, "%s_%s_event", item->name, rule->evtdef->name);
+
+   if ((rule->jscript_function = os_strdup(buf)) == NULL)
+      return -1;
+
+   return 0;
+}
+
+/**
+ * Sources key line of the generated file, items and rules files are described by their count, total size
+ * and the latest modification time. Generator version and build time invalidate the file of the other firmware.
+ */
+static void sources_key(char *buf, int bufsize)
+{
+   uint32_t mtime = 0, count = 0, size = 0;
+
+   scan_sources(CFG_UHAB_ITEMS_CFG_DIR, ".items", &mtime, &count, &size);
+   scan_sources(CFG_UHAB_RULES_CFG_DIR, ".rules", &mtime, &count, &size);
+
+   snprintf(buf, bufsize, "// Sources: %d %s %s %u %u %u\n", JSCRIPT_GENERATE_VERSION, __DATE__, __TIME__,
+            (unsigned)mtime, (unsigned)count, (unsigned)size);
+}
+
+/** Add files of the directory to the sources latest mtime, count and total size */
+static void scan_sources(const char *dirname, const char *ext, uint32_t *mtime, uint32_t *count, uint32_t *size)
+{
+   DIR *d;
+   struct dirent *dir;
+   struct stat st;
+   char path[255];
+
+   if ((d = opendir(dirname)) == NULL)
+      return;
+
+   while ((dir = readdir(d)) != NULL)
+   {
+      if (strstr(dir->d_name, ext) == NULL)
+         continue;
+
+      snprintf(path, sizeof(path), "%s/%s", dirname, dir->d_name);
+      if (stat(path, &st) != 0)
+         continue;
+
+      if ((uint32_t)st.st_mtime > *mtime)
+         *mtime = st.st_mtime;
+
+      *count += 1;
+      *size += st.st_size;
+   }
+
+   closedir(d);
+}
+
+/** Test javascript file was generated from the sources of the key */
+static int is_generated(const char *jscript_filename, const char *key)
+{
+   FILE *fs;
+   char line[128];
+   int res = 0;
+
+   if ((fs = fopen(jscript_filename, "r")) == NULL)
+      return 0;
+
+   if (fgets(line, sizeof(line), fs) != NULL && !strcmp(line, key))
+      res = 1;
+
+   fclose(fs);
+
+   return res;
+}
@@ -13,6 +13,7 @@ TRACE_GROUP(automation);
 // Prototypes:
 static enum v7_err js_item_send_command(struct v7 *v7, v7_val_t *res) ;
 static enum v7_err js_item_update(struct v7 *v7, v7_val_t *res);
+static enum v7_err js_update_batch(struct v7 *v7, v7_val_t *res);
 
 
 /** Initialize items module */
@@ -20,9 +21,12 @@ int jscript_items_init(struct v7 *v7)
 {
    uhab_item_t *item;
    v7_val_t value = V7_NULL;
+
+   // Define global functions
+   VERIFY(v7_set_method(v7, v7_get_global(v7), "update_batch", &js_update_batch) == V7_OK);
    
    // Define js item objects
-   for (item = list_head(repository.items); item != NULL; item = list_item_next(item))
+   for (item = uhab_item_first(); item != NULL; item = uhab_item_next(item))
    {
       // Create static item object
       item->automation.jsobject = v7_mk_object(v7);     
@@ -126,7 +130,7 @@ static enum v7_err js_item_update(struct v7 *v7, v7_val_t *res)
       }
 
       // Execute update
-      if (uhab_bus_update(item, &state) != 0)
+      if (uhab_bus_update_cmd(item, &state) != 0)
       {
          TRACE_ERROR("Send command to item: %s", item->name);
          throw_exception(fail);
@@ -144,3 +148,90 @@ fail:
    *res = v7_mk_number(v7, -1);
    return V7_OK; 
 }
+
+/** Update batch of items - update_batch(item1, value1, item2, value2, ...) */
+static enum v7_err js_update_batch(struct v7 *v7, v7_val_t *res)
+{
+   unsigned long ix, argc;
+   int count = 0;
+   v7_val_t obj, value;
+   uhab_item_t *item;
+   const uhab_item_t **items = NULL;
+   uhab_item_state_t *states = NULL;
+
+   argc = v7_argc(v7);
+
+   if ((argc % 2) != 0 || argc / 2 > CFG_UHAB_BUS_MAX_BATCH)
+   {
+      TRACE_ERROR("update_batch: expected max. %d pairs of item and value", CFG_UHAB_BUS_MAX_BATCH);
+      throw_exception(fail);
+   }
+
+   if ((items = os_malloc((argc / 2) * sizeof(uhab_item_t *))) == NULL || (states = os_malloc((argc / 2) * sizeof(uhab_item_state_t))) == NULL)
+   {
+      TRACE_ERROR("update_batch: alloc");
+      throw_exception(fail);
+   }
+   os_memset(states, 0, (argc / 2) * sizeof(uhab_item_state_t));
+
+   for (ix = 0; ix < argc; ix += 2)
+   {
+      obj = v7_arg(v7, ix);
+      value = v7_arg(v7, ix + 1);
+
+      // Get item pointer
+      if (!v7_is_object(obj) || (item = v7_get_user_data(v7, obj)) == NULL)
+      {
+         TRACE_ERROR("update_batch: argument %lu is not item", ix);
+         throw_exception(fail);
+      }
+
+      if (item->automation.event_pending)
+      {
+         // Update js object item state only
+         v7_set(v7, item->automation.jsobject, "state", ~0, value);
+         continue;
+      }
+
+      // Convert jsvascript to item state
+      if (jsvalue_to_itemstate(v7, &value, &states[count]) != 0)
+      {
+         TRACE_ERROR("conversion jscript value -> item state failed");
+         throw_exception(fail);
+      }
+
+      items[count++] = item;
+   }
+
+   // Execute batch update
+   if (count > 0 && uhab_bus_update_batch_cmd(items, states, count) != 0)
+   {
+      TRACE_ERROR("Update batch of %d items", count);
+      throw_exception(fail);
+   }
+
+   for (ix = 0; ix < count; ix++)
+      uhab_item_state_release(&states[ix]);
+
+   os_free(states);
+   os_free(items);
+
+   *res = v7_mk_number(v7, 0);
+
+   return V7_OK;
+
+fail:
+   if (states != NULL)
+   {
+      for (ix = 0; ix < count; ix++)
+         uhab_item_state_release(&states[ix]);
+
+      os_free(states);
+   }
+
+   if (items != NULL)
+      os_free(items);
+
+   *res = v7_mk_number(v7, -1);
+   return V7_OK;
+}
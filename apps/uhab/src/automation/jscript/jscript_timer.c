@@ -10,14 +10,24 @@ TRACE_GROUP(automation);
 #include "trace_undef.h"
 #endif
 
-typedef struct
+/** Timer id is the timers table index with the slot generation, id of the destroyed timer is never valid again */
+#define JS_TIMER_ID(_index, _gen)   (((uint32_t)(_gen) << 16) | (uint32_t)(_index))
+#define JS_TIMER_INDEX(_id)         ((_id) & 0xFFFF)
+
+typedef struct js_timer
 {
    struct v7 *v7;
-   osTimerId id;
+   uhab_timer_t *handle;
    v7_val_t func_cb;
+   uint32_t id;         // Current id, 0 when the timer slot is free
+   uint16_t gen;        // Slot generation, incremented on every reuse
    
 } js_timer_t;
 
+#if CFG_UHAB_JSCRIPT_MAX_TIMERS > 0xFFFF
+#error "Javascript timer index must fit to 16 bits of the timer id"
+#endif
+
 
 // Prototypes:
 static enum v7_err js_timer_create(struct v7 *v7, v7_val_t *res);
@@ -25,6 +35,11 @@ static enum v7_err js_timer_destroy(struct v7 *v7, v7_val_t *res);
 static enum v7_err js_timer_start(struct v7 *v7, v7_val_t *res);
 static enum v7_err js_timer_stop(struct v7 *v7, v7_val_t *res);
 static void js_timer_callback(void *arg);
+static js_timer_t *alloc_timer(void);
+static void free_timer(js_timer_t *timer);
+
+/** Timer objects table, destroyed timers are reused, accessed with locked jscript */
+static js_timer_t *timers[CFG_UHAB_JSCRIPT_MAX_TIMERS];
 
 
 int jscript_timer_init(struct v7 *v7)
@@ -39,8 +54,7 @@ static enum v7_err js_timer_create(struct v7 *v7, v7_val_t *result)
    v7_val_t this_obj;
    v7_val_t value, func_cb;
    js_timer_t *timer = NULL;
-   os_timer_type type;
-   const osTimerDef(JS_TIMER, js_timer_callback);
+   uhab_timer_type_t type;
 
    // Get input args
    value = v7_arg(v7, 0);
@@ -50,7 +64,7 @@ static enum v7_err js_timer_create(struct v7 *v7, v7_val_t *result)
       throw_exception(fail);
    }
    type = v7_get_int(v7, value);
-   if (type != osTimerOnce && type != osTimerPeriodic)
+   if (type != UHAB_TIMER_ONCE && type != UHAB_TIMER_PERIODIC)
    {
       TRACE_ERROR("Bad type of timer type: %d", type);
       throw_exception(fail);
@@ -75,13 +89,14 @@ static enum v7_err js_timer_create(struct v7 *v7, v7_val_t *result)
       throw_exception(fail);
    }
    
-   if ((timer = os_malloc(sizeof(js_timer_t))) == NULL)
+   if ((timer = alloc_timer()) == NULL)
    {
       TRACE_ERROR("Alloc timer object");
       throw_exception(fail);
    }
    
-   if ((timer->id = osTimerCreate(osTimer(JS_TIMER), type, timer)) == NULL)
+   // Callback gets the timer id, pending callback of the destroyed timer doesn't match the reused slot
+   if ((timer->handle = uhab_timer_create(js_timer_callback, type, (void *)(uintptr_t)timer->id)) == NULL)
    {
       TRACE_ERROR("Create timer failed");
       throw_exception(fail);
@@ -99,7 +114,7 @@ static enum v7_err js_timer_create(struct v7 *v7, v7_val_t *result)
    
 fail:
    if (timer != NULL)
-      os_free(timer);
+      free_timer(timer);
    *result = V7_NULL; 
    return V7_OK;
 }
@@ -117,8 +132,9 @@ static enum v7_err js_timer_destroy(struct v7 *v7, v7_val_t *res)
       throw_exception(fail);
    }
    
-   osTimerDelete(timer->id);
-   os_free(timer);
+   uhab_timer_delete(timer->handle);
+   timer->handle = NULL;
+   free_timer(timer);
    v7_set_user_data(v7, this_obj, NULL);
 
    // Set output result
@@ -156,7 +172,7 @@ static enum v7_err js_timer_start(struct v7 *v7, v7_val_t *res)
       throw_exception(fail);
    }
    
-   if (osTimerStart(timer->id, interval) != osOK)
+   if (uhab_timer_start(timer->handle, interval) != 0)
    {
       TRACE_ERROR("Start timer failed");
       throw_exception(fail);
@@ -187,7 +203,7 @@ static enum v7_err js_timer_stop(struct v7 *v7, v7_val_t *res)
       throw_exception(fail);
    }
    
-   if (osTimerStop(timer->id) != osOK)
+   if (uhab_timer_stop(timer->handle) != 0)
    {
       TRACE_ERROR("Stop timer failed");
       throw_exception(fail);
@@ -209,17 +225,56 @@ fail:
 
 static void js_timer_callback(void *arg)
 {
-   js_timer_t *timer = arg;
+   uint32_t id = (uint32_t)(uintptr_t)arg;
+   js_timer_t *timer;
    v7_val_t result;
 
-   ASSERT(timer != NULL);
-
    uhab_jscript_lock();
    
-   if (v7_apply(timer->v7, timer->func_cb, V7_UNDEFINED, V7_UNDEFINED, &result) != V7_OK) 
+   // Timer could be destroyed (and its slot reused) while the callback was waiting for the lock
+   timer = timers[JS_TIMER_INDEX(id)];
+   if (timer != NULL && timer->id == id && v7_apply(timer->v7, timer->func_cb, V7_UNDEFINED, V7_UNDEFINED, &result) != V7_OK) 
    {
       v7_print_error(stderr, timer->v7, "Error while calling timer callback\n", result);
    }
 
    uhab_jscript_unlock();
 }
+
+/** Take free timer slot with new id, slot objects are never released */
+static js_timer_t *alloc_timer(void)
+{
+   int ix;
+   js_timer_t *timer;
+
+   // First destroyed or not yet allocated slot
+   for (ix = 0; ix < CFG_UHAB_JSCRIPT_MAX_TIMERS && timers[ix] != NULL && timers[ix]->id != 0; ix++);
+
+   if (ix == CFG_UHAB_JSCRIPT_MAX_TIMERS)
+   {
+      TRACE_ERROR("Max. %d timers exceeded", CFG_UHAB_JSCRIPT_MAX_TIMERS);
+      return NULL;
+   }
+
+   if ((timer = timers[ix]) == NULL)
+   {
+      if ((timer = os_malloc(sizeof(js_timer_t))) == NULL)
+         return NULL;
+
+      os_memset(timer, 0, sizeof(js_timer_t));
+      timers[ix] = timer;
+   }
+
+   // Generation 0 is skipped, id 0 marks the free slot
+   if (++timer->gen == 0)
+      timer->gen = 1;
+   timer->id = JS_TIMER_ID(ix, timer->gen);
+
+   return timer;
+}
+
+/** Return timer slot for reuse */
+static void free_timer(js_timer_t *timer)
+{
+   timer->id = 0;
+}
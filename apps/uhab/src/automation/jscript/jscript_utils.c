@@ -38,12 +38,16 @@ int itemstate_to_jsvalue(struct v7 *v7, const uhab_item_state_t *state, v7_val_t
          
       case UHAB_ITEM_STATE_TYPE_STRING:
       {
-         char buf[255];
+         uhab_item_state_t snap;
+         const char *str;
 
-         if (uhab_item_state_get_string(state, buf, sizeof(buf)) != 0)
+         // Take string reference, string is not truncated
+         if (uhab_item_state_copy(&snap, state) != 0)
             return -1;
 
-         *value = v7_mk_string(v7, buf, ~0, 1);
+         str = uhab_item_state_str(&snap);
+         *value = (str != NULL) ? v7_mk_string(v7, str, ~0, 1) : V7_NULL;
+         uhab_item_state_release(&snap);
       }
       break;
 
@@ -22,24 +22,18 @@ static const uhab_rule_event_definition_t uhab_rule_events_def[] =
 };
 
 
-uhab_rule_t *uhab_rule_alloc(void)
+uhab_rule_t *uhab_rule_alloc(uhab_arena_t *arena)
 {
    uhab_rule_t *rule;
    
-   if ((rule = os_malloc(sizeof(uhab_rule_t))) != NULL)
+   if ((rule = uhab_arena_alloc(arena, sizeof(uhab_rule_t))) != NULL)
    {
-      memset(rule, 0, sizeof(uhab_rule_t));
       LIST_STRUCT_INIT(rule, actions);
    }
    
    return rule;
 }
 
-void uhab_rule_free(uhab_rule_t *rule)
-{
-   os_free(rule);
-}
-
 const uhab_rule_event_definition_t *uhab_rule_get_definition(const char *name)
 {
    const uhab_rule_event_definition_t *def;
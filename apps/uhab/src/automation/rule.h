@@ -58,11 +58,8 @@ typedef struct uhab_rule
 } uhab_rule_t;
 
 
-/** Alloc new rule */
-uhab_rule_t *uhab_rule_alloc(void);
-
-/** Free allocated rule */
-void uhab_rule_free(uhab_rule_t *rule);
+/** Alloc new rule in the config arena */
+uhab_rule_t *uhab_rule_alloc(uhab_arena_t *arena);
 
 /** Get rule event definition */
 const uhab_rule_event_definition_t *uhab_rule_get_definition(const char *name);
@@ -92,6 +92,7 @@ int uhab_binding_deinit(void)
 int uhab_binding_start(void)
 {
    int ix, res = 0;
+   uhab_item_id_t id;
    uhab_item_t *item;
 
    for (ix = 0; ix < BINDINGS_COUNT; ix++)
@@ -104,9 +105,10 @@ int uhab_binding_start(void)
    }
 
    // Notify all items start event
-   for (item = list_head(repository.items); item != NULL; item = list_item_next(item))
+   for (id = 0; id < uhab_item_get_max_id(); id++)
    {
-      res += uhab_automation_process_event(&automation, UHAB_RULE_EVENT_START, item, &item->state);
+      if ((item = uhab_item_get(id)) != NULL)
+         res += uhab_automation_process_event(&automation, UHAB_RULE_EVENT_START, item, &item->state);
    }
 
    if (res != 0)
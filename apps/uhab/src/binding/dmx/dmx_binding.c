@@ -461,7 +461,7 @@ static int dmx_binding_send(const uhab_item_t *item, const uhab_item_state_t *st
       uhab_item_state_set_number(&newstate, round(cmd->channel_values[0] / (CFG_DMX_MAX_CHANNEL_VALUE / 100.0)));
 
       // Update item state
-      return uhab_bus_update(item, &newstate);
+      return uhab_bus_update_cmd(item, &newstate);
    }
    else
    {
@@ -588,10 +588,8 @@ static int dmx_fader_start(dmx_device_item_t *devitem, dmx_cmd_t *cmd, int perio
    // Create a new timer
    if (devitem->fader.timer == NULL)
    {
-      const osTimerDef(FADER_TIMER, dmx_fader_timer_cb);
-
-      // Create click length timer
-      if ((devitem->fader.timer = osTimerCreate(osTimer(FADER_TIMER), osTimerPeriodic, devitem)) == NULL)
+      // Create fader timer
+      if ((devitem->fader.timer = uhab_timer_create(dmx_fader_timer_cb, UHAB_TIMER_PERIODIC, devitem)) == NULL)
       {
          TRACE_ERROR("Start fader timer");
          throw_exception(fail);
@@ -648,7 +646,7 @@ static int dmx_fader_start(dmx_device_item_t *devitem, dmx_cmd_t *cmd, int perio
       devitem->fader.endvalue = 0;
    }
 
-   VERIFY(osTimerStart(devitem->fader.timer, devitem->fader.interval) == osOK);
+   VERIFY(uhab_timer_start(devitem->fader.timer, devitem->fader.interval) == 0);
    devitem->fader.start_time = hal_time_ms();
    
    osMutexRelease(devitem->fader.mutex);
@@ -677,7 +675,7 @@ static dmx_cmd_t *dmx_fader_stop(dmx_device_item_t *devitem)
    }
 
    // Stop timer
-   VERIFY(osTimerDelete(devitem->fader.timer) == osOK);
+   uhab_timer_delete(devitem->fader.timer);
    devitem->fader.timer = NULL;
    devitem->fader.periodical = 0;
    
@@ -779,7 +777,7 @@ static void dmx_fader_timer_cb(void *arg)
          // Stop fader timer
          if (devitem->fader.timer != NULL)
          {
-            VERIFY(osTimerDelete(devitem->fader.timer) == osOK);
+            uhab_timer_delete(devitem->fader.timer);
             devitem->fader.timer = NULL;
             hal_gpio_set(HAL_GPIO2, 0);
             //TRACE("Fade done, cv: %d count: %d  fadelen: %d (ms)", devitem->channels_values[0], devitem->fader.count, hal_time_ms() - devitem->fader.start_time);
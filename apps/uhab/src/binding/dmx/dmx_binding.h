@@ -88,7 +88,7 @@ typedef struct dmx_device_item
 
    struct
    {
-      osTimerId timer;
+      uhab_timer_t *timer;
       osMutexId mutex;
       int periodical;
       int interval;
@@ -164,14 +164,20 @@ static int http_binding_send(const uhab_item_t *item, const uhab_item_state_t *s
       return -1;
    }
 
-   // Set queued item state
+   // Set queued item state, pool memory is not initialized state
    event->item = item;
-   uhab_item_state_set(&event->state, state);
+   if (uhab_item_state_copy(&event->state, state) != 0)
+   {
+      TRACE_ERROR("Alloc event state");
+      osPoolFree(pool, event);
+      return -1;
+   }
 
    // Add command to queue
    if (osMessagePut(queue, (uintptr_t)event, osWaitForever) != osOK)
    {
       TRACE_ERROR("Add event to queue");
+      uhab_item_state_release(&event->state);
       osPoolFree(pool, event);
       return -1;
    }
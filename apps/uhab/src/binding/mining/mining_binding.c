@@ -15,6 +15,7 @@ TRACE_TAG(binding_mining);
 static mining_device_t *alloc_mining_device(const char *name);
 static int free_mining_device(mining_device_t *dev);
 static void mining_thread(void *arg);
+static void update_batch(const uhab_item_t * const items[], uhab_item_state_t states[], int count);
 
 
 // Locals:
@@ -182,9 +183,13 @@ static int mining_binding_send(const uhab_item_t *item, const uhab_item_state_t
         throw_exception(fail);
     }
 
-    // Set queued item state
+    // Set queued item state, pool memory is not initialized state
     event->devitem = item->binding.protocol_item;
-    uhab_item_state_set(&event->state, state);
+    if (uhab_item_state_copy(&event->state, state) != 0)
+    {
+        TRACE_ERROR("Alloc event state");
+        throw_exception(fail_state);
+    }
 
     // Add command to queue
     if (osMessagePut(queue, (uintptr_t)event, osWaitForever) != osOK)
@@ -196,6 +201,8 @@ static int mining_binding_send(const uhab_item_t *item, const uhab_item_state_t
     return 0;
 
 fail:
+    uhab_item_state_release(&event->state);
+fail_state:
     if (event != NULL)
         osPoolFree(pool, event);
 
@@ -264,6 +271,9 @@ static void mining_thread(void *arg)
     mining_device_item_t *devitem;
     mining_jsonrpc_rig_status_t miner_status;
     uint8_t online;
+    const uhab_item_t *batch_items[CFG_UHAB_BUS_MAX_BATCH];
+    uhab_item_state_t batch_states[CFG_UHAB_BUS_MAX_BATCH];
+    int batch_count;
 
     TRACE("Working thread is running ...");
 
@@ -325,7 +335,10 @@ static void mining_thread(void *arg)
                 online = 0;
             }
 
-            // Update states of all items
+            // Update states of all items by bus batches
+            batch_count = 0;
+            os_memset(batch_states, 0, sizeof(batch_states));
+
             for (devitem = list_head(dev->items); devitem != NULL; devitem = list_item_next(devitem))
             {
                 switch(devitem->type)
@@ -347,10 +360,13 @@ static void mining_thread(void *arg)
                     // Update item only when it was changed
                     if (uhab_item_state_compare(&devitem->item->state, &newstate) != 0)
                     {
-                        if (uhab_bus_update(devitem->item, &newstate) != 0)
+                        if (batch_count == CFG_UHAB_BUS_MAX_BATCH)
                         {
-                            TRACE_ERROR("Update item failed");
+                            update_batch(batch_items, batch_states, batch_count);
+                            batch_count = 0;
                         }
+                        batch_items[batch_count] = devitem->item;
+                        uhab_item_state_set(&batch_states[batch_count++], &newstate);
                     }
                 }
                 break;
@@ -395,10 +411,14 @@ static void mining_thread(void *arg)
                     // Update item only when it was changed
                     if (uhab_item_state_compare(&devitem->item->state, &newstate) != 0)
                     {
-                        if (uhab_bus_update(devitem->item, &newstate) != 0)
+                        if (batch_count == CFG_UHAB_BUS_MAX_BATCH)
                         {
-                            TRACE_ERROR("Update item failed");
+                            update_batch(batch_items, batch_states, batch_count);
+                            batch_count = 0;
                         }
+                        // Batch state owns the string, the bus shares it
+                        if (uhab_item_state_set_string(&batch_states[batch_count], value) == 0)
+                            batch_items[batch_count++] = devitem->item;
                     }
                 }
                 break;
@@ -408,10 +428,27 @@ static void mining_thread(void *arg)
                     break;
                 }
             }
+
+            if (batch_count > 0)
+                update_batch(batch_items, batch_states, batch_count);
         }
     }
 }
 
+/** Update items by bus batch and release its states */
+static void update_batch(const uhab_item_t * const items[], uhab_item_state_t states[], int count)
+{
+    int ix;
+
+    if (uhab_bus_update_batch(items, states, count, 0) != 0)
+    {
+        TRACE_ERROR("Update items failed");
+    }
+
+    for (ix = 0; ix < count; ix++)
+        uhab_item_state_release(&states[ix]);
+}
+
 /** Interface definition */
 uhab_protocol_binding_t mining_binding =
 {
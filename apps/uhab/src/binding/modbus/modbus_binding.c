@@ -12,6 +12,7 @@ TRACE_TAG(binding_modbus);
 // Prototypes:
 static modbus_device_t *alloc_modbus_device(const char *name);
 static void modbus_poll_thread(void *arg);
+static void config_changed_cb(const char *service, const char *key, void *arg);
 
 // Locals:
 static const osThreadDef(MODBUS_POLL, modbus_poll_thread, CFG_MODBUS_THREAD_PRIORITY, 0, CFG_MODBUS_THREAD_STACK_SIZE);   
@@ -57,6 +58,10 @@ static int modbus_binding_init(void)
    if (uhab_config_service_get_value(CFG_MODBUS_BINDING_NAME, "poll", txt, sizeof(txt)) == 0)
       poll_interval = atoi(txt);
    
+   // Poll periods follow the service config reload
+   if (uhab_config_service_subscribe(CFG_MODBUS_BINDING_NAME, config_changed_cb, NULL) != 0)
+      TRACE_ERROR("Subscribe modbus config changes");
+   
    TRACE("Init"); 
    
    return 0;
@@ -363,6 +368,10 @@ static void modbus_poll_thread(void *arg)
    int ix;
    osEvent evt;
    modbus_device_t *dev;
+   const uhab_item_t *batch_items[CFG_MODBUS_BINDING_MAX_ITEMS];
+   uhab_item_state_t batch_states[CFG_MODBUS_BINDING_MAX_ITEMS];
+   int batch_count;
+   hal_time_t timestamp;
       
    TRACE("Modbus poll thread is running ...  (poll_interval: %d ms)", poll_interval);
    
@@ -373,7 +382,7 @@ static void modbus_poll_thread(void *arg)
          //
          // Wait for commands in the queue or pool timeout
          //
-         evt = osMessageGet(cmd_queue, poll_interval);
+         evt = osMessageGet(cmd_queue, __atomic_load_n(&poll_interval, __ATOMIC_RELAXED));
          if (evt.status == osEventMessage)
          {
             modbus_cmd_t *cmd = evt.value.p;
@@ -395,7 +404,8 @@ static void modbus_poll_thread(void *arg)
 
                   // Update uhab item state
                   uhab_item_state_set_command(&newstate, cmd->set_coil.state);
-                  VERIFY(uhab_bus_update(cmd->set_coil.devitem->item, &newstate) == 0);
+                  if (uhab_bus_update_cmd(cmd->set_coil.devitem->item, &newstate) != 0)
+                     TRACE_ERROR("Update item: %s coil", cmd->set_coil.devitem->item->name);
                   uhab_item_state_set(&cmd->set_coil.devitem->state, &newstate);
                   
                   // Reset device poll timeout
@@ -418,7 +428,8 @@ static void modbus_poll_thread(void *arg)
 
                   // Update uhab item state
                   uhab_item_state_set_number(&newstate, cmd->write_holding.regval);
-                  VERIFY(uhab_bus_update(cmd->write_holding.devitem->item, &newstate) == 0);
+                  if (uhab_bus_update_cmd(cmd->write_holding.devitem->item, &newstate) != 0)
+                     TRACE_ERROR("Update item: %s holding", cmd->write_holding.devitem->item->name);
                   uhab_item_state_set(&cmd->write_holding.devitem->state, &newstate);
 
                   // Reset device poll timeout
@@ -453,6 +464,10 @@ static void modbus_poll_thread(void *arg)
          
          if (dev->serial.inter_transaction_delay > 0)
             hal_delay_ms(dev->serial.inter_transaction_delay);
+
+         // Changed items of the device are updated by one bus batch, poll time is the source timestamp
+         batch_count = 0;
+         timestamp = hal_time_ms();
      
          switch(dev->func_type)
          {
@@ -472,7 +487,8 @@ static void modbus_poll_thread(void *arg)
                      // Update item only when it was changed
                      if (uhab_item_state_compare(&dev->items[ib].state, &newstate) != 0)
                      {
-                        VERIFY(uhab_bus_update(dev->items[ib].item, &newstate) == 0);
+                        batch_items[batch_count] = dev->items[ib].item;
+                        batch_states[batch_count++] = newstate;
 
                         // Save current state
                         uhab_item_state_set(&dev->items[ib].state, &newstate);
@@ -502,7 +518,8 @@ static void modbus_poll_thread(void *arg)
                      // Update item only when it was changed
                      if (uhab_item_state_compare(&dev->items[ib].state, &newstate) != 0)
                      {
-                        VERIFY(uhab_bus_update(dev->items[ib].item, &newstate) == 0);
+                        batch_items[batch_count] = dev->items[ib].item;
+                        batch_states[batch_count++] = newstate;
 
                         // Save current state
                         uhab_item_state_set(&dev->items[ib].state, &newstate);
@@ -534,7 +551,8 @@ static void modbus_poll_thread(void *arg)
                      // Update item only when it was changed
                      if (uhab_item_state_compare(&dev->items[ix].state, &newstate) != 0)
                      {
-                        VERIFY(uhab_bus_update(dev->items[ix].item, &newstate) == 0);
+                        batch_items[batch_count] = dev->items[ix].item;
+                        batch_states[batch_count++] = newstate;
 
                         // Save current state
                         uhab_item_state_set(&dev->items[ix].state, &newstate);
@@ -551,13 +569,48 @@ static void modbus_poll_thread(void *arg)
             default:
                TRACE_ERROR("Not supported function type: %d", dev->func_type);
          }        
+
+         if (batch_count > 0)
+         {
+            if (uhab_bus_update_batch(batch_items, batch_states, batch_count, timestamp) != 0)
+               TRACE_ERROR("Update batch of %d items, dev_id: %d", batch_count, dev->id);
+         }
          
          // Set next poll timeout
-         dev->poll_tmo = hal_time_ms() + dev->poll_interval;
+         dev->poll_tmo = hal_time_ms() + __atomic_load_n(&dev->poll_interval, __ATOMIC_RELAXED);
       }
    }
 }
 
+/** Service config changed, re-read the poll periods */
+static void config_changed_cb(const char *service, const char *key, void *arg)
+{
+   int ix;
+   int interval;
+   int len = strlen(key);
+   char name[64];
+
+   if (strcmp(key, "poll") != 0 && (len < 5 || strcmp(key + len - 5, ".poll") != 0))
+      return;
+
+   interval = uhab_config_service_get_int(CFG_MODBUS_BINDING_NAME, "poll", CFG_MODBUS_DEFAULT_POLL_INTERVAL);
+
+   for (ix = 0; ix < devices_count; ix++)
+   {
+      snprintf(name, sizeof(name), "%s.poll", devices[ix].name);
+      __atomic_store_n(&devices[ix].poll_interval,
+                       uhab_config_service_get_int(CFG_MODBUS_BINDING_NAME, name, devices[ix].poll_interval), __ATOMIC_RELAXED);
+
+      if (devices[ix].poll_interval < interval)
+         interval = devices[ix].poll_interval;
+   }
+
+   // Poll thread takes the new period on the next queue wait
+   __atomic_store_n(&poll_interval, interval, __ATOMIC_RELAXED);
+
+   TRACE("Poll interval reloaded: %d ms, changed key: %s", interval, key);
+}
+
 /** Modbus binding interface definition */
 uhab_protocol_binding_t modbus_binding = 
 {
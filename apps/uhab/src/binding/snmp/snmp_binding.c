@@ -270,12 +270,13 @@ static void snmp_poll_thread(void *arg)
                case UHAB_ITEM_STATE_TYPE_STRING:
                {
                   char value[255];
-                  uhab_item_state_t newstate = UAHB_ITEM_STATE_INIT_STRING_REF(value);
+                  uhab_item_state_t refstate = UAHB_ITEM_STATE_INIT_STRING_REF(value);
+                  uhab_item_state_t newstate = UHAB_ITEM_STATE_INIT(UHAB_ITEM_STATE_TYPE_STRING);
 
                   if (snmpc_get_str_value(&dev->conn, devitem->oid, value, sizeof(value)) == 0)
                   {
-                     // Update item only when it was changed
-                     if (uhab_item_state_compare(&devitem->state, &newstate) != 0)
+                     // Update item only when it was changed, the string is stored once and shared by the bus and the saved state
+                     if (uhab_item_state_compare(&devitem->state, &refstate) != 0 && uhab_item_state_set_string(&newstate, value) == 0)
                      {                           
                         if (uhab_bus_update(devitem->item, &newstate) != 0)
                         {
@@ -284,6 +285,7 @@ static void snmp_poll_thread(void *arg)
                         
                         // Save current state
                         uhab_item_state_set(&devitem->state, &newstate);
+                        uhab_item_state_release(&newstate);
                      }
                   }
                   else
@@ -347,7 +347,7 @@ static int system_binding_send(const uhab_item_t *item, const uhab_item_state_t
    uhab_item_state_t state_ticks = UHAB_ITEM_STATE_INIT_NUMBER(timer->nticks);
 
    // Update item state
-   return uhab_bus_update(item, &state_ticks);
+   return uhab_bus_update_cmd(item, &state_ticks);
 
 fail:
    osMutexRelease(mutex_timers);
@@ -387,7 +387,8 @@ static void second_timer_cb(void *arg)
       {
          uhab_item_state_t state_ticks = UHAB_ITEM_STATE_INIT_NUMBER(++timer->nticks);
         
-         VERIFY(uhab_bus_update(timer->item, &state_ticks) == 0);
+         if (uhab_bus_update(timer->item, &state_ticks) != 0)
+            TRACE_ERROR("Update timer: %s ticks", timer->item->name);
          
          if (timer->type == osTimerPeriodic)
          {
@@ -293,7 +293,7 @@ static int vehabus_binding_send(const uhab_item_t *item, const uhab_item_state_t
    }
 
    // Update item state
-   return uhab_bus_update(item, state);
+   return uhab_bus_update_cmd(item, state);
 }
 
 /** Reading inputs state timer callback */
@@ -307,6 +307,13 @@ static void input_timer_cb(void *arg)
    int pwr2_on = 0;
    uint32_t prev_input_mask = vehabus_input_mask;
    uint32_t input_mask[CFG_VEHABUS_MAX_DEGLITCH_COUNT];
+   const uhab_item_t *batch_items[CFG_UHAB_BUS_MAX_BATCH];
+   uhab_item_state_t batch_states[CFG_UHAB_BUS_MAX_BATCH];
+   int batch_count = 0;
+   hal_time_t timestamp;
+
+   // Inputs sampling time is the source timestamp of the changes
+   timestamp = hal_time_ms();
 
    // Read inputs
    for (di = 0; di < input_deglitch_count; di++)
@@ -379,10 +386,26 @@ static void input_timer_cb(void *arg)
       {
          if ((vehabus_input_mask & (1 << vi->index)) != (prev_input_mask & (1 << vi->index)))
          {
+            // Full batch is updated and the next one started
+            if (batch_count == CFG_UHAB_BUS_MAX_BATCH)
+            {
+               if (uhab_bus_update_batch(batch_items, batch_states, batch_count, timestamp) != 0)
+                  TRACE_ERROR("Update batch of %d inputs", batch_count);
+               batch_count = 0;
+            }
+
             uhab_item_state_set_command(&newstate, ((vehabus_input_mask & (1 << vi->index)) != 0));
-            VERIFY(uhab_bus_update(vi->item, &newstate) == 0);
+            batch_items[batch_count] = vi->item;
+            batch_states[batch_count++] = newstate;
          }
       }
+
+      // All changed inputs are updated by bus batches
+      if (batch_count > 0)
+      {
+         if (uhab_bus_update_batch(batch_items, batch_states, batch_count, timestamp) != 0)
+            TRACE_ERROR("Update batch of %d inputs", batch_count);
+      }
    }
 }
 
@@ -397,7 +420,8 @@ static void onewire_timer_cb(void *arg)
    {
       temp = 21 + ((rand() % 10) * 0.1);
       uhab_item_state_set_number(&newstate, temp);
-      VERIFY(uhab_bus_update(vi->item, &newstate) == 0);
+      if (uhab_bus_update(vi->item, &newstate) != 0)
+         TRACE_ERROR("Update item: %s temp", vi->item->name);
    }
 }
 
@@ -14,21 +14,94 @@ TRACE_TAG(bus);
 static uhab_bus_waitstate_t *alloc_waitstate(uhab_sitemap_widget_t *parent_widget);
 static void free_waitstate(uhab_bus_waitstate_t *ws);
 static void contact_timer_cb(void *arg);
+static void wakeup_timer_cb(void *arg);
+static void release_waitstate(uhab_bus_waitstate_t *ws, int defer);
 static void bus_thread(void *arg);
+static inline uhab_bus_worker_t *get_item_worker(const uhab_item_t *item);
+static inline uhab_bus_lane_t get_update_lane(const uhab_item_t *item, int command);
+static int update_state(const uhab_item_t *item, const uhab_item_state_t *state, hal_time_t timestamp, int command);
+static int update_batch(const uhab_item_t * const items[], const uhab_item_state_t states[], int count, hal_time_t timestamp, int command);
+static int ring_init(uhab_bus_ring_t *ring, uint32_t size);
+static int ring_put(uhab_bus_ring_t *ring, const uhab_bus_event_t *event);
+static int ring_get(uhab_bus_ring_t *ring, uhab_bus_event_t *event);
+static int ring_empty(uhab_bus_ring_t *ring);
+static int coalesce_update(uhab_bus_worker_t *worker, uhab_item_t *item, uhab_item_state_t *state);
+static void take_pending_state(uhab_bus_event_t *event);
+static void close_pending(uhab_bus_event_t *event);
+static void take_aggregate_state(uhab_bus_event_t *event);
+static void drop_event(uhab_bus_ring_t *ring, uhab_bus_event_t *event);
+static int queue_event(uhab_bus_worker_t *worker, uhab_bus_lane_t lane_id, uhab_bus_event_t *event);
+static int copy_state(uhab_item_state_t *dest, const uhab_item_state_t *src);
+static uhab_rule_event_t translate_event(uhab_bus_event_t *event);
+static void apply_event_state(uhab_bus_event_t *event);
+static void process_batch(uhab_bus_batch_t *batch);
+static void process_event(uhab_bus_event_t *event);
+static void wakeup_waitstates(uhab_item_t **items, int count);
+static void publish_changes(uhab_item_t **items, int count);
+static void update_aggregates(uhab_item_t *item, const uhab_item_state_t *oldstate);
+static uint32_t click_timeout(const uhab_bus_event_t *event, uint32_t timelen);
+static uhab_item_click_t *get_click(uhab_item_t *item);
+static void update_latency(uhab_bus_worker_t *worker, hal_time_t timestamp, int count);
+static void load_timing_config(void);
+static void config_changed_cb(const char *service, const char *key, void *arg);
+
+#if (CFG_UHAB_BUS_QUEUE_SIZE & (CFG_UHAB_BUS_QUEUE_SIZE - 1)) != 0 || (CFG_UHAB_BUS_INTERACTIVE_QUEUE_SIZE & (CFG_UHAB_BUS_INTERACTIVE_QUEUE_SIZE - 1)) != 0
+#error "BUS queue size must be power of 2"
+#endif
+
+#if (CFG_UHAB_BUS_JOURNAL_SIZE & (CFG_UHAB_BUS_JOURNAL_SIZE - 1)) != 0
+#error "BUS journal size must be power of 2"
+#endif
+
+/** BUS lane configuration */
+typedef struct
+{
+   const char *name;
+   uint32_t size;
+   uhab_bus_overflow_t overflow;
+   uint32_t block_timeout;
+
+} bus_lane_config_t;
 
 // Locals:
 static const osThreadDef(BUS, bus_thread, CFG_BUS_THREAD_PRIORITY, 0, CFG_BUS_THREAD_STACK_SIZE);
-static osThreadId thread;
-static const osTimerDef(CONTACT_TIMER, contact_timer_cb);
 
-static osPoolDef(BUS, CFG_UHAB_BUS_QUEUE_SIZE, uhab_bus_event_t);
-static osPoolId pool;
+static uhab_bus_worker_t workers[CFG_UHAB_BUS_MAX_WORKERS];
+static int num_workers = CFG_UHAB_BUS_NUM_WORKERS;
+static int coalesce = 0;
+
+static bus_lane_config_t lanes[UHAB_BUS_LANE_COUNT] =
+{
+   {"interactive", CFG_UHAB_BUS_INTERACTIVE_QUEUE_SIZE, UHAB_BUS_OVERFLOW_BLOCK, CFG_UHAB_BUS_BLOCK_TIMEOUT},
+   {"telemetry", CFG_UHAB_BUS_QUEUE_SIZE, UHAB_BUS_OVERFLOW_DROP_OLDEST, 0},
+};
 
-const osMessageQDef(BUS, CFG_UHAB_BUS_QUEUE_SIZE, uint32_t);
-static osMessageQId queue;
+static const char *overflow_names[] =
+{
+   "block",
+   "drop_oldest",
+   "drop_newest",
+   "coalesce",
+   NULL
+};
 
 LIST(waitstates);
 static osMutexId waitstate_mutex;
+static uint32_t wakeup_pass = 0;
+
+/** Waitstates wakeups coalescing */
+static uint32_t waitstate_coalesce = CFG_UHAB_BUS_WAITSTATE_COALESCE;
+static uhab_timer_t *wakeup_timer;
+static uint8_t wakeup_timer_armed = 0;
+static hal_time_t last_wakeup_time = 0;
+
+/** Waitstates waiting for any journal change */
+static uhab_bus_waitstate_t *journal_waitstates = NULL;
+
+/** Changes journal, entry of the sequence is at index seq & (size - 1) */
+static uhab_bus_journal_entry_t journal[CFG_UHAB_BUS_JOURNAL_SIZE];
+static uint32_t journal_seq = 0;
+static osMutexId journal_mutex;
 
 static uint32_t click_timelen = 200;
 static uint32_t longclick_timelen = 1000;
@@ -38,21 +111,39 @@ static uint32_t waitchanges_timeout = CFG_UHAB_UIPROVIDER_POOL_TIMEOUT;
 /** Initialize event bus */
 int uhab_bus_init(void)
 {
+   int ix, lane, policy;
+   char key[64];
    char value[255];
 
    list_init(waitstates);
 
-   if (uhab_config_service_get_value(CFG_SYSTEM_BINDING_NAME, CFG_SYSTEM_CONFIG_KEY_BUS_CLICK_TMLEN, value, sizeof(value)) == 0)
-      click_timelen = atoi(value);
+   load_timing_config();
+
+   num_workers = uhab_config_service_get_int(CFG_SYSTEM_BINDING_NAME, CFG_SYSTEM_CONFIG_KEY_BUS_WORKERS, num_workers);
+   coalesce = uhab_config_service_get_bool(CFG_SYSTEM_BINDING_NAME, CFG_SYSTEM_CONFIG_KEY_BUS_COALESCE, coalesce);
+
+   for (lane = 0; lane < UHAB_BUS_LANE_COUNT; lane++)
+   {
+      snprintf(key, sizeof(key), CFG_SYSTEM_CONFIG_KEY_BUS_LANE_OVERFLOW, lanes[lane].name);
+      if (uhab_config_service_get_value(CFG_SYSTEM_BINDING_NAME, key, value, sizeof(value)) == 0)
+      {
+         for (policy = 0; overflow_names[policy] != NULL && strcasecmp(overflow_names[policy], value); policy++);
 
-   if (uhab_config_service_get_value(CFG_SYSTEM_BINDING_NAME, CFG_SYSTEM_CONFIG_KEY_BUS_LONGCLICK_TMLEN, value, sizeof(value)) == 0)
-      longclick_timelen = atoi(value);
+         if (overflow_names[policy] != NULL)
+            lanes[lane].overflow = policy;
+         else
+            TRACE_ERROR("Unknown bus %s lane overflow policy: %s", lanes[lane].name, value);
+      }
 
-   if (uhab_config_service_get_value(CFG_SYSTEM_BINDING_NAME, CFG_SYSTEM_CONFIG_KEY_BUS_LONGPRESS_TMLEN, value, sizeof(value)) == 0)
-      longpress_timelen = atoi(value);
+      snprintf(key, sizeof(key), CFG_SYSTEM_CONFIG_KEY_BUS_LANE_BLOCK_TIMEOUT, lanes[lane].name);
+      if (uhab_config_service_get_value(CFG_SYSTEM_BINDING_NAME, key, value, sizeof(value)) == 0)
+         lanes[lane].block_timeout = atoi(value);
+   }
 
-   if (uhab_config_service_get_value(CFG_SYSTEM_BINDING_NAME, CFG_SYSTEM_CONFIG_KEY_BUS_WAITCHANGES_TIMEOUT, value, sizeof(value)) == 0)
-      waitchanges_timeout = atoi(value);
+   if (num_workers < 1)
+      num_workers = 1;
+   else if (num_workers > CFG_UHAB_BUS_MAX_WORKERS)
+      num_workers = CFG_UHAB_BUS_MAX_WORKERS;
 
    if ((waitstate_mutex = osMutexCreate(NULL)) == NULL)
    {
@@ -60,31 +151,61 @@ int uhab_bus_init(void)
       throw_exception(fail_mutex);
    }
 
-   if ((queue = osMessageCreate(osMessageQ(BUS), osThreadGetId())) == NULL)
+   if ((journal_mutex = osMutexCreate(NULL)) == NULL)
    {
-      TRACE_ERROR("Create queue");
-      throw_exception(fail_queue);
+      TRACE_ERROR("Alloc journal mutex");
+      throw_exception(fail_journal_mutex);
    }
 
-   if ((pool = osPoolCreate(osPool(BUS))) == NULL)
+   if ((wakeup_timer = uhab_timer_create(wakeup_timer_cb, UHAB_TIMER_ONCE, NULL)) == NULL)
    {
-      TRACE_ERROR("Create pool");
-      throw_exception(fail_pool);
+      TRACE_ERROR("Create wakeup timer");
+      throw_exception(fail_timer);
    }
 
-   if ((thread = osThreadCreate(osThread(BUS), NULL)) == 0)
+   for (ix = 0; ix < num_workers; ix++)
    {
-      TRACE_ERROR("Start thread");
-      throw_exception(fail_thread);
+      os_memset(&workers[ix], 0, sizeof(uhab_bus_worker_t));
+      workers[ix].index = ix;
+
+      for (lane = 0; lane < UHAB_BUS_LANE_COUNT; lane++)
+      {
+         if (ring_init(&workers[ix].ring[lane], lanes[lane].size) != 0)
+         {
+            TRACE_ERROR("Alloc worker[%d] %s ring", ix, lanes[lane].name);
+            throw_exception(fail_ring);
+         }
+      }
+
+      if ((workers[ix].sem = osSemaphoreCreate(NULL, 1)) == NULL)
+      {
+         TRACE_ERROR("Create worker[%d] semaphore", ix);
+         throw_exception(fail_sem);
+      }
+      VERIFY(osSemaphoreWait(workers[ix].sem, osWaitForever) == osOK);
+
+      if ((workers[ix].thread = osThreadCreate(osThread(BUS), &workers[ix])) == 0)
+      {
+         TRACE_ERROR("Start worker[%d] thread", ix);
+         throw_exception(fail_thread);
+      }
    }
 
-   TRACE("BUS init");
+   // Click and waitstate timing is changed without restart
+   if (uhab_config_service_subscribe(CFG_SYSTEM_BINDING_NAME, config_changed_cb, NULL) != 0)
+      TRACE_ERROR("Subscribe system config changes");
+
+   TRACE("BUS init with %d workers, coalesce: %d", num_workers, coalesce);
 
    return 0;
 
 fail_thread:
-fail_pool:
-fail_queue:
+fail_sem:
+fail_ring:
+   uhab_timer_delete(wakeup_timer);
+fail_timer:
+   osMutexDelete(journal_mutex);
+fail_journal_mutex:
    osMutexDelete(waitstate_mutex);
 fail_mutex:
    return -1;
@@ -93,6 +214,8 @@ fail_mutex:
 /** Deinitialize event bus */
 int uhab_bus_deinit(void)
 {
+   uhab_timer_delete(wakeup_timer);
+   VERIFY(osMutexDelete(journal_mutex) == osOK);
    VERIFY(osMutexDelete(waitstate_mutex) == osOK);
    return 0;
 }
@@ -130,7 +253,7 @@ static int _uhab_bus_send(const uhab_item_t *item, const uhab_item_state_t *stat
    }
    else
    {
-      res += uhab_bus_update(item, pstate);
+      res += uhab_bus_update_cmd(item, pstate);
    }
 
    return res;
@@ -139,8 +262,8 @@ static int _uhab_bus_send(const uhab_item_t *item, const uhab_item_state_t *stat
 /** Send state to item and all child items */
 int uhab_bus_send(const uhab_item_t *item, const uhab_item_state_t *state)
 {
-   int res = 0;
-   uhab_child_item_t *child;
+   int ix, res = 0;
+   const uhab_item_array_t *children;
 
    ASSERT(item != NULL);
    ASSERT(state != NULL);
@@ -154,9 +277,10 @@ int uhab_bus_send(const uhab_item_t *item, const uhab_item_state_t *state)
       else
       {
          // Send command to all child items
-         for (child = list_head(item->child_items); child != NULL; child = list_item_next(child))
+         children = &uhab_item_get_meta(item)->children;
+         for (ix = 0; ix < children->count; ix++)
          {
-            res += _uhab_bus_send(child->item, state);
+            res += _uhab_bus_send(children->items[ix], state);
          }
       }
    }
@@ -171,391 +295,1330 @@ int uhab_bus_send(const uhab_item_t *item, const uhab_item_state_t *state)
 /** Update binding item state */
 int uhab_bus_update(const uhab_item_t *item, const uhab_item_state_t *state)
 {
-   uhab_bus_event_t *event;
+   return update_state(item, state, hal_time_ms(), 0);
+}
+
+/** Update item state by the command */
+int uhab_bus_update_cmd(const uhab_item_t *item, const uhab_item_state_t *state)
+{
+   return update_state(item, state, hal_time_ms(), 1);
+}
+
+/** Queue item state update to the lane of its origin */
+static int update_state(const uhab_item_t *item, const uhab_item_state_t *state, hal_time_t timestamp, int command)
+{
+   int res;
+   uhab_bus_worker_t *worker;
+   uhab_bus_lane_t lane;
+   uhab_bus_event_t event;
+
+   ASSERT(item != NULL);
+   ASSERT(state != NULL);
 
-   // Alloc event
-   if ((event = osPoolAlloc(pool)) == NULL)
+   // Add event to the lane ring of the item worker, keeps per item ordering within the lane
+   worker = get_item_worker(item);
+   lane = get_update_lane(item, command);
+
+   os_memset(&event, 0, sizeof(uhab_bus_event_t));
+   event.item = (uhab_item_t *)item;
+   event.timestamp = timestamp;
+
+   if (copy_state(&event.state, state) != 0)
    {
       TRACE_ERROR("Alloc event");
       return -1;
    }
-   os_memset(event, 0, sizeof(uhab_bus_event_t));
 
-   // Set queued item state
-   event->item = (uhab_item_t *)item;
-   uhab_item_state_set(&event->state, state);
-
-   // Add command to queue
-   if (osMessagePut(queue, (uintptr_t)event, osWaitForever) != osOK)
+   // Commands and contacts are never coalesced, they keep edge semantics
+   if ((coalesce || lanes[lane].overflow == UHAB_BUS_OVERFLOW_COALESCE) && state->type != UHAB_ITEM_STATE_TYPE_CMD && item->type != UHAB_ITEM_TYPE_CONTACT)
    {
-      TRACE_ERROR("Add event to queue");
-      osPoolFree(pool, event);
-      return -1;
+      // Merged into the queued event of the item
+      if ((res = coalesce_update(worker, (uhab_item_t *)item, &event.state)) == 0)
+         return 0;
+
+      // Queue event marker, state is taken from the item when processed
+      if (res == 1)
+         event.flags = UHAB_BUS_EVENT_FLAG_COALESCED;
    }
 
-   return 0;
+   return queue_event(worker, lane, &event);
 }
 
-/** Wait for any changes */
-int uhab_bus_waitfor_changes(uhab_sitemap_widget_t *parent_widget)
+/** Update batch of items state, the items of one worker lane are applied atomically (whole batch with one worker only) */
+int uhab_bus_update_batch(const uhab_item_t * const items[], const uhab_item_state_t states[], int count, hal_time_t timestamp)
 {
-   uhab_bus_waitstate_t *ws;
+   return update_batch(items, states, count, timestamp, 0);
+}
 
-   if ((ws = alloc_waitstate(parent_widget)) == NULL)
+/** Update batch of items state by the command */
+int uhab_bus_update_batch_cmd(const uhab_item_t * const items[], const uhab_item_state_t states[], int count)
+{
+   return update_batch(items, states, count, 0, 1);
+}
+
+/** Queue batch of items state updates to the lanes of its origin */
+static int update_batch(const uhab_item_t * const items[], const uhab_item_state_t states[], int count, hal_time_t timestamp, int command)
+{
+   int ix, iw, lane, num, res = 0;
+   uhab_bus_batch_t *parts[CFG_UHAB_BUS_MAX_WORKERS][UHAB_BUS_LANE_COUNT];
+   uhab_bus_batch_t *batch;
+   uhab_bus_event_t event;
+
+   ASSERT(items != NULL);
+   ASSERT(states != NULL);
+
+   if (count > CFG_UHAB_BUS_MAX_BATCH)
    {
-      TRACE_ERROR("Alloc waitstate");
+      TRACE_ERROR("Batch items count %d exceeds max. %d", count, CFG_UHAB_BUS_MAX_BATCH);
       return -1;
    }
 
-   osSemaphoreWait(ws->sem, waitchanges_timeout);
-   free_waitstate(ws);
+   if (timestamp == 0)
+      timestamp = hal_time_ms();
 
-   return 0;
-}
+   os_memset(parts, 0, sizeof(parts));
 
-/** Alloc waitstate */
-static uhab_bus_waitstate_t *alloc_waitstate(uhab_sitemap_widget_t *parent_widget)
-{
-   uhab_bus_waitstate_t *ws = NULL;
+   // Split batch by workers and lanes to keep per item ordering, parts of the batch are not applied atomically together.
+   // All parts are allocated first, nothing is queued when any of them fails.
+   for (iw = 0; iw < num_workers; iw++)
+   {
+      for (lane = 0; lane < UHAB_BUS_LANE_COUNT; lane++)
+      {
+         for (num = 0, ix = 0; ix < count; ix++)
+         {
+            if (get_item_worker(items[ix]) == &workers[iw] && get_update_lane(items[ix], command) == lane)
+               num++;
+         }
 
-   VERIFY(osMutexWait(waitstate_mutex, osWaitForever) == osOK);
+         if (num == 0)
+            continue;
 
-   // Find allocated free waitstate
-   for (ws = list_head(waitstates); ws != NULL; ws = list_item_next(ws))
+         if ((batch = os_malloc(sizeof(uhab_bus_batch_t) + num * (sizeof(uhab_item_state_t) + sizeof(uhab_item_t *)))) == NULL)
+         {
+            TRACE_ERROR("Alloc batch");
+            throw_exception(fail_alloc);
+         }
+         batch->count = 0;
+         batch->timestamp = timestamp;
+         batch->items = (uhab_item_t **)&batch->states[num];
+         parts[iw][lane] = batch;
+
+         for (ix = 0; ix < count; ix++)
+         {
+            if (get_item_worker(items[ix]) == &workers[iw] && get_update_lane(items[ix], command) == lane)
+            {
+               if (copy_state(&batch->states[batch->count], &states[ix]) != 0)
+               {
+                  TRACE_ERROR("Alloc item: %s batch state", items[ix]->name);
+                  throw_exception(fail_alloc);
+               }
+
+               batch->items[batch->count++] = (uhab_item_t *)items[ix];
+            }
+         }
+      }
+   }
+
+   // Queue the parts, failed queue drops its part only
+   for (iw = 0; iw < num_workers; iw++)
    {
-      if (!ws->active)
+      for (lane = 0; lane < UHAB_BUS_LANE_COUNT; lane++)
       {
-         ws->active = 1;
-         break;
+         if ((batch = parts[iw][lane]) == NULL)
+            continue;
+
+         os_memset(&event, 0, sizeof(uhab_bus_event_t));
+         event.item = batch->items[0];
+         event.flags = UHAB_BUS_EVENT_FLAG_BATCH;
+         event.batch = batch;
+         event.timestamp = timestamp;
+
+         if (queue_event(&workers[iw], lane, &event) != 0)
+            res = -1;
       }
    }
 
-   // Free waitstate does't found, alloc new waitstate
-   if (ws == NULL)
+   return res;
+
+fail_alloc:
+   for (iw = 0; iw < num_workers; iw++)
    {
-      if ((ws = os_malloc(sizeof(uhab_bus_waitstate_t))) == NULL)
+      for (lane = 0; lane < UHAB_BUS_LANE_COUNT; lane++)
       {
-         TRACE_ERROR("Alloc new wait state");
-         throw_exception(fail);
+         if ((batch = parts[iw][lane]) == NULL)
+            continue;
+
+         for (ix = 0; ix < batch->count; ix++)
+            uhab_item_state_release(&batch->states[ix]);
+
+         os_free(batch);
       }
+   }
 
-      if ((ws->sem = osSemaphoreCreate(NULL, 1)) == NULL)
+   return -1;
+}
+
+/** Queue event to the worker lane ring, event resources are owned by the bus */
+static int queue_event(uhab_bus_worker_t *worker, uhab_bus_lane_t lane_id, uhab_bus_event_t *event)
+{
+   uhab_bus_ring_t *ring = &worker->ring[lane_id];
+   bus_lane_config_t *lane = &lanes[lane_id];
+   uhab_bus_event_t oldest;
+   hal_time_t start_time = 0;
+
+   // Next updates are not merged into the pending event queued before this one
+   if (!(event->flags & UHAB_BUS_EVENT_FLAG_COALESCED))
+      close_pending(event);
+
+   while (ring_put(ring, event) != 0)
+   {
+      // Ring is full, apply lane overflow policy
+      if (lane->overflow == UHAB_BUS_OVERFLOW_DROP_OLDEST)
       {
-         TRACE_ERROR("Create semaphore");
-         os_free(ws);
-         throw_exception(fail);
-      }
+         if (ring_get(ring, &oldest) == 0)
+            drop_event(ring, &oldest);
 
-      if (osSemaphoreWait(ws->sem, osWaitForever) != osOK)
+         continue;
+      }
+      else if (lane->overflow == UHAB_BUS_OVERFLOW_BLOCK)
       {
-         TRACE_ERROR("Sem wait");
-         osSemaphoreDelete(ws->sem);
-         os_free(ws);
-         throw_exception(fail);
+         if (start_time == 0)
+            start_time = hal_time_ms();
+
+         if (lane->block_timeout == 0 || hal_time_ms() - start_time < lane->block_timeout)
+         {
+            __atomic_add_fetch(&ring->stats.full_waits, 1, __ATOMIC_RELAXED);
+            osDelay(1);
+            continue;
+         }
       }
 
-      ws->active = 1;
-      list_add(waitstates, ws);
+      // Drop new event
+      drop_event(ring, event);
 
-      TRACE("Alloc new waitstate");
+      return -1;
    }
 
-   ws->parent_widget = parent_widget;
-
-   VERIFY(osMutexRelease(waitstate_mutex) == osOK);
-
-   return ws;
+   // Wakeup sleeping consumer
+   if (__atomic_exchange_n(&worker->sleeping, 0, __ATOMIC_SEQ_CST))
+      osSemaphoreRelease(worker->sem);
 
-fail:
-   VERIFY(osMutexRelease(waitstate_mutex) == osOK);
-   return NULL;
+   return 0;
 }
 
-/** Free waitstate */
-static void free_waitstate(uhab_bus_waitstate_t *ws)
+/** Copy state to event, event holds a reference of the string, it is moved to the item on apply */
+static int copy_state(uhab_item_state_t *dest, const uhab_item_state_t *src)
 {
-   VERIFY(osMutexWait(waitstate_mutex, osWaitForever) == osOK);
-   ws->active = 0;
-   VERIFY(osMutexRelease(waitstate_mutex) == osOK);
+   return uhab_item_state_copy(dest, src);
 }
 
-/** Contact time length measurement timeout timer callback */
-static void contact_timer_cb(void *arg)
+/** Wait for any changes */
+int uhab_bus_waitfor_changes(uhab_sitemap_widget_t *parent_widget)
 {
-   uhab_item_t *item = arg;
-   uhab_rule_event_t rule_event;
-
-   ASSERT(item != NULL);
+   uhab_bus_waitstate_t *ws;
 
-   if (item->state.value.cmd == UHAB_ITEM_STATE_CMD_ON)
+   if ((ws = alloc_waitstate(parent_widget)) == NULL)
    {
-      rule_event = UHAB_RULE_EVENT_LONGPRESS;
+      TRACE_ERROR("Alloc waitstate");
+      return -1;
    }
-   else
-   {
-      switch (item->bus.click.count)
-      {
-         case 1:
-         {
-            if (hal_time_ms() - item->bus.click.start_time >= longclick_timelen)
-               rule_event = UHAB_RULE_EVENT_LONGCLICK;
-            else
-               rule_event = UHAB_RULE_EVENT_CLICK;
-         }
-         break;
 
-         case 2:
-            rule_event = UHAB_RULE_EVENT_DOUBLECLICK;
-            break;
+   osSemaphoreWait(ws->sem, waitchanges_timeout);
+   free_waitstate(ws);
 
-         case 3:
-            rule_event = UHAB_RULE_EVENT_TRIPLECLICK;
-            break;
+   return 0;
+}
 
-         default:
-            rule_event = UHAB_RULE_EVENT_QUADCLICK;
-            break;
-      }
-   }
+/** Wait until the changes journal sequence exceeds since or timeout [ms] expires */
+int uhab_bus_waitfor_journal(uint32_t since, uint32_t timeout)
+{
+   uhab_bus_waitstate_t *ws;
 
-   // Process automatin rule event
-   if (uhab_automation_process_event(&automation, rule_event, item, &item->state) != 0)
+   if (uhab_bus_get_seq() != since || timeout == 0)
+      return 0;
+
+   if ((ws = alloc_waitstate(NULL)) == NULL)
    {
-      TRACE_ERROR("Automation process item: %s  event: %d", item->name, rule_event);
+      TRACE_ERROR("Alloc waitstate");
+      return -1;
    }
 
-   item->bus.click.count = 0;
-   item->bus.click.start_time = 0;
+   // Check again, change could be recorded before the waitstate was registered
+   if (uhab_bus_get_seq() == since)
+      osSemaphoreWait(ws->sem, timeout);
+
+   free_waitstate(ws);
+
+   return 0;
 }
 
+/** Get current changes journal sequence number */
+uint32_t uhab_bus_get_seq(void)
+{
+   return __atomic_load_n(&journal_seq, __ATOMIC_ACQUIRE);
+}
 
-/** Working thread */
-static void bus_thread(void *arg)
+/** Get items changed after the since sequence */
+int uhab_bus_get_changes(uint32_t since, uhab_item_t *items[], int maxitems, uint32_t *seq)
 {
-   osEvent evt;
-   uhab_bus_event_t *event;
-   uhab_bus_waitstate_t *ws;
-   uhab_rule_event_t rule_event;
-#if ENABLE_TRACE_BUS_CHANGES
-   char txt[255];
-#endif
+   int count = 0;
+   uint32_t head;
+   uhab_bus_journal_entry_t *entry;
 
-   TRACE("BUS thread is running ...");
+   VERIFY(osMutexWait(journal_mutex, osWaitForever) == osOK);
 
-   while(1)
+   head = journal_seq;
+   *seq = head;
+
+   // Sequence out of the journal window, client has to resync
+   if (since > head || head - since > CFG_UHAB_BUS_JOURNAL_SIZE)
    {
-      // Wait for event in the queue
-      evt = osMessageGet(queue, osWaitForever);
-      if (evt.status != osEventMessage)
-      {
-         TRACE_ERROR("Get event from the queue");
-         continue;
-      }
+      VERIFY(osMutexRelease(journal_mutex) == osOK);
+      return -1;
+   }
+
+   for (; since != head; since++)
+   {
+      entry = &journal[(since + 1) & (CFG_UHAB_BUS_JOURNAL_SIZE - 1)];
 
-      event = evt.value.p;
+      // Report only the last change of the item
+      if (uhab_item_get_bus(entry->item)->seq != entry->seq)
+         continue;
 
-      // Translate item state to automation rule event type
-      switch(event->state.type)
+      if (count == maxitems)
       {
-         case UHAB_ITEM_STATE_TYPE_CMD:
-         {
-            switch(event->state.value.cmd)
-            {
-               case UHAB_ITEM_STATE_CMD_TOGGLE:
-               {
-                  // Toogle current state
-                  event->state.value.cmd =  event->item->state.value.cmd ^ 1;
-                  rule_event = (event->state.value.cmd) ? UHAB_RULE_EVENT_ON : UHAB_RULE_EVENT_OFF;
-               }
-               break;
+         // Next request continues from the last returned change
+         *seq = since;
+         break;
+      }
 
-               case UHAB_ITEM_STATE_CMD_ON:
-               {
-                  rule_event = UHAB_RULE_EVENT_ON;
+      items[count++] = entry->item;
+   }
 
-                  if (event->item->type == UHAB_ITEM_TYPE_CONTACT)
-                  {
-                     // Click ON
-                     event->item->bus.click.start_time = hal_time_ms();
-
-                     // Stop click len timer
-                     if (event->item->bus.click.timer == NULL)
-                     {
-                        // Create click length timer
-                        if ((event->item->bus.click.timer = osTimerCreate(osTimer(CONTACT_TIMER), osTimerOnce, event->item)) == NULL)
-                        {
-                           TRACE_ERROR("Start contact: %s click timer", event->item->name);
-                           break;
-                        }
-                     }
-
-                     event->item->bus.click.count++;
-                     VERIFY(osTimerStart(event->item->bus.click.timer, longpress_timelen) == osOK);
-                  }
-               }
-               break;
+   VERIFY(osMutexRelease(journal_mutex) == osOK);
 
-               case UHAB_ITEM_STATE_CMD_OFF:
-               {
-                  rule_event = UHAB_RULE_EVENT_OFF;
+   return count;
+}
 
-                  if (event->item->type == UHAB_ITEM_TYPE_CONTACT)
-                  {
-                     // Click OFF
-                     if (event->item->bus.click.timer == NULL)
-                     {
-                        // Create click length timer
-                        if ((event->item->bus.click.timer = osTimerCreate(osTimer(CONTACT_TIMER), osTimerOnce, event->item)) == NULL)
-                        {
-                           TRACE_ERROR("Start contact: %s click timer", event->item->name);
-                           break;
-                        }
-                     }
-
-                     VERIFY(osTimerStart(event->item->bus.click.timer, click_timelen) == osOK);
-                  }
-               }
-               break;
+/** Get worker processing events of the item */
+static inline uhab_bus_worker_t *get_item_worker(const uhab_item_t *item)
+{
+   // Multiplicative hash of the item address, item objects are never moved
+   return &workers[(((uint32_t)(uintptr_t)item >> 3) * 2654435761U) % num_workers];
+}
 
-               case UHAB_ITEM_STATE_CMD_UP:
-               {
-                  rule_event = UHAB_RULE_EVENT_CHANGED;
+/**
+ * Get lane of the item update by its origin. Commands (user, rules and their binding confirmations) and contact
+ * input edges are interactive, polled values are telemetry.
+ */
+static inline uhab_bus_lane_t get_update_lane(const uhab_item_t *item, int command)
+{
+   return (command || item->type == UHAB_ITEM_TYPE_CONTACT) ? UHAB_BUS_LANE_INTERACTIVE : UHAB_BUS_LANE_TELEMETRY;
+}
 
-                  if (event->item->stereotype == UHAB_ITEM_STEREOTYPE_LIST)
-                  {
-                     // Seek to next child item
-                     if (event->item->active_child_item != NULL)
-                     {
-                        uhab_item_state_t newstate = UHAB_ITEM_STATE_INIT_CMD(UHAB_ITEM_STATE_CMD_OFF);
-
-                        // Deactivate child item
-                        VERIFY(uhab_bus_send(event->item->active_child_item->item, &newstate) == 0);
-
-                        event->item->active_child_item = list_item_next(event->item->active_child_item);
-                        if (event->item->active_child_item == NULL)
-                           event->item->active_child_item = list_head(event->item->child_items);
-
-                        // Activete child_item
-                        uhab_item_state_set_command(&newstate, UHAB_ITEM_STATE_CMD_ON);
-                        VERIFY(uhab_bus_send(event->item->active_child_item->item, &newstate) == 0);
-                     }
-                  }
-               }
-               break;
+/** Get number of bus workers */
+int uhab_bus_get_workers_count(void)
+{
+   return num_workers;
+}
 
-               case UHAB_ITEM_STATE_CMD_DOWN:
-               {
-                  rule_event = UHAB_RULE_EVENT_CHANGED;
+/** Get bus worker statistics */
+int uhab_bus_get_stats(int worker, uhab_bus_stats_t *stats)
+{
+   int lane;
 
-                  if (event->item->stereotype == UHAB_ITEM_STEREOTYPE_LIST)
-                  {
-                     if (event->item->active_child_item != NULL)
-                     {
-                        uhab_child_item_t *child_item, *prev_child;
-                        uhab_item_state_t newstate = UHAB_ITEM_STATE_INIT_CMD(UHAB_ITEM_STATE_CMD_OFF);
-
-                        // Deactivate child item
-                        VERIFY(uhab_bus_send(event->item->active_child_item->item, &newstate) == 0);
-
-                        if (event->item->active_child_item == list_head(event->item->child_items))
-                        {
-                           // First child item, seek to end
-                           event->item->active_child_item = list_tail(event->item->child_items);
-                        }
-                        else
-                        {
-                           // Seek to previous child item
-                           for (prev_child = child_item = list_head(event->item->child_items); child_item != event->item->active_child_item; child_item = list_item_next(child_item))
-                              prev_child = child_item;
-
-                           event->item->active_child_item = prev_child;
-                        }
-
-                        // Activate child item
-                        uhab_item_state_set_command(&newstate, UHAB_ITEM_STATE_CMD_ON);
-                        VERIFY(uhab_bus_send(event->item->active_child_item->item, &newstate) == 0);
-                     }
-                  }
-               }
-               break;
+   if (worker < 0 || worker >= num_workers)
+      return -1;
 
-               default:
-                  rule_event = UHAB_RULE_EVENT_CHANGED;
-                  break;
-            }
-         }
-         break;
+   *stats = workers[worker].stats;
 
-         case UHAB_ITEM_STATE_TYPE_NUMBER:
-         {
-            if (event->item->stereotype == UHAB_ITEM_STEREOTYPE_LIST)
-            {
-               if (event->item->active_child_item != NULL)
-               {
-                  int count = 0;
-                  uhab_item_state_t newstate = UHAB_ITEM_STATE_INIT_CMD(UHAB_ITEM_STATE_CMD_OFF);
+   for (lane = 0; lane < UHAB_BUS_LANE_COUNT; lane++)
+      stats->lanes[lane] = workers[worker].ring[lane].stats;
 
-                  // Deactivate active item
-                  VERIFY(uhab_bus_send(event->item->active_child_item->item, &newstate) == 0);
+   return 0;
+}
+
+/** Get bus lane name */
+const char *uhab_bus_get_lane_name(uhab_bus_lane_t lane)
+{
+   return (lane < UHAB_BUS_LANE_COUNT) ? lanes[lane].name : "unknown";
+}
+
+/** Initialize ring */
+static int ring_init(uhab_bus_ring_t *ring, uint32_t size)
+{
+   uint32_t pos;
+
+   if ((ring->slots = os_malloc(size * sizeof(uhab_bus_slot_t))) == NULL)
+      return -1;
+
+   os_memset(ring->slots, 0, size * sizeof(uhab_bus_slot_t));
+
+   for (pos = 0; pos < size; pos++)
+      ring->slots[pos].seq = pos;
+
+   ring->mask = size - 1;
+
+   return 0;
+}
+
+/** Put event to the ring, returns 1 when ring is full */
+static int ring_put(uhab_bus_ring_t *ring, const uhab_bus_event_t *event)
+{
+   uhab_bus_slot_t *slot;
+   uint32_t pos, seq, used;
+
+   pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+   while(1)
+   {
+      slot = &ring->slots[pos & ring->mask];
+      seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+
+      if (seq == pos)
+      {
+         // Slot is free, try to reserve it
+         if (__atomic_compare_exchange_n(&ring->head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            break;
+      }
+      else if ((int32_t)(seq - pos) < 0)
+      {
+         // Ring is full
+         return 1;
+      }
+      else
+      {
+         // Slot was taken by other producer
+         pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+      }
+   }
+
+   slot->event = *event;
+
+   // Publish event to consumer
+   __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+
+   // Update lane statistics
+   __atomic_add_fetch(&ring->stats.enqueued, 1, __ATOMIC_RELAXED);
+
+   used = pos + 1 - __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+   if (used > ring->stats.high_water && used <= ring->mask + 1)
+      ring->stats.high_water = used;
+
+   return 0;
+}
+
+/** Lock item pending state */
+static inline void pending_lock(uhab_item_bus_t *bus)
+{
+   while (__atomic_test_and_set(&bus->pending.lock, __ATOMIC_ACQUIRE));
+}
+
+/** Unlock item pending state */
+static inline void pending_unlock(uhab_item_bus_t *bus)
+{
+   __atomic_clear(&bus->pending.lock, __ATOMIC_RELEASE);
+}
+
+/**
+ * Replace item pending state by the newer one, the state is moved to the item.
+ * Returns 0 when merged into already queued event, 1 when new event marker has to be queued,
+ * 2 when another event was queued after the pending one and the state has to be queued as is.
+ */
+static int coalesce_update(uhab_bus_worker_t *worker, uhab_item_t *item, uhab_item_state_t *state)
+{
+   int res;
+   uhab_item_state_t oldstate;
+   uhab_item_bus_t *bus = uhab_item_get_bus(item);
+
+   pending_lock(bus);
+
+   if (bus->pending.queued && bus->pending.closed)
+   {
+      pending_unlock(bus);
+      return 2;
+   }
+
+   oldstate = bus->pending.state;
+   bus->pending.state = *state;
+   os_memset(state, 0, sizeof(uhab_item_state_t));
+
+   if (bus->pending.queued)
+   {
+      bus->pending.count++;
+      res = 0;
+   }
+   else
+   {
+      bus->pending.queued = 1;
+      res = 1;
+   }
+
+   pending_unlock(bus);
+
+   // Previous pending state is not shared, its string reference is dropped here
+   uhab_item_state_release(&oldstate);
+
+   if (res == 0)
+      __atomic_add_fetch(&worker->stats.coalesced, 1, __ATOMIC_RELAXED);
+
+   return res;
+}
+
+/** Take latest pending state of the coalesced event */
+static void take_pending_state(uhab_bus_event_t *event)
+{
+   uhab_item_bus_t *bus = uhab_item_get_bus(event->item);
+
+   pending_lock(bus);
+
+   event->state = bus->pending.state;
+   os_memset(&bus->pending.state, 0, sizeof(uhab_item_state_t));
+   bus->pending.queued = 0;
+   bus->pending.closed = 0;
+
+   pending_unlock(bus);
+}
+
+/** Close pending events of the event items, pending event is not the last queued one of the item */
+static void close_pending(uhab_bus_event_t *event)
+{
+   int ix, count = 1;
+   uhab_item_t **items = &event->item;
+   uhab_item_bus_t *bus;
+
+   if (event->flags & UHAB_BUS_EVENT_FLAG_BATCH)
+   {
+      items = event->batch->items;
+      count = event->batch->count;
+   }
+
+   for (ix = 0; ix < count; ix++)
+   {
+      bus = uhab_item_get_bus(items[ix]);
+
+      if (!__atomic_load_n(&bus->pending.queued, __ATOMIC_RELAXED))
+         continue;
+
+      pending_lock(bus);
+      if (bus->pending.queued)
+         bus->pending.closed = 1;
+      pending_unlock(bus);
+   }
+}
+
+/** Take current group aggregate value as the event state */
+static void take_aggregate_state(uhab_bus_event_t *event)
+{
+   event->state.type = UHAB_ITEM_STATE_TYPE_NUMBER;
+   event->state.value.number = uhab_group_aggregate_get_value(event->item);
+}
+
+/** Get event from the ring, returns -1 when ring is empty */
+static int ring_get(uhab_bus_ring_t *ring, uhab_bus_event_t *event)
+{
+   uhab_bus_slot_t *slot;
+   uint32_t pos, seq;
+
+   // Producers may take the oldest event too (drop oldest policy)
+   pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+   while(1)
+   {
+      slot = &ring->slots[pos & ring->mask];
+      seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+
+      if (seq == pos + 1)
+      {
+         if (__atomic_compare_exchange_n(&ring->tail, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            break;
+      }
+      else if ((int32_t)(seq - (pos + 1)) < 0)
+      {
+         // Ring is empty
+         return -1;
+      }
+      else
+      {
+         pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+      }
+   }
+
+   *event = slot->event;
+
+   // Release slot to producers
+   __atomic_store_n(&slot->seq, pos + ring->mask + 1, __ATOMIC_RELEASE);
+
+   return 0;
+}
+
+/** Check ring is empty */
+static int ring_empty(uhab_bus_ring_t *ring)
+{
+   uint32_t pos = __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST);
+
+   return __atomic_load_n(&ring->slots[pos & ring->mask].seq, __ATOMIC_SEQ_CST) != pos + 1;
+}
+
+/** Drop event by lane overflow policy */
+static void drop_event(uhab_bus_ring_t *ring, uhab_bus_event_t *event)
+{
+   int ix;
+
+   // Dropped coalesced event discards the item pending state
+   if (event->flags & UHAB_BUS_EVENT_FLAG_COALESCED)
+      take_pending_state(event);
+
+   // Group keeps the last value until the next aggregate update
+   if (event->flags & UHAB_BUS_EVENT_FLAG_AGGREGATE)
+      uhab_group_aggregate_set_stale(event->item);
+
+   TRACE("Drop item: %s event", event->item->name);
+
+   if (event->flags & UHAB_BUS_EVENT_FLAG_BATCH)
+   {
+      for (ix = 0; ix < event->batch->count; ix++)
+         uhab_item_state_release(&event->batch->states[ix]);
+
+      os_free(event->batch);
+   }
+
+   uhab_item_state_release(&event->state);
+   __atomic_add_fetch(&ring->stats.dropped, 1, __ATOMIC_RELAXED);
+}
+
+/** Alloc waitstate */
+static uhab_bus_waitstate_t *alloc_waitstate(uhab_sitemap_widget_t *parent_widget)
+{
+   uhab_bus_waitstate_t *ws = NULL;
+   uhab_bus_waitstate_t **pws;
+
+   VERIFY(osMutexWait(waitstate_mutex, osWaitForever) == osOK);
+
+   // Find allocated free waitstate
+   for (ws = list_head(waitstates); ws != NULL; ws = list_item_next(ws))
+   {
+      if (!ws->active)
+      {
+         ws->active = 1;
+         break;
+      }
+   }
+
+   // Free waitstate does't found, alloc new waitstate
+   if (ws == NULL)
+   {
+      if ((ws = os_malloc(sizeof(uhab_bus_waitstate_t))) == NULL)
+      {
+         TRACE_ERROR("Alloc new wait state");
+         throw_exception(fail);
+      }
+
+      if ((ws->sem = osSemaphoreCreate(NULL, 1)) == NULL)
+      {
+         TRACE_ERROR("Create semaphore");
+         os_free(ws);
+         throw_exception(fail);
+      }
+
+      if (osSemaphoreWait(ws->sem, osWaitForever) != osOK)
+      {
+         TRACE_ERROR("Sem wait");
+         osSemaphoreDelete(ws->sem);
+         os_free(ws);
+         throw_exception(fail);
+      }
+
+      ws->active = 1;
+      list_add(waitstates, ws);
+
+      TRACE("Alloc new waitstate");
+   }
+
+   ws->parent_widget = parent_widget;
+
+   // Register waitstate at the page widget or journal waitstates
+   pws = (parent_widget != NULL) ? &parent_widget->waitstates : &journal_waitstates;
+   ws->page_next = *pws;
+   *pws = ws;
+
+   VERIFY(osMutexRelease(waitstate_mutex) == osOK);
+
+   return ws;
+
+fail:
+   VERIFY(osMutexRelease(waitstate_mutex) == osOK);
+   return NULL;
+}
+
+/** Free waitstate */
+static void free_waitstate(uhab_bus_waitstate_t *ws)
+{
+   uhab_bus_waitstate_t **pws;
+
+   VERIFY(osMutexWait(waitstate_mutex, osWaitForever) == osOK);
+
+   // Unregister waitstate from the page widget or journal waitstates
+   pws = (ws->parent_widget != NULL) ? &ws->parent_widget->waitstates : &journal_waitstates;
+   for (; *pws != NULL; pws = &(*pws)->page_next)
+   {
+      if (*pws == ws)
+      {
+         *pws = ws->page_next;
+         break;
+      }
+   }
+
+   ws->page_next = NULL;
+   ws->parent_widget = NULL;
+   ws->wakeup_deferred = 0;
+   ws->active = 0;
+   VERIFY(osMutexRelease(waitstate_mutex) == osOK);
+}
+
+/** Contact time length measurement timeout timer callback */
+static void contact_timer_cb(void *arg)
+{
+   uhab_item_t *item = arg;
+   uhab_item_click_t *click = uhab_item_get_bus(item)->click;
+   uhab_rule_event_t rule_event;
+   uhab_item_state_cmd_t cmd;
+
+   ASSERT(item != NULL);
+   ASSERT(click != NULL);
+
+   if (uhab_item_state_get_command(&item->state, &cmd) == 0 && cmd == UHAB_ITEM_STATE_CMD_ON)
+   {
+      rule_event = UHAB_RULE_EVENT_LONGPRESS;
+   }
+   else
+   {
+      switch (click->count)
+      {
+         case 1:
+         {
+            // Release edge must be processed to measure the click length
+            if (click->release_time != 0 && click->release_time >= click->start_time &&
+                click->release_time - click->start_time >= longclick_timelen)
+               rule_event = UHAB_RULE_EVENT_LONGCLICK;
+            else
+               rule_event = UHAB_RULE_EVENT_CLICK;
+         }
+         break;
+
+         case 2:
+            rule_event = UHAB_RULE_EVENT_DOUBLECLICK;
+            break;
+
+         case 3:
+            rule_event = UHAB_RULE_EVENT_TRIPLECLICK;
+            break;
+
+         default:
+            rule_event = UHAB_RULE_EVENT_QUADCLICK;
+            break;
+      }
+   }
+
+   // Process automatin rule event
+   if (uhab_automation_process_event(&automation, rule_event, item, &item->state) != 0)
+   {
+      TRACE_ERROR("Automation process item: %s  event: %d", item->name, rule_event);
+   }
+
+   click->count = 0;
+   click->start_time = 0;
+   click->release_time = 0;
+}
+
+/** Get contact click measurement, it is allocated with its timer on the first click */
+static uhab_item_click_t *get_click(uhab_item_t *item)
+{
+   uhab_item_click_t *click;
+   uhab_item_bus_t *bus = uhab_item_get_bus(item);
+
+   if (bus->click != NULL)
+      return bus->click;
+
+   if ((click = os_malloc(sizeof(uhab_item_click_t))) == NULL)
+      return NULL;
+
+   os_memset(click, 0, sizeof(uhab_item_click_t));
+
+   if ((click->timer = uhab_timer_create(contact_timer_cb, UHAB_TIMER_ONCE, item)) == NULL)
+   {
+      os_free(click);
+      return NULL;
+   }
+
+   bus->click = click;
 
-                  // Seek to new active
-                  for (count = 0, event->item->active_child_item = list_head(event->item->child_items);
-                       event->item->active_child_item != NULL && count < event->state.value.number;
-                       event->item->active_child_item = list_item_next(event->item->active_child_item), count++);
+   return click;
+}
+
+/**
+ * Remaining click timer timeout, time the event spent in the bus queue is already elapsed.
+ * Timer is not armed below the inputs debounce time, the next edge may still wait in the queue.
+ */
+static uint32_t click_timeout(const uhab_bus_event_t *event, uint32_t timelen)
+{
+   hal_time_t elapsed = hal_time_ms() - event->timestamp;
+
+   if (elapsed >= timelen || timelen - (uint32_t)elapsed < CFG_UHAB_BUS_CLICK_MIN_TIMEOUT)
+      return CFG_UHAB_BUS_CLICK_MIN_TIMEOUT;
+
+   return timelen - (uint32_t)elapsed;
+}
+
+
+/**
+ * Process one bus event. State of the item without rules is applied first, its JS state property follows it.
+ * Rules may rewrite the new state of their item, so the state of the item with rules is applied after them.
+ */
+static void process_event(uhab_bus_event_t *event)
+{
+   uhab_rule_event_t rule_event;
+
+   // Translate item state to automation rule event type
+   rule_event = translate_event(event);
+
+   if (!uhab_automation_has_rules(event->item))
+   {
+      // Update item state, then its JS state property
+      apply_event_state(event);
+
+      if (uhab_automation_process_event(&automation, rule_event, event->item, &event->item->state) != 0)
+         TRACE_ERROR("Automation update item: %s  event: %d", event->item->name, rule_event);
+
+      return;
+   }
+
+   // Process automatin rule event
+   if (uhab_automation_process_event(&automation, rule_event, event->item, &event->state) != 0)
+   {
+      TRACE_ERROR("Automation process item: %s  event: %d", event->item->name, rule_event);
+   }
+
+   // Update item state
+   apply_event_state(event);
+}
+
+/** Process batch of events, all states are applied before waitstates are released */
+static void process_batch(uhab_bus_batch_t *batch)
+{
+   int ix;
+   uhab_bus_event_t event;
+   uhab_rule_event_t rule_events[CFG_UHAB_BUS_MAX_BATCH];
+
+   os_memset(&event, 0, sizeof(uhab_bus_event_t));
+   event.timestamp = batch->timestamp;
+
+   // Translate item states to automation rule event types
+   for (ix = 0; ix < batch->count; ix++)
+   {
+      event.item = batch->items[ix];
+      event.state = batch->states[ix];
+      rule_events[ix] = translate_event(&event);
+      batch->states[ix] = event.state;
+   }
+
+   // Process automatin rule events of whole batch
+   if (uhab_automation_process_batch(&automation, rule_events, batch->items, batch->states, batch->count) != 0)
+   {
+      TRACE_ERROR("Automation process batch of %d items", batch->count);
+   }
+
+   // Update items state
+   for (ix = 0; ix < batch->count; ix++)
+   {
+      event.item = batch->items[ix];
+      event.state = batch->states[ix];
+      apply_event_state(&event);
+   }
+}
 
-                  if (event->item->active_child_item != NULL)
+/** Translate item state to automation rule event type */
+static uhab_rule_event_t translate_event(uhab_bus_event_t *event)
+{
+   uhab_rule_event_t rule_event;
+   uhab_item_click_t *click;
+
+   switch(event->state.type)
+   {
+      case UHAB_ITEM_STATE_TYPE_CMD:
+      {
+         switch(event->state.value.cmd)
+         {
+            case UHAB_ITEM_STATE_CMD_TOGGLE:
+            {
+               // Toogle current state
+               event->state.value.cmd =  event->item->state.value.cmd ^ 1;
+               rule_event = (event->state.value.cmd) ? UHAB_RULE_EVENT_ON : UHAB_RULE_EVENT_OFF;
+            }
+            break;
+
+            case UHAB_ITEM_STATE_CMD_ON:
+            {
+               rule_event = UHAB_RULE_EVENT_ON;
+
+               if (event->item->type == UHAB_ITEM_TYPE_CONTACT)
+               {
+                  if ((click = get_click(event->item)) == NULL)
                   {
-                     // Activate child item
-                     uhab_item_state_set_command(&newstate, UHAB_ITEM_STATE_CMD_ON);
-                     VERIFY(uhab_bus_send(event->item->active_child_item->item, &newstate) == 0);
+                     TRACE_ERROR("Start contact: %s click timer", event->item->name);
+                     break;
+                  }
+
+                  // Click ON, measured from the source timestamp
+                  click->start_time = event->timestamp;
+                  click->count++;
+                  VERIFY(uhab_timer_start(click->timer, click_timeout(event, longpress_timelen)) == 0);
+               }
+            }
+            break;
+
+            case UHAB_ITEM_STATE_CMD_OFF:
+            {
+               rule_event = UHAB_RULE_EVENT_OFF;
+
+               if (event->item->type == UHAB_ITEM_TYPE_CONTACT)
+               {
+                  if ((click = get_click(event->item)) == NULL)
+                  {
+                     TRACE_ERROR("Start contact: %s click timer", event->item->name);
+                     break;
                   }
-                  else
+
+                  // Click OFF
+                  click->release_time = event->timestamp;
+                  VERIFY(uhab_timer_start(click->timer, click_timeout(event, click_timelen)) == 0);
+               }
+            }
+            break;
+
+            case UHAB_ITEM_STATE_CMD_UP:
+            {
+               rule_event = UHAB_RULE_EVENT_CHANGED;
+
+               if (event->item->stereotype == UHAB_ITEM_STEREOTYPE_LIST)
+               {
+                  // Seek to next child item
+                  if (event->item->active_child >= 0)
                   {
-                     TRACE_ERROR("Select active child is out of range");
+                     uhab_item_state_t newstate = UHAB_ITEM_STATE_INIT_CMD(UHAB_ITEM_STATE_CMD_OFF);
+
+                     // Deactivate child item
+                     if (uhab_bus_send(uhab_repository_get_active_child(event->item), &newstate) != 0)
+                        TRACE_ERROR("Send to list: %s active child", event->item->name);
+
+                     if (++event->item->active_child >= uhab_item_get_meta(event->item)->children.count)
+                        event->item->active_child = 0;
+
+                     // Activete child_item
+                     uhab_item_state_set_command(&newstate, UHAB_ITEM_STATE_CMD_ON);
+                     if (uhab_bus_send(uhab_repository_get_active_child(event->item), &newstate) != 0)
+                        TRACE_ERROR("Send to list: %s active child", event->item->name);
                   }
                }
             }
+            break;
 
-            rule_event = UHAB_RULE_EVENT_CHANGED;
-         }
+            case UHAB_ITEM_STATE_CMD_DOWN:
+            {
+               rule_event = UHAB_RULE_EVENT_CHANGED;
 
-         default:
-            rule_event = UHAB_RULE_EVENT_CHANGED;
+               if (event->item->stereotype == UHAB_ITEM_STEREOTYPE_LIST)
+               {
+                  if (event->item->active_child >= 0)
+                  {
+                     uhab_item_state_t newstate = UHAB_ITEM_STATE_INIT_CMD(UHAB_ITEM_STATE_CMD_OFF);
+
+                     // Deactivate child item
+                     if (uhab_bus_send(uhab_repository_get_active_child(event->item), &newstate) != 0)
+                        TRACE_ERROR("Send to list: %s active child", event->item->name);
+
+                     // Seek to previous child item, first child item seeks to end
+                     if (--event->item->active_child < 0)
+                        event->item->active_child = uhab_item_get_meta(event->item)->children.count - 1;
+
+                     // Activate child item
+                     uhab_item_state_set_command(&newstate, UHAB_ITEM_STATE_CMD_ON);
+                     if (uhab_bus_send(uhab_repository_get_active_child(event->item), &newstate) != 0)
+                        TRACE_ERROR("Send to list: %s active child", event->item->name);
+                  }
+               }
+            }
             break;
+
+            default:
+               rule_event = UHAB_RULE_EVENT_CHANGED;
+               break;
+         }
       }
+      break;
 
-      // Process automatin rule event
-      if (uhab_automation_process_event(&automation, rule_event, event->item, &event->state) != 0)
+      case UHAB_ITEM_STATE_TYPE_NUMBER:
       {
-         TRACE_ERROR("Automation process item: %s  event: %d", event->item->name, rule_event);
+         if (event->item->stereotype == UHAB_ITEM_STEREOTYPE_LIST)
+         {
+            if (event->item->active_child >= 0)
+            {
+               int index = (int)event->state.value.number;
+               uhab_item_state_t newstate = UHAB_ITEM_STATE_INIT_CMD(UHAB_ITEM_STATE_CMD_OFF);
+
+               if (index >= 0 && index < uhab_item_get_meta(event->item)->children.count)
+               {
+                  // Deactivate active item
+                  if (uhab_bus_send(uhab_repository_get_active_child(event->item), &newstate) != 0)
+                     TRACE_ERROR("Send to list: %s active child", event->item->name);
+
+                  // Activate child item
+                  event->item->active_child = index;
+                  uhab_item_state_set_command(&newstate, UHAB_ITEM_STATE_CMD_ON);
+                  if (uhab_bus_send(uhab_repository_get_active_child(event->item), &newstate) != 0)
+                     TRACE_ERROR("Send to list: %s active child", event->item->name);
+               }
+               else
+               {
+                  TRACE_ERROR("Select active child is out of range");
+               }
+            }
+         }
+
+         rule_event = UHAB_RULE_EVENT_CHANGED;
       }
 
-      // Update item state
-      uhab_item_state_set(&event->item->state, &event->state);
+      default:
+         rule_event = UHAB_RULE_EVENT_CHANGED;
+         break;
+   }
 
+   return rule_event;
+}
+
+/** Apply event state to the item */
+static void apply_event_state(uhab_bus_event_t *event)
+{
+   uhab_item_state_t oldstate;
+   int grouped = (uhab_item_get_meta(event->item)->groups.count > 0);
 #if ENABLE_TRACE_BUS_CHANGES
-      TRACE("Item: '%s' changed to: %s", event->item->name, uhab_item_state_get_value(&event->item->state, txt, sizeof(txt)));
+   char txt[255];
 #endif
 
-      // Release all waiting states
-      VERIFY(osMutexWait(waitstate_mutex, osWaitForever) == osOK);
+   // Keep previous state for the aggregates of the item groups
+   if (grouped && uhab_item_state_copy(&oldstate, &event->item->state) != 0)
+   {
+      // Only string copy may fail, string state is not aggregated so its type is enough
+      os_memset(&oldstate, 0, sizeof(uhab_item_state_t));
+      oldstate.type = event->item->state.type;
+      oldstate.storage = UHAB_ITEM_STATE_STR_REF;
+   }
+
+   // Update item state, event state is moved to the item
+   uhab_item_state_move(&event->item->state, &event->state);
+
+#if ENABLE_TRACE_BUS_CHANGES
+   TRACE("Item: '%s' changed to: %s", event->item->name, uhab_item_state_get_value(&event->item->state, txt, sizeof(txt)));
+#endif
+
+   // Save update time
+   event->item->bus.update_time = hal_time_ms();
+
+   uhab_history_record(event->item, event->timestamp);
+
+   if (grouped)
+   {
+      update_aggregates(event->item, &oldstate);
+      uhab_item_state_release(&oldstate);
+   }
+}
+
+/**
+ * Update aggregates of the item groups, group with changed aggregate gets its own update event.
+ * Group state is taken from the aggregate when the group worker processes the event, so the last processed
+ * event sets the latest value whatever order the events of more workers are queued in.
+ */
+static void update_aggregates(uhab_item_t *item, const uhab_item_state_t *oldstate)
+{
+   int ix;
+   uhab_item_t *group;
+   uhab_bus_event_t event;
+   const uhab_item_array_t *groups = &uhab_item_get_meta(item)->groups;
+
+   for (ix = 0; ix < groups->count; ix++)
+   {
+      group = groups->items[ix];
+
+      if (uhab_item_get_meta(group)->aggregate != NULL && uhab_group_aggregate_update(group, oldstate, &item->state) > 0)
+      {
+         os_memset(&event, 0, sizeof(uhab_bus_event_t));
+         event.item = group;
+         event.state.type = UHAB_ITEM_STATE_TYPE_NUMBER;
+         event.flags = UHAB_BUS_EVENT_FLAG_AGGREGATE;
+         event.timestamp = hal_time_ms();
+
+         // Dropped event marks the group stale, it is posted again by the next child change
+         if (queue_event(get_item_worker(group), UHAB_BUS_LANE_TELEMETRY, &event) != 0)
+            TRACE_ERROR("Update group: %s aggregate", group->name);
+      }
+   }
+}
+
+/**
+ * Publish changed items as new repository snapshot version and record them to the journal.
+ * Snapshot is replaced under the journal lock, reader of the journal sequence gets snapshot with its changes.
+ */
+static void publish_changes(uhab_item_t **items, int count)
+{
+   int ix;
+   uhab_bus_journal_entry_t *entry;
+
+   VERIFY(osMutexWait(journal_mutex, osWaitForever) == osOK);
+
+   // Failed publish marks the snapshot stale, readers get live states until the next publish rebuilds it
+   if (uhab_snapshot_publish(items, count) != 0)
+      TRACE_ERROR("Publish snapshot of %d items", count);
+
+   for (ix = 0; ix < count; ix++)
+   {
+      entry = &journal[(journal_seq + 1) & (CFG_UHAB_BUS_JOURNAL_SIZE - 1)];
+      entry->seq = journal_seq + 1;
+      entry->item = items[ix];
+      uhab_item_get_bus(items[ix])->seq = entry->seq;
+
+      __atomic_store_n(&journal_seq, entry->seq, __ATOMIC_RELEASE);
+   }
+
+   VERIFY(osMutexRelease(journal_mutex) == osOK);
+
+   // Persisted states are written from the published snapshot
+   for (ix = 0; ix < count; ix++)
+      uhab_persist_mark(items[ix]);
+}
+
+/** Release waiting states of the pages where the changed items are visible */
+static void wakeup_waitstates(uhab_item_t **items, int count)
+{
+   int ix, px, defer;
+   uint32_t pass;
+   hal_time_t now;
+   uhab_item_bus_t *bus;
+   uhab_sitemap_widget_t *page;
+   uhab_bus_waitstate_t *ws;
+
+   if (count == 0)
+      return;
+
+   VERIFY(osMutexWait(waitstate_mutex, osWaitForever) == osOK);
+
+   // Each waitstate is released only once per wakeup pass
+   pass = ++wakeup_pass;
+
+   // Wakeups following the last wakeup within the coalescing window are deferred to the window end,
+   // the first change after quiet period is released immediately
+   now = hal_time_ms();
+   defer = (waitstate_coalesce > 0 && now - last_wakeup_time < waitstate_coalesce);
+
+   // Journal waitstates are released by any change
+   for (ws = journal_waitstates; ws != NULL; ws = ws->page_next)
+   {
+      if (ws->active && ws->wakeup_pass != pass)
+      {
+         ws->wakeup_pass = pass;
+         release_waitstate(ws, defer);
+      }
+   }
+
+   for (ix = 0; ix < count; ix++)
+   {
+      bus = uhab_item_get_bus(items[ix]);
+
+      for (px = 0; px < bus->pages.count; px++)
+      {
+         page = bus->pages.widgets[px];
+
+         for (ws = page->waitstates; ws != NULL; ws = ws->page_next)
+         {
+            if (ws->active && ws->wakeup_pass != pass)
+            {
+               ws->wakeup_pass = pass;
+               release_waitstate(ws, defer);
+            }
+         }
+      }
+   }
+
+   if (!defer)
+   {
+      last_wakeup_time = now;
+   }
+   else if (!wakeup_timer_armed)
+   {
+      VERIFY(uhab_timer_start(wakeup_timer, waitstate_coalesce - (uint32_t)(now - last_wakeup_time)) == 0);
+      wakeup_timer_armed = 1;
+   }
+
+   VERIFY(osMutexRelease(waitstate_mutex) == osOK);
+}
+
+/** Release or defer release of the waitstate, must be called with locked waitstate mutex */
+static void release_waitstate(uhab_bus_waitstate_t *ws, int defer)
+{
+   if (defer)
+   {
+      ws->wakeup_deferred = 1;
+   }
+   else if (!ws->wakeup_deferred)
+   {
+      VERIFY(osSemaphoreRelease(ws->sem) == osOK);
+   }
+}
+
+/** Coalescing window timeout, release deferred waitstates */
+static void wakeup_timer_cb(void *arg)
+{
+   uhab_bus_waitstate_t *ws;
+
+   VERIFY(osMutexWait(waitstate_mutex, osWaitForever) == osOK);
 
-      for (ws = list_head(waitstates); ws != NULL; ws = list_item_next(ws))
+   for (ws = list_head(waitstates); ws != NULL; ws = list_item_next(ws))
+   {
+      if (ws->active && ws->wakeup_deferred)
       {
-         if (ws->active)
+         ws->wakeup_deferred = 0;
+         VERIFY(osSemaphoreRelease(ws->sem) == osOK);
+      }
+   }
+
+   last_wakeup_time = hal_time_ms();
+   wakeup_timer_armed = 0;
+
+   VERIFY(osMutexRelease(waitstate_mutex) == osOK);
+}
+
+/** Update source to dispatch latency statistics, batch latency is counted for each of its items (as events) */
+static void update_latency(uhab_bus_worker_t *worker, hal_time_t timestamp, int count)
+{
+   hal_time_t now = hal_time_ms();
+   uint32_t latency = (now > timestamp) ? (uint32_t)(now - timestamp) : 0;
+
+   worker->stats.latency_last = latency;
+   worker->stats.latency_total += (uint64_t)latency * count;
+   if (latency > worker->stats.latency_max)
+      worker->stats.latency_max = latency;
+}
+
+/** Working thread */
+static void bus_thread(void *arg)
+{
+   uhab_bus_worker_t *worker = arg;
+   uhab_bus_event_t event;
+   uhab_item_t *changed_items[CFG_UHAB_BUS_DRAIN_BATCH];
+   int count, processed, lane;
+
+   ASSERT(worker != NULL);
+
+   TRACE("BUS worker[%d] thread is running ...", worker->index);
+
+   while(1)
+   {
+      // Drain batch of events from the rings, interactive lane first
+      for (count = 0, processed = 0; processed < CFG_UHAB_BUS_DRAIN_BATCH; processed++)
+      {
+         for (lane = 0; lane < UHAB_BUS_LANE_COUNT && ring_get(&worker->ring[lane], &event) != 0; lane++);
+
+         if (lane == UHAB_BUS_LANE_COUNT)
+            break;
+
+         update_latency(worker, event.timestamp, (event.flags & UHAB_BUS_EVENT_FLAG_BATCH) ? event.batch->count : 1);
+
+         if (event.flags & UHAB_BUS_EVENT_FLAG_BATCH)
+         {
+            // Changes preceding the batch are published first to keep the versions order
+            if (count > 0)
+            {
+               publish_changes(changed_items, count);
+               wakeup_waitstates(changed_items, count);
+               count = 0;
+            }
+
+            // Batch part of this worker is processed, published as one snapshot version and its waitstates are released at once.
+            // Parts of the batch processed by the other workers are published by their own versions.
+            process_batch(event.batch);
+            publish_changes(event.batch->items, event.batch->count);
+            wakeup_waitstates(event.batch->items, event.batch->count);
+
+            worker->stats.events += event.batch->count;
+            os_free(event.batch);
+            continue;
+         }
+
+         // Changes preceding the rules are published first, waitstates don't wait for the automation
+         if (count > 0 && uhab_automation_has_rules(event.item))
          {
-            if (uhab_sitemap_find_item_widget(ws->parent_widget, event->item) != NULL)
-               VERIFY(osSemaphoreRelease(ws->sem) == osOK);
+            publish_changes(changed_items, count);
+            wakeup_waitstates(changed_items, count);
+            count = 0;
          }
+
+         if (event.flags & UHAB_BUS_EVENT_FLAG_COALESCED)
+            take_pending_state(&event);
+         else if (event.flags & UHAB_BUS_EVENT_FLAG_AGGREGATE)
+            take_aggregate_state(&event);
+
+         process_event(&event);
+         changed_items[count++] = event.item;
+         worker->stats.events++;
       }
 
-      VERIFY(osMutexRelease(waitstate_mutex) == osOK);
+      // Publish changes and release all waiting states once per drain
+      if (count > 0)
+      {
+         publish_changes(changed_items, count);
+         wakeup_waitstates(changed_items, count);
+      }
 
-      // Save update time
-      event->item->bus.update_time = hal_time_ms();
+      if (processed > 0)
+      {
+         worker->stats.drains++;
+         worker->stats.last_drain = processed;
+         if (processed > worker->stats.max_drain)
+            worker->stats.max_drain = processed;
+      }
+      else
+      {
+         // Rings are empty, wait for producer
+         __atomic_store_n(&worker->sleeping, 1, __ATOMIC_SEQ_CST);
+
+         for (lane = 0; lane < UHAB_BUS_LANE_COUNT && ring_empty(&worker->ring[lane]); lane++);
 
-      // Free bus event
-      uhab_item_state_release(&event->state);
-      osPoolFree(pool, event);
+         if (lane == UHAB_BUS_LANE_COUNT)
+         {
+            osSemaphoreWait(worker->sem, osWaitForever);
+         }
+         else if (!__atomic_exchange_n(&worker->sleeping, 0, __ATOMIC_SEQ_CST))
+         {
+            // Producer already released the semaphore, consume it
+            osSemaphoreWait(worker->sem, osWaitForever);
+         }
+      }
+   }
+}
+
+/** Load click and waitstate timing from the system config */
+static void load_timing_config(void)
+{
+   click_timelen = uhab_config_service_get_int(CFG_SYSTEM_BINDING_NAME, CFG_SYSTEM_CONFIG_KEY_BUS_CLICK_TMLEN, click_timelen);
+   longclick_timelen = uhab_config_service_get_int(CFG_SYSTEM_BINDING_NAME, CFG_SYSTEM_CONFIG_KEY_BUS_LONGCLICK_TMLEN, longclick_timelen);
+   longpress_timelen = uhab_config_service_get_int(CFG_SYSTEM_BINDING_NAME, CFG_SYSTEM_CONFIG_KEY_BUS_LONGPRESS_TMLEN, longpress_timelen);
+   waitchanges_timeout = uhab_config_service_get_int(CFG_SYSTEM_BINDING_NAME, CFG_SYSTEM_CONFIG_KEY_BUS_WAITCHANGES_TIMEOUT, waitchanges_timeout);
+   waitstate_coalesce = uhab_config_service_get_int(CFG_SYSTEM_BINDING_NAME, CFG_SYSTEM_CONFIG_KEY_BUS_WAITSTATE_COALESCE, waitstate_coalesce);
+}
+
+/** System config changed, workers and lanes are configured only at init */
+static void config_changed_cb(const char *service, const char *key, void *arg)
+{
+   if (!strncasecmp(key, "bus.", 4))
+   {
+      load_timing_config();
+      TRACE("BUS timing reloaded, changed key: %s", key);
    }
 }
@@ -16,18 +16,159 @@ typedef struct uhab_bus_waitstate
    osSemaphoreId sem;
    uhab_sitemap_widget_t *parent_widget;
 
+   /** Next waitstate of the same page widget */
+   struct uhab_bus_waitstate *page_next;
+
+   /** Last wakeup pass, waitstate is released once per pass */
+   uint32_t wakeup_pass;
+
+   /** Wakeup is deferred to the end of the coalescing window */
+   uint8_t wakeup_deferred;
+
 } uhab_bus_waitstate_t;
 
 
+/** Event state is pending in the item (coalesced update) */
+#define UHAB_BUS_EVENT_FLAG_COALESCED     0x01
+
+/** Event carries batch of item updates */
+#define UHAB_BUS_EVENT_FLAG_BATCH         0x02
+
+/** Group state is taken from its aggregate when the event is processed */
+#define UHAB_BUS_EVENT_FLAG_AGGREGATE     0x04
+
+
+/** BUS batch of item updates applied at once */
+typedef struct uhab_bus_batch
+{
+   int count;
+
+   /** Source timestamp of the batch states */
+   hal_time_t timestamp;
+
+   /** Batch items, array is allocated behind the states */
+   uhab_item_t **items;
+
+   /** New item states */
+   uhab_item_state_t states[];
+
+} uhab_bus_batch_t;
+
+
 /** BUS event */
 typedef struct
 {
    uhab_item_t *item;
    uhab_item_state_t state;
+   uint8_t flags;
+   uhab_bus_batch_t *batch;
+
+   /** Source timestamp, time when the input was changed */
+   hal_time_t timestamp;
 
 } uhab_bus_event_t;
 
 
+/** BUS ring slot with inline event */
+typedef struct
+{
+   /** Slot sequence number, equals position + 1 when event is ready */
+   uint32_t seq;
+   uhab_bus_event_t event;
+
+} uhab_bus_slot_t;
+
+
+/** BUS lanes, interactive lane has strict priority */
+typedef enum
+{
+   UHAB_BUS_LANE_INTERACTIVE,
+   UHAB_BUS_LANE_TELEMETRY,
+
+   UHAB_BUS_LANE_COUNT
+
+} uhab_bus_lane_t;
+
+
+/** BUS lane overflow policy */
+typedef enum
+{
+   UHAB_BUS_OVERFLOW_BLOCK,            // Wait for free slot up to block timeout, then drop newest
+   UHAB_BUS_OVERFLOW_DROP_OLDEST,      // Drop the oldest queued event
+   UHAB_BUS_OVERFLOW_DROP_NEWEST,      // Drop the new event
+   UHAB_BUS_OVERFLOW_COALESCE,         // Coalesce lane updates per item, drop newest when still full
+
+} uhab_bus_overflow_t;
+
+
+/** BUS lane statistics */
+typedef struct
+{
+   uint32_t enqueued;         // Queued events
+   uint32_t dropped;          // Events dropped by overflow policy
+   uint32_t high_water;       // Max. number of queued events
+   uint32_t full_waits;       // Producer waits on full ring
+
+} uhab_bus_lane_stats_t;
+
+
+/** Lock-free bounded events ring, multi producers and one consumer (producers may drop oldest event) */
+typedef struct
+{
+   uhab_bus_slot_t *slots;
+   uint32_t mask;             // Ring size - 1
+   uint32_t head;             // Producers position
+   uint32_t tail;             // Consumer position
+
+   uhab_bus_lane_stats_t stats;
+
+} uhab_bus_ring_t;
+
+
+/** BUS changes journal entry */
+typedef struct
+{
+   uint32_t seq;
+   uhab_item_t *item;
+
+} uhab_bus_journal_entry_t;
+
+
+/** BUS worker statistics */
+typedef struct
+{
+   uint32_t events;           // Processed events
+   uint32_t drains;           // Number of ring drains
+   uint32_t last_drain;       // Events processed by the last drain
+   uint32_t max_drain;        // Max. events processed by one drain
+   uint32_t coalesced;        // Updates merged into queued event
+   uint32_t latency_last;     // Last event source to dispatch latency [ms]
+   uint32_t latency_max;      // Max. event latency [ms]
+   uint64_t latency_total;    // Sum of dispatched events latency [ms]
+
+   uhab_bus_lane_stats_t lanes[UHAB_BUS_LANE_COUNT];
+
+} uhab_bus_stats_t;
+
+
+/** BUS worker, processes events of the items hashed to it */
+typedef struct
+{
+   int index;
+   osThreadId thread;
+
+   /** Events rings, one per lane */
+   uhab_bus_ring_t ring[UHAB_BUS_LANE_COUNT];
+
+   /** Consumer is waiting for events on the semaphore */
+   uint32_t sleeping;
+   osSemaphoreId sem;
+
+   uhab_bus_stats_t stats;
+
+} uhab_bus_worker_t;
+
+
 /** Initialize event bus */
 int uhab_bus_init(void);
 
@@ -40,8 +181,39 @@ int uhab_bus_send(const uhab_item_t *item, const uhab_item_state_t *state);
 /** Update item state without sending to binding */
 int uhab_bus_update(const uhab_item_t *item, const uhab_item_state_t *state);
 
+/** Update item state by the command (command confirmed by binding, rules), event is queued to the interactive lane */
+int uhab_bus_update_cmd(const uhab_item_t *item, const uhab_item_state_t *state);
+
+/**
+ * Update batch of items state (timestamp 0 is current time, max. CFG_UHAB_BUS_MAX_BATCH items).
+ * Batch is split by the items workers and lanes, each part is processed and published by its worker separately,
+ * the parts are not applied atomically together. Nothing is queued when any part allocation fails.
+ */
+int uhab_bus_update_batch(const uhab_item_t * const items[], const uhab_item_state_t states[], int count, hal_time_t timestamp);
+
+/** Update batch of items state by the command, batch is queued to the interactive lane */
+int uhab_bus_update_batch_cmd(const uhab_item_t * const items[], const uhab_item_state_t states[], int count);
+
 /** Wait for any changes */
 int uhab_bus_waitfor_changes(uhab_sitemap_widget_t *parent_widget);
 
+/** Wait until the changes journal sequence exceeds since or timeout [ms] expires */
+int uhab_bus_waitfor_journal(uint32_t since, uint32_t timeout);
+
+/** Get current changes journal sequence number */
+uint32_t uhab_bus_get_seq(void);
+
+/** Get items changed after the since sequence, returns number of items or -1 when since is out of the journal (resync) */
+int uhab_bus_get_changes(uint32_t since, uhab_item_t *items[], int maxitems, uint32_t *seq);
+
+/** Get number of bus workers */
+int uhab_bus_get_workers_count(void);
+
+/** Get bus worker statistics */
+int uhab_bus_get_stats(int worker, uhab_bus_stats_t *stats);
+
+/** Get bus lane name */
+const char *uhab_bus_get_lane_name(uhab_bus_lane_t lane);
+
 
 #endif // __UHAB_EVENT_BUS_H
@@ -0,0 +1,629 @@
+/**
+ * \file config_xml.c        \brief Streaming XML config reader
+ *
+ * Config file is parsed by the yxml in one pass through small read buffer, the loaders get element
+ * start with its attributes and element end. Only the attributes of the current element and the
+ * requested element content are kept in memory.
+ *
+ * Parsed tokens are recorded to the cache file (records of the element attributes and captured
+ * content). Next load maps the cache and replays the records when the source file was not changed,
+ * the cache is rebuilt from the source file otherwise. Cache is not a compiled config image, loaders
+ * still create their objects from the replayed elements.
+ */
+
+#include "uhab.h"
+#include "config_xml.h"
+#include <sys/mman.h>
+
+TRACE_TAG(cfg_xml);
+#if !ENABLE_TRACE_CONFIG
+#include "trace_undef.h"
+#endif
+
+#define CACHE_MAGIC           0x55484358     // UHCX
+#define CACHE_FORMAT          1
+
+/** Cache version of the records format and loaders schema, caches of the other version are rebuilt */
+#define CACHE_VERSION         ((CACHE_FORMAT << 8) | UHAB_CONFIG_XML_SCHEMA)
+
+#if UHAB_CONFIG_XML_SCHEMA > 0xFF
+#error "Config XML schema version must fit to 8 bits of the cache version"
+#endif
+
+// Cache records
+#define CACHE_RECORD_START    'S'
+#define CACHE_RECORD_CONTENT  'C'
+#define CACHE_RECORD_END      'E'
+#define CACHE_RECORD_EOF      'Z'
+
+// Prototypes:
+static void begin_element(uhab_config_xml_t *xml);
+static int append_attr(uhab_config_xml_t *xml, const char *str, int term);
+static int append_content(uhab_config_xml_t *xml, const char *str, int len);
+static int cache_open(uhab_config_xml_t *xml, const struct stat *st);
+static void cache_create(uhab_config_xml_t *xml, const struct stat *st);
+static void cache_close(uhab_config_xml_t *xml);
+static int cache_next(uhab_config_xml_t *xml);
+static int cache_record(uhab_config_xml_t *xml, int event);
+static void cache_write(uhab_config_xml_t *xml, const void *data, int len);
+static int cache_flush(uhab_config_xml_t *xml);
+static uint32_t cache_checksum(uint32_t checksum, const uint8_t *data, int len);
+
+
+/** Open config XML file, its token cache is used when it is not older than the source file */
+uhab_config_xml_t *uhab_config_xml_open(const char *path)
+{
+   struct stat st;
+   const char *name;
+   char txt[255];
+   uhab_config_xml_t *xml;
+
+   if ((xml = os_malloc(sizeof(uhab_config_xml_t))) == NULL)
+   {
+      TRACE_ERROR("Alloc xml reader");
+      throw_exception(fail_alloc);
+   }
+   os_memset(xml, 0, sizeof(uhab_config_xml_t));
+   xml->fd = xml->cache_fd = -1;
+   xml->start_time = hal_time_ms();
+   xml->heap_free = xml->heap_min = osMemGetFreeSize();
+
+   if ((xml->path = os_strdup(path)) == NULL)
+      throw_exception(fail_path);
+
+   if (stat(path, &st) != 0)
+   {
+      TRACE_ERROR("Can't open cfg file %s", path);
+      throw_exception(fail_open);
+   }
+
+   // Cache file name is the source file name (with extension)
+   name = ((name = strrchr(path, '/')) != NULL) ? name + 1 : path;
+   snprintf(txt, sizeof(txt), CFG_UHAB_CONFIG_CACHE_FILENAME, name);
+   if ((xml->cache_path = os_strdup(txt)) == NULL)
+      throw_exception(fail_open);
+
+   if (cache_open(xml, &st) == 0)
+      return xml;
+
+   if ((xml->fd = open(path, O_RDONLY)) < 0)
+   {
+      TRACE_ERROR("Can't open cfg file %s", path);
+      throw_exception(fail_open);
+   }
+
+   yxml_init(&xml->x, xml->stack, sizeof(xml->stack));
+
+   // Cache is not used when it can't be written
+   cache_create(xml, &st);
+
+   return xml;
+
+fail_open:
+   if (xml->cache_path != NULL)
+      os_free(xml->cache_path);
+   os_free(xml->path);
+fail_path:
+   os_free(xml);
+fail_alloc:
+   return NULL;
+}
+
+/** Close config XML file */
+void uhab_config_xml_close(uhab_config_xml_t *xml)
+{
+   if (xml == NULL)
+      return;
+
+   TRACE("%s: %d elements%s in %d ms, heap used: %d  peak: %d", xml->path, xml->elements, xml->cached ? " from cache" : "",
+         (int)(hal_time_ms() - xml->start_time), xml->heap_free - osMemGetFreeSize(), xml->heap_free - xml->heap_min);
+
+   if (xml->map != NULL)
+      munmap((void *)xml->map, xml->map_size);
+
+   if (xml->fd >= 0)
+      close(xml->fd);
+
+   cache_close(xml);
+
+   if (xml->content != NULL)
+      os_free(xml->content);
+
+   os_free(xml->cache_path);
+   os_free(xml->path);
+   os_free(xml);
+}
+
+/** Read next element start or end, returns uhab_config_xml_event_t or -1 on error */
+int uhab_config_xml_next(uhab_config_xml_t *xml)
+{
+   int res;
+
+   // Ended element is left by the next call, its content is not valid anymore
+   if (xml->closed)
+   {
+      xml->depth--;
+      xml->closed = 0;
+
+      if (xml->capture_depth > xml->depth)
+         xml->capture_depth = 0;
+   }
+
+   if (xml->cached)
+      return cache_next(xml);
+
+   // Token read while the element start was reported
+   res = xml->pending;
+   xml->pending = YXML_OK;
+
+   for (;;)
+   {
+      switch(res)
+      {
+         case YXML_ELEMSTART:
+            if (xml->opened)
+            {
+               xml->pending = res;
+               xml->opened = 0;
+               return cache_record(xml, UHAB_CONFIG_XML_START);
+            }
+            begin_element(xml);
+            break;
+
+         case YXML_ATTRSTART:
+            if (append_attr(xml, xml->x.attr, 1) != 0)
+               return -1;
+            break;
+
+         case YXML_ATTRVAL:
+            if (append_attr(xml, xml->x.data, 0) != 0)
+               return -1;
+            break;
+
+         case YXML_ATTREND:
+            if (append_attr(xml, "", 1) != 0)
+               return -1;
+            break;
+
+         case YXML_CONTENT:
+            if (xml->opened)
+            {
+               xml->pending = res;
+               xml->opened = 0;
+               return cache_record(xml, UHAB_CONFIG_XML_START);
+            }
+            if (xml->capture_depth > 0 && append_content(xml, xml->x.data, strlen(xml->x.data)) != 0)
+               return -1;
+            break;
+
+         case YXML_ELEMEND:
+            if (xml->opened)
+            {
+               xml->pending = res;
+               xml->opened = 0;
+               return cache_record(xml, UHAB_CONFIG_XML_START);
+            }
+            xml->closed = 1;
+            return cache_record(xml, UHAB_CONFIG_XML_END);
+
+         default:
+            break;
+      }
+
+      // Read next token
+      if (xml->bufpos == xml->buflen)
+      {
+         if ((xml->buflen = read(xml->fd, xml->buf, sizeof(xml->buf))) < 0)
+         {
+            TRACE_ERROR("Read %s failed", xml->path);
+            return -1;
+         }
+         xml->bufpos = 0;
+
+         if (xml->buflen == 0)
+         {
+            if (yxml_eof(&xml->x) < 0)
+            {
+               TRACE_ERROR("%s: unexpected end of file", xml->path);
+               return -1;
+            }
+            return cache_record(xml, UHAB_CONFIG_XML_EOF);
+         }
+      }
+
+      if ((res = yxml_parse(&xml->x, xml->buf[xml->bufpos++])) < 0)
+      {
+         TRACE_ERROR("%s:%d: xml syntax error %d", xml->path, xml->x.line, res);
+         return -1;
+      }
+   }
+}
+
+/** Get attribute value of the started element, value may be modified by the caller */
+char *uhab_config_xml_attr(uhab_config_xml_t *xml, const char *name)
+{
+   return uhab_config_xml_attrs_find(xml->attrs, xml->attrslen, name);
+}
+
+/** Find attribute value in the element name and attributes block */
+char *uhab_config_xml_attrs_find(char *attrs, int attrslen, const char *name)
+{
+   char *pname, *pvalue;
+
+   // First string is the element name
+   for (pname = attrs + strlen(attrs) + 1; pname < attrs + attrslen; pname = pvalue + strlen(pvalue) + 1)
+   {
+      pvalue = pname + strlen(pname) + 1;
+      if (!strcmp(pname, name))
+         return pvalue;
+   }
+
+   return NULL;
+}
+
+/** Capture content of the started element, it is returned by uhab_config_xml_content() at the element end */
+void uhab_config_xml_capture(uhab_config_xml_t *xml)
+{
+   xml->capture_depth = xml->depth;
+   xml->content_len = 0;
+}
+
+/** Get captured content of the ended element or NULL when element has no content */
+char *uhab_config_xml_content(uhab_config_xml_t *xml)
+{
+   if (xml->capture_depth != xml->depth || xml->content_len == 0)
+      return NULL;
+
+   return xml->content;
+}
+
+/** Start new element, its name is the first string of the attributes */
+static void begin_element(uhab_config_xml_t *xml)
+{
+   int heap;
+
+   xml->depth++;
+   xml->opened = 1;
+   xml->elements++;
+
+   strlcpy(xml->attrs, xml->x.elem, sizeof(xml->attrs));
+   xml->attrslen = strlen(xml->attrs) + 1;
+
+   if ((heap = osMemGetFreeSize()) < xml->heap_min)
+      xml->heap_min = heap;
+}
+
+/** Append attribute name or value part to the attributes buffer */
+static int append_attr(uhab_config_xml_t *xml, const char *str, int term)
+{
+   int len = strlen(str) + term;
+
+   if (xml->attrslen + len > sizeof(xml->attrs))
+   {
+      TRACE_ERROR("%s:%d: attributes of element '%s' too long", xml->path, xml->x.line, xml->attrs);
+      return -1;
+   }
+
+   // Terminator is copied with the string
+   memcpy(&xml->attrs[xml->attrslen], str, len);
+   xml->attrslen += len;
+
+   return 0;
+}
+
+/** Append data to the captured content, buffer is doubled when it is full */
+static int append_content(uhab_config_xml_t *xml, const char *str, int len)
+{
+   int size;
+   char *content;
+
+   if (xml->content_len + len + 1 > xml->content_size)
+   {
+      for (size = xml->content_size * 2 + CFG_UHAB_CONFIG_XML_READ_SIZE; size < xml->content_len + len + 1; size *= 2);
+
+      if ((content = os_malloc(size)) == NULL)
+      {
+         TRACE_ERROR("Alloc content of element '%s'", xml->attrs);
+         return -1;
+      }
+
+      if (xml->content != NULL)
+      {
+         memcpy(content, xml->content, xml->content_len);
+         os_free(xml->content);
+      }
+
+      xml->content = content;
+      xml->content_size = size;
+   }
+
+   memcpy(&xml->content[xml->content_len], str, len);
+   xml->content_len += len;
+   xml->content[xml->content_len] = '\0';
+
+   return 0;
+}
+
+/** Map cache file when it is valid for the source file */
+static int cache_open(uhab_config_xml_t *xml, const struct stat *st)
+{
+   int fd;
+   struct stat cst;
+   const uhab_config_xml_cache_header_t *header;
+
+   if ((fd = open(xml->cache_path, O_RDONLY)) < 0)
+      return -1;
+
+   if (fstat(fd, &cst) != 0 || cst.st_size < (off_t)sizeof(uhab_config_xml_cache_header_t))
+      throw_exception(fail_map);
+
+   if ((xml->map = mmap(NULL, cst.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+   {
+      xml->map = NULL;
+      throw_exception(fail_map);
+   }
+   xml->map_size = cst.st_size;
+   close(fd);
+
+   header = (const uhab_config_xml_cache_header_t *)xml->map;
+   if (header->magic != CACHE_MAGIC || header->version != CACHE_VERSION ||
+       header->source_mtime != (uint32_t)st->st_mtime || header->source_size != (uint32_t)st->st_size ||
+       header->size != xml->map_size - sizeof(uhab_config_xml_cache_header_t))
+   {
+      TRACE("%s: cache is not valid", xml->path);
+      throw_exception(fail_valid);
+   }
+
+   if (cache_checksum(0x811C9DC5, xml->map + sizeof(uhab_config_xml_cache_header_t), header->size) != header->checksum)
+   {
+      TRACE_ERROR("%s: cache checksum failed", xml->path);
+      throw_exception(fail_valid);
+   }
+
+   xml->map_pos = sizeof(uhab_config_xml_cache_header_t);
+   xml->cached = 1;
+
+   return 0;
+
+fail_valid:
+   munmap((void *)xml->map, xml->map_size);
+   xml->map = NULL;
+   return -1;
+
+fail_map:
+   close(fd);
+   return -1;
+}
+
+/** Create temporary cache file, it replaces the cache when the source file is parsed */
+static void cache_create(uhab_config_xml_t *xml, const struct stat *st)
+{
+   char path[255];
+
+   mkdir(CFG_UHAB_CONFIG_CACHE_DIR, 0755);
+
+   snprintf(path, sizeof(path), "%s.tmp", xml->cache_path);
+   if ((xml->cache_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+   {
+      TRACE("%s: cache is not written", xml->path);
+      return;
+   }
+
+   xml->header.magic = CACHE_MAGIC;
+   xml->header.version = CACHE_VERSION;
+   xml->header.source_mtime = st->st_mtime;
+   xml->header.source_size = st->st_size;
+   xml->header.checksum = 0x811C9DC5;
+
+   // Header is written when all records are written
+   if (lseek(xml->cache_fd, sizeof(uhab_config_xml_cache_header_t), SEEK_SET) < 0)
+   {
+      close(xml->cache_fd);
+      xml->cache_fd = -1;
+      unlink(path);
+   }
+}
+
+/** Close cache file, it replaces previous cache file when the source file was parsed completely */
+static void cache_close(uhab_config_xml_t *xml)
+{
+   char path[255];
+
+   if (xml->cache_fd < 0)
+      return;
+
+   snprintf(path, sizeof(path), "%s.tmp", xml->cache_path);
+
+   if (xml->complete && cache_flush(xml) == 0 && lseek(xml->cache_fd, 0, SEEK_SET) == 0 &&
+       write(xml->cache_fd, &xml->header, sizeof(xml->header)) == sizeof(xml->header))
+   {
+      close(xml->cache_fd);
+
+      if (rename(path, xml->cache_path) == 0)
+      {
+         TRACE("%s: cache %s written, size: %d", xml->path, xml->cache_path, xml->header.size);
+         return;
+      }
+   }
+   else if (xml->cache_fd >= 0)
+   {
+      close(xml->cache_fd);
+   }
+
+   unlink(path);
+}
+
+/** Replay next cache record */
+static int cache_next(uhab_config_xml_t *xml)
+{
+   int heap;
+   uint8_t type;
+   uint16_t len16;
+   uint32_t len;
+
+   for (;;)
+   {
+      if (xml->map_pos >= xml->map_size)
+         throw_exception(fail_record);
+
+      type = xml->map[xml->map_pos++];
+      switch(type)
+      {
+         case CACHE_RECORD_START:
+            if (xml->map_pos + sizeof(len16) > xml->map_size)
+               throw_exception(fail_record);
+            memcpy(&len16, &xml->map[xml->map_pos], sizeof(len16));
+            xml->map_pos += sizeof(len16);
+
+            if (len16 == 0 || len16 > sizeof(xml->attrs) || xml->map_pos + len16 > xml->map_size)
+               throw_exception(fail_record);
+            memcpy(xml->attrs, &xml->map[xml->map_pos], len16);
+            xml->map_pos += len16;
+
+            if (xml->attrs[len16 - 1] != '\0')
+               throw_exception(fail_record);
+            xml->attrslen = len16;
+
+            xml->depth++;
+            xml->elements++;
+
+            if ((heap = osMemGetFreeSize()) < xml->heap_min)
+               xml->heap_min = heap;
+
+            return UHAB_CONFIG_XML_START;
+
+         case CACHE_RECORD_CONTENT:
+            if (xml->map_pos + sizeof(len) > xml->map_size)
+               throw_exception(fail_record);
+            memcpy(&len, &xml->map[xml->map_pos], sizeof(len));
+            xml->map_pos += sizeof(len);
+
+            if (len > xml->map_size - xml->map_pos)
+               throw_exception(fail_record);
+
+            // Content is returned only when it is captured by the loader
+            if (xml->capture_depth == xml->depth && append_content(xml, (const char *)&xml->map[xml->map_pos], len) != 0)
+               return -1;
+            xml->map_pos += len;
+            break;
+
+         case CACHE_RECORD_END:
+            if (xml->depth == 0)
+               throw_exception(fail_record);
+            xml->closed = 1;
+            return UHAB_CONFIG_XML_END;
+
+         case CACHE_RECORD_EOF:
+            return UHAB_CONFIG_XML_EOF;
+
+         default:
+            throw_exception(fail_record);
+      }
+   }
+
+fail_record:
+   TRACE_ERROR("%s: not valid cache record at %d", xml->cache_path, xml->map_pos);
+   return -1;
+}
+
+/** Write record of the reported event to the cache */
+static int cache_record(uhab_config_xml_t *xml, int event)
+{
+   uint8_t type;
+   uint16_t len16;
+   uint32_t len;
+
+   if (xml->cache_fd < 0)
+      return event;
+
+   switch(event)
+   {
+      case UHAB_CONFIG_XML_START:
+         type = CACHE_RECORD_START;
+         len16 = xml->attrslen;
+         cache_write(xml, &type, sizeof(type));
+         cache_write(xml, &len16, sizeof(len16));
+         cache_write(xml, xml->attrs, len16);
+         break;
+
+      case UHAB_CONFIG_XML_END:
+         if (uhab_config_xml_content(xml) != NULL)
+         {
+            type = CACHE_RECORD_CONTENT;
+            len = xml->content_len;
+            cache_write(xml, &type, sizeof(type));
+            cache_write(xml, &len, sizeof(len));
+            cache_write(xml, xml->content, len);
+         }
+         type = CACHE_RECORD_END;
+         cache_write(xml, &type, sizeof(type));
+         break;
+
+      case UHAB_CONFIG_XML_EOF:
+         type = CACHE_RECORD_EOF;
+         cache_write(xml, &type, sizeof(type));
+         xml->complete = 1;
+         break;
+   }
+
+   return event;
+}
+
+/** Write data to the cache write buffer */
+static void cache_write(uhab_config_xml_t *xml, const void *data, int len)
+{
+   int n;
+   const uint8_t *pdata = data;
+
+   while (len > 0 && xml->cache_fd >= 0)
+   {
+      if (xml->wlen == sizeof(xml->wbuf) && cache_flush(xml) != 0)
+         return;
+
+      n = sizeof(xml->wbuf) - xml->wlen;
+      if (n > len)
+         n = len;
+      memcpy(&xml->wbuf[xml->wlen], pdata, n);
+      xml->wlen += n;
+      pdata += n;
+      len -= n;
+   }
+}
+
+/** Write cache buffer to the file, cache is dropped on write error */
+static int cache_flush(uhab_config_xml_t *xml)
+{
+   char path[255];
+
+   if (xml->wlen == 0)
+      return 0;
+
+   if (write(xml->cache_fd, xml->wbuf, xml->wlen) != xml->wlen)
+   {
+      TRACE_ERROR("Write cache %s failed", xml->cache_path);
+
+      snprintf(path, sizeof(path), "%s.tmp", xml->cache_path);
+      close(xml->cache_fd);
+      xml->cache_fd = -1;
+      unlink(path);
+      return -1;
+   }
+
+   xml->header.checksum = cache_checksum(xml->header.checksum, xml->wbuf, xml->wlen);
+   xml->header.size += xml->wlen;
+   xml->wlen = 0;
+
+   return 0;
+}
+
+/** FNV-1a checksum of the cache records */
+static uint32_t cache_checksum(uint32_t checksum, const uint8_t *data, int len)
+{
+   while (len-- > 0)
+   {
+      checksum ^= *data++;
+      checksum *= 0x01000193;
+   }
+
+   return checksum;
+}
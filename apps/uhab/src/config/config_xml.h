@@ -0,0 +1,141 @@
+/**
+ * \file config_xml.h        \brief Streaming XML config reader
+ */
+
+#ifndef __UHAB_CONFIG_XML_H
+#define __UHAB_CONFIG_XML_H
+
+#include "yxml.h"
+
+
+/**
+ * Loaders schema version, the set of elements captured by uhab_config_xml_capture() in all loaders.
+ * Token cache keeps the captured content only, the version must be incremented when a loader captures other elements.
+ */
+#define UHAB_CONFIG_XML_SCHEMA      1
+
+
+/** Reader events */
+typedef enum
+{
+   UHAB_CONFIG_XML_EOF = 0,
+
+   /** Element start, its name and all attributes are available */
+   UHAB_CONFIG_XML_START,
+
+   /** Element end, captured content is available */
+   UHAB_CONFIG_XML_END,
+
+} uhab_config_xml_event_t;
+
+
+/** Config token cache file header */
+typedef struct
+{
+   uint32_t magic;
+   uint16_t version;
+   uint16_t reserved;
+
+   /** Modification time and size of the source file */
+   uint32_t source_mtime;
+   uint32_t source_size;
+
+   /** Records size and checksum */
+   uint32_t size;
+   uint32_t checksum;
+
+} uhab_config_xml_cache_header_t;
+
+
+/** Config XML reader */
+typedef struct
+{
+   yxml_t x;
+   int fd;
+   char *path;
+
+   char buf[CFG_UHAB_CONFIG_XML_READ_SIZE];
+   int buflen;
+   int bufpos;
+
+   /** Parser elements stack */
+   char stack[CFG_UHAB_CONFIG_XML_STACK_SIZE];
+
+   /** Name and attributes of the started element, "name\0attr\0value\0..." */
+   char attrs[CFG_UHAB_CONFIG_XML_ATTRS_SIZE];
+   int attrslen;
+
+   /** Element nesting level, root element is 1 */
+   int depth;
+
+   /** Element start is not reported yet */
+   uint8_t opened;
+
+   /** Element end was reported */
+   uint8_t closed;
+
+   /** Parser token to be processed by the next call */
+   int pending;
+
+   /** Content of the element captured at depth */
+   int capture_depth;
+   char *content;
+   int content_len;
+   int content_size;
+
+   /** Token cache is replayed instead of the source file */
+   uint8_t cached;
+   const uint8_t *map;
+   uint32_t map_size;
+   uint32_t map_pos;
+
+   /** Token cache written while the source file is parsed */
+   int cache_fd;
+   uint8_t complete;
+   char *cache_path;
+   uhab_config_xml_cache_header_t header;
+   uint8_t wbuf[CFG_UHAB_CONFIG_XML_READ_SIZE];
+   int wlen;
+
+   /** Load statistics */
+   int elements;
+   hal_time_t start_time;
+   int heap_free;
+   int heap_min;
+
+} uhab_config_xml_t;
+
+
+/** Open config XML file, its token cache is used when it is not older than the source file */
+uhab_config_xml_t *uhab_config_xml_open(const char *path);
+
+/** Close config XML file */
+void uhab_config_xml_close(uhab_config_xml_t *xml);
+
+/** Read next element start or end, returns uhab_config_xml_event_t or -1 on error */
+int uhab_config_xml_next(uhab_config_xml_t *xml);
+
+/** Get name of the started element */
+#define uhab_config_xml_name(_xml) ((_xml)->attrs)
+
+/** Get nesting level of the started or ended element */
+#define uhab_config_xml_depth(_xml) ((_xml)->depth)
+
+/** Get attribute value of the started element, value may be modified by the caller */
+char *uhab_config_xml_attr(uhab_config_xml_t *xml, const char *name);
+
+/** Get name and attributes block of the started element and its length (block may be copied) */
+#define uhab_config_xml_attrs(_xml) ((_xml)->attrs)
+#define uhab_config_xml_attrs_len(_xml) ((_xml)->attrslen)
+
+/** Find attribute value in the element name and attributes block */
+char *uhab_config_xml_attrs_find(char *attrs, int attrslen, const char *name);
+
+/** Capture content of the started element, it is returned by uhab_config_xml_content() at the element end (see UHAB_CONFIG_XML_SCHEMA) */
+void uhab_config_xml_capture(uhab_config_xml_t *xml);
+
+/** Get captured content of the ended element or NULL when element has no content */
+char *uhab_config_xml_content(uhab_config_xml_t *xml);
+
+
+#endif // __UHAB_CONFIG_XML_H
@@ -3,7 +3,7 @@
  */
 
 #include "uhab.h"
-#include "roxml.h"
+#include "config_xml.h"
 
 TRACE_TAG(cfg_items);
 #if !ENABLE_TRACE_CONFIG
@@ -20,6 +20,81 @@ typedef struct
 } uhab_item_xml_element_t;
 
 
+/** Group reference of the item */
+typedef struct group_ref
+{
+   struct group_ref *next;
+   uhab_item_t *item;
+   char name[];
+
+} group_ref_t;
+
+
+/** Group references in the document order of the group children */
+typedef struct
+{
+   group_ref_t *head;
+   group_ref_t **tail;
+
+} group_refs_t;
+
+
+/** Item element staged by the loader thread */
+typedef struct staged_item
+{
+   struct staged_item *next;
+   const uhab_item_xml_element_t *elem;
+
+   /** Copy of the element name and attributes block */
+   int attrslen;
+   char attrs[];
+
+} staged_item_t;
+
+
+/** Items file parsed to the staging list */
+typedef struct
+{
+   char *path;
+   int res;
+
+   /** File is parsed, staged items may be merged */
+   int done;
+
+   /** Staged items in the document order */
+   staged_item_t *items;
+   staged_item_t **tail;
+
+   /** Staged items are freed right after the file merge */
+   uhab_arena_t arena;
+
+} staged_file_t;
+
+
+/** Items files loader */
+typedef struct
+{
+   staged_file_t *files;
+   int count;
+
+   /** Index of the next file to parse */
+   int next;
+
+   /** Signalled when a file is parsed */
+   osSemaphoreId sem;
+
+} items_loader_t;
+
+
+/** Loader thread */
+typedef struct
+{
+   items_loader_t *loader;
+   osSemaphoreId sem;
+
+} items_worker_t;
+
+
 /** UAHB items XML elements */
 static const uhab_item_xml_element_t uhab_item_elements [] = 
 {
@@ -36,178 +111,565 @@ static const uhab_item_xml_element_t uhab_item_elements [] =
    {NULL},
 };
 
+// Prototypes:
+static void load_thread(void *arg);
+static void load_files(items_loader_t *loader);
+static int parse_next(items_loader_t *loader);
+static int parse_file(staged_file_t *file);
+static int merge_file(staged_file_t *file, uhab_repository_t *repo, group_refs_t *refs);
+static int create_item(uhab_repository_t *repo, staged_item_t *st, group_refs_t *refs);
+static int resolve_groups(uhab_repository_t *repo, group_refs_t *refs);
+static int add_to_group(uhab_item_t *grp, uhab_item_t *item);
+static void free_refs(group_refs_t *refs);
+static int list_files(const char *dirname, items_loader_t *loader);
+static void free_files(items_loader_t *loader);
+static int compare_files(const void *a, const void *b);
+
+// Locals:
+static const osThreadDef(ITEMS_LOAD, load_thread, CFG_CONFIG_LOAD_THREAD_PRIORITY, 0, CFG_CONFIG_LOAD_THREAD_STACK_SIZE);
+
 
-/** Load items */
-int uhab_config_items_load(const char *path, uhab_repository_t *repo)
+/**
+ * Load items of all files in directory, files are parsed in parallel and merged in the name order.
+ * File is merged as soon as it and all the previous files are parsed, its staged items are freed right away.
+ */
+int uhab_config_items_load(const char *dirname, uhab_repository_t *repo)
 {
-   int fd;
-   uhab_item_t *item;
-   node_t *doc, *root, *node;
-   const char *value;   
-   const uhab_item_xml_element_t *elem;
-   
-   // Open config file
-   if ((fd = open(path, O_RDONLY)) < 0)
+   int ix, num_threads, res = 0;
+   hal_time_t start_time, merge_start, merge_time = 0;
+   items_loader_t loader;
+   items_worker_t workers[CFG_UHAB_CONFIG_MAX_LOAD_THREADS];
+   group_refs_t refs = {NULL, &refs.head};
+
+   start_time = hal_time_ms();
+
+   os_memset(&loader, 0, sizeof(items_loader_t));
+   if (list_files(dirname, &loader) != 0)
+      throw_exception(fail_list);
+
+   num_threads = uhab_config_service_get_int(CFG_SYSTEM_BINDING_NAME, CFG_SYSTEM_CONFIG_KEY_CONFIG_LOAD_THREADS, CFG_UHAB_CONFIG_LOAD_THREADS);
+   if (num_threads > CFG_UHAB_CONFIG_MAX_LOAD_THREADS)
+      num_threads = CFG_UHAB_CONFIG_MAX_LOAD_THREADS;
+   if (num_threads > loader.count)
+      num_threads = loader.count;
+
+   if ((loader.sem = osSemaphoreCreate(NULL, 1)) == NULL)
    {
-      TRACE_ERROR("Can't open items cfg file %s", path);
-      throw_exception(fail_open);
+      TRACE_ERROR("Create items loader semaphore");
+      throw_exception(fail_sem);
    }
-   
-   TRACE("Items cfg: %s open", path);
+   VERIFY(osSemaphoreWait(loader.sem, osWaitForever) == osOK);
 
-   if ((doc = roxml_load_fd(fd)) == NULL)
+   //
+   // 1) Start loaders parsing files to the staging lists
+   //
+   for (ix = 0; ix < num_threads - 1; ix++)
    {
-      TRACE_ERROR("Load items xml failed");
-      throw_exception(fail_load);
+      workers[ix].loader = &loader;
+
+      if ((workers[ix].sem = osSemaphoreCreate(NULL, 1)) == NULL)
+      {
+         TRACE_ERROR("Create items loader[%d] semaphore", ix);
+         break;
+      }
+      VERIFY(osSemaphoreWait(workers[ix].sem, osWaitForever) == osOK);
+
+      if (osThreadCreate(osThread(ITEMS_LOAD), &workers[ix]) == 0)
+      {
+         TRACE_ERROR("Start items loader[%d] thread", ix);
+         osSemaphoreDelete(workers[ix].sem);
+         break;
+      }
    }
-   
-   if ((root = roxml_get_chld(doc, "items", 0)) == NULL)
+   num_threads = ix;
+
+   //
+   // 2) Merge staged items to the repository in the files order, the init thread parses files too
+   //
+   for (ix = 0; ix < loader.count; ix++)
    {
-      TRACE_ERROR("Items not found");
-      throw_exception(fail_parse);
+      while (!__atomic_load_n(&loader.files[ix].done, __ATOMIC_ACQUIRE))
+      {
+         // Wait for the loader parsing the file when there is no file left to parse
+         if (parse_next(&loader) != 0)
+            osSemaphoreWait(loader.sem, osWaitForever);
+      }
+
+      if (loader.files[ix].res != 0)
+      {
+         TRACE_ERROR("Load items file %s", loader.files[ix].path);
+         res = -1;
+         break;
+      }
+
+      merge_start = hal_time_ms();
+
+      if (merge_file(&loader.files[ix], repo, &refs) != 0)
+      {
+         TRACE_ERROR("Merge items file %s", loader.files[ix].path);
+         res = -1;
+         break;
+      }
+
+      merge_time += hal_time_ms() - merge_start;
+
+      uhab_arena_free(&loader.files[ix].arena);
+      loader.files[ix].items = NULL;
    }
 
-   // Parse all defined elements
-   for (elem = &uhab_item_elements[0]; elem->name != NULL; elem++)
+   // Failed load stops taking the next files, wait for the running loaders
+   if (res != 0)
+      __atomic_store_n(&loader.next, loader.count, __ATOMIC_RELAXED);
+
+   for (ix = 0; ix < num_threads; ix++)
    {
-      for (node = roxml_get_chld(root, elem->name, 0); node != NULL; node = roxml_get_next_sibling(node))           
+      VERIFY(osSemaphoreWait(workers[ix].sem, osWaitForever) == osOK);
+      osSemaphoreDelete(workers[ix].sem);
+   }
+   osSemaphoreDelete(loader.sem);
+
+   if (res != 0)
+      throw_exception(fail_merge);
+
+   // Groups may be defined later or in the other file
+   if (resolve_groups(repo, &refs) != 0)
+      throw_exception(fail_merge);
+
+   TRACE("Items: %d files loaded in %d ms by %d threads, merged in %d ms", loader.count, (int)(hal_time_ms() - start_time),
+         num_threads + 1, (int)merge_time);
+
+   free_refs(&refs);
+   free_files(&loader);
+
+   return 0;
+
+fail_merge:
+   free_refs(&refs);
+fail_sem:
+   free_files(&loader);
+fail_list:
+   return -1;
+}
+
+/** Items loader thread */
+static void load_thread(void *arg)
+{
+   items_worker_t *worker = arg;
+
+   ASSERT(worker != NULL);
+
+   load_files(worker->loader);
+
+   osSemaphoreRelease(worker->sem);
+
+   // Terminate loader thread
+   VERIFY(osThreadTerminate(osThreadGetId()) == osOK);
+}
+
+/** Parse files until all files are taken */
+static void load_files(items_loader_t *loader)
+{
+   while (parse_next(loader) == 0);
+}
+
+/** Parse next not taken file and signal it is parsed, returns -1 when all files are taken */
+static int parse_next(items_loader_t *loader)
+{
+   int ix;
+
+   if ((ix = __atomic_fetch_add(&loader->next, 1, __ATOMIC_RELAXED)) >= loader->count)
+      return -1;
+
+   loader->files[ix].res = parse_file(&loader->files[ix]);
+   __atomic_store_n(&loader->files[ix].done, 1, __ATOMIC_RELEASE);
+   osSemaphoreRelease(loader->sem);
+
+   return 0;
+}
+
+/** Parse items file to the staging list, repository is not accessed */
+static int parse_file(staged_file_t *file)
+{
+   int res;
+   uhab_config_xml_t *xml;
+   staged_item_t *st;
+   const uhab_item_xml_element_t *elem;
+
+   TRACE("Items cfg: %s open", file->path);
+
+   file->tail = &file->items;
+
+   if ((xml = uhab_config_xml_open(file->path)) == NULL)
+   {
+      TRACE_ERROR("Load items xml failed");
+      throw_exception(fail_open);
+   }
+
+   while ((res = uhab_config_xml_next(xml)) != UHAB_CONFIG_XML_EOF)
+   {
+      if (res < 0)
+         throw_exception(fail_parse);
+
+      if (res != UHAB_CONFIG_XML_START)
+         continue;
+
+      if (uhab_config_xml_depth(xml) == 1)
       {
-         if (strcmp(roxml_get_name(node, NULL, 0), elem->name) != 0)
-            continue;
-         
-         if ((item = uhab_item_alloc(elem->type)) == NULL)
+         if (strcmp(uhab_config_xml_name(xml), "items") != 0)
          {
-            TRACE_ERROR("Alloc item: %s", elem->name);
+            TRACE_ERROR("Items not found");
             throw_exception(fail_parse);
          }
-         item->state.type = elem->state_type;
-         
-         // Get stereotype
-         if ((value = roxml_get_attr_value(node, "stereotype")) != NULL)
-         {
-            if (!strcasecmp(value, "list"))
-               item->stereotype = UHAB_ITEM_STEREOTYPE_LIST;
-            else
-            {
-               TRACE_ERROR("Item: %s has defined not supported stereotype: %s", item->name, value);
-               throw_exception(fail_parse);
-            }
-         }
-            
-         // Get name
-         if ((value = roxml_get_attr_value(node, "name")) == NULL)
+         continue;
+      }
+
+      if (uhab_config_xml_depth(xml) != 2)
+         continue;
+
+      for (elem = &uhab_item_elements[0]; elem->name != NULL; elem++)
+      {
+         if (!strcmp(uhab_config_xml_name(xml), elem->name))
+            break;
+      }
+
+      // Not defined elements are skipped
+      if (elem->name == NULL)
+         continue;
+
+      // Items are created from the attributes copy in the merge
+      if ((st = uhab_arena_alloc(&file->arena, sizeof(staged_item_t) + uhab_config_xml_attrs_len(xml))) == NULL)
+      {
+         TRACE_ERROR("Alloc staged item: %s", elem->name);
+         throw_exception(fail_parse);
+      }
+      st->elem = elem;
+      st->attrslen = uhab_config_xml_attrs_len(xml);
+      memcpy(st->attrs, uhab_config_xml_attrs(xml), st->attrslen);
+
+      *file->tail = st;
+      file->tail = &st->next;
+   }
+
+   uhab_config_xml_close(xml);
+
+   TRACE("Parse done");
+
+   return 0;
+
+fail_parse:
+   uhab_config_xml_close(xml);
+fail_open:
+   return -1;
+}
+
+/** Create items of the staged file in the document order, items of the failed file are removed from the repository */
+static int merge_file(staged_file_t *file, uhab_repository_t *repo, group_refs_t *refs)
+{
+   int count = 0;
+   staged_item_t *st;
+   uhab_item_t *item;
+   group_ref_t *pg, **tail = refs->tail;
+
+   for (st = file->items; st != NULL; st = st->next, count++)
+   {
+      if (create_item(repo, st, refs) != 0)
+         throw_exception(fail_create);
+   }
+
+   return 0;
+
+fail_create:
+   // Repository keeps only the complete files (UI provider runs on it in the fail mode)
+   while ((pg = *tail) != NULL)
+   {
+      *tail = pg->next;
+      os_free(pg);
+   }
+   refs->tail = tail;
+
+   for (st = file->items; count > 0; st = st->next, count--)
+   {
+      item = uhab_repository_get_item(repo, uhab_config_xml_attrs_find(st->attrs, st->attrslen, "name"));
+      uhab_repository_remove_item(repo, item);
+      uhab_item_free(item);
+   }
+
+   return -1;
+}
+
+/** Create item of the staged element */
+static int create_item(uhab_repository_t *repo, staged_item_t *st, group_refs_t *refs)
+{
+   uhab_item_t *item = NULL;
+   group_ref_t *pg;
+   const uhab_item_xml_element_t *elem = st->elem;
+   const char *value;
+
+   if ((item = uhab_item_alloc(elem->type)) == NULL)
+   {
+      TRACE_ERROR("Alloc item: %s", elem->name);
+      throw_exception(fail_parse);
+   }
+   item->state.type = elem->state_type;
+
+   // Get name, it is used by the following error traces
+   if ((value = uhab_config_xml_attrs_find(st->attrs, st->attrslen, "name")) == NULL)
+   {
+      TRACE_ERROR("Expected item: %s name", elem->name);
+      throw_exception(fail_parse);
+   }
+   if ((item->name = uhab_arena_strdup(&repo->arena, value)) == NULL)
+      throw_exception(fail_parse);
+
+   // Get stereotype
+   if ((value = uhab_config_xml_attrs_find(st->attrs, st->attrslen, "stereotype")) != NULL)
+   {
+      if (!strcasecmp(value, "list"))
+         item->stereotype = UHAB_ITEM_STEREOTYPE_LIST;
+      else
+      {
+         TRACE_ERROR("Item: %s has defined not supported stereotype: %s", item->name, value);
+         throw_exception(fail_parse);
+      }
+   }
+
+   // Get group aggregate function
+   if (item->type == UHAB_ITEM_TYPE_GROUP && (value = uhab_config_xml_attrs_find(st->attrs, st->attrslen, "aggregate")) != NULL)
+   {
+      int func;
+
+      if ((func = uhab_group_get_aggregate_func(value)) < 0 || item->stereotype == UHAB_ITEM_STEREOTYPE_LIST)
+      {
+         TRACE_ERROR("Group: %s has defined not supported aggregate: %s", item->name, value);
+         throw_exception(fail_parse);
+      }
+
+      if (uhab_group_set_aggregate(item, func) != 0)
+         throw_exception(fail_parse);
+   }
+
+   // Get label
+   if ((value = uhab_config_xml_attrs_find(st->attrs, st->attrslen, "label")) != NULL)
+   {
+      if ((uhab_item_get_meta(item)->label = uhab_arena_strdup(&repo->arena, value)) == NULL)
+         throw_exception(fail_parse);
+   }
+
+   // Get TAG
+   if ((value = uhab_config_xml_attrs_find(st->attrs, st->attrslen, "tag")) != NULL)
+   {
+      if ((uhab_item_get_meta(item)->tag = uhab_arena_strdup(&repo->arena, value)) == NULL)
+         throw_exception(fail_parse);
+   }
+
+   // Get persistence
+   if ((value = uhab_config_xml_attrs_find(st->attrs, st->attrslen, "persist")) != NULL)
+      item->persist = (!strcasecmp(value, "true") || atoi(value) != 0);
+
+   // Get history
+   if ((value = uhab_config_xml_attrs_find(st->attrs, st->attrslen, "history")) != NULL)
+      item->history = (!strcasecmp(value, "true") || atoi(value) != 0);
+
+   // Get binding
+   if ((value = uhab_config_xml_attrs_find(st->attrs, st->attrslen, "binding")) != NULL)
+   {
+      if ((uhab_item_get_meta(item)->binding_config = uhab_arena_strdup(&repo->arena, value)) == NULL)
+         throw_exception(fail_parse);
+   }
+
+   // State || value
+   if ((value = uhab_config_xml_attrs_find(st->attrs, st->attrslen, "state")) != NULL ||
+       (value = uhab_config_xml_attrs_find(st->attrs, st->attrslen, "value")))
+   {
+      if (uhab_item_state_set_value(&item->state, value) != 0)
+      {
+         TRACE_ERROR("Set item: %s state/value failed", item->name);
+         throw_exception(fail_parse);
+      }
+   }
+
+   // Get group
+   if ((value = uhab_config_xml_attrs_find(st->attrs, st->attrslen, "group")) != NULL)
+   {
+      int argc, ix;
+      char *argv[CFG_MAXNUM_ITEMS_GROUPS];
+
+      // Groups are resolved when all files are merged
+      argc = split_line((char *)value, ',', argv, CFG_MAXNUM_ITEMS_GROUPS);
+      for (ix = 0; ix < argc; ix++)
+      {
+         str_remove(argv[ix], ' ');
+
+         if ((pg = os_malloc(sizeof(group_ref_t) + strlen(argv[ix]) + 1)) == NULL)
          {
-            TRACE_ERROR("Expected item: %s name", elem->name);
+            TRACE_ERROR("Alloc group: %s reference", argv[ix]);
             throw_exception(fail_parse);
          }
-         if ((item->name = os_strdup(value)) == NULL)
-            throw_exception(fail_parse);
+         pg->next = NULL;
+         pg->item = item;
+         strcpy(pg->name, argv[ix]);
 
-         // Get label
-         if ((value = roxml_get_attr_value(node, "label")) != NULL)
-         {
-            if ((item->label = os_strdup(value)) == NULL)
-               throw_exception(fail_parse);
-         }
-         
-         // Get TAG
-         if ((value = roxml_get_attr_value(node, "tag")) != NULL)
-         {
-            if ((item->tag = os_strdup(value)) == NULL)
-               throw_exception(fail_parse);
-         }
+         *refs->tail = pg;
+         refs->tail = &pg->next;
+      }
+   }
 
-         // Get binding
-         if ((value = roxml_get_attr_value(node, "binding")) != NULL)
-         {
-            if ((item->binding.config = os_strdup(value)) == NULL)
-               throw_exception(fail_parse);
-         }
+   TRACE("   Item: '%s'  '%s'  '%s'", item->name, elem->name, uhab_item_get_meta(item)->binding_config);
 
-         // State || value
-         if ((value = roxml_get_attr_value(node, "state")) != NULL ||
-             (value = roxml_get_attr_value(node, "value")))
-         {
-            if (uhab_item_state_set_value(&item->state, value) != 0)
-            {
-               TRACE_ERROR("Set item: %s state/value failed", item->name);
-               throw_exception(fail_parse);
-            }
-         }
+   // Add to repository
+   if (uhab_repository_add_item(repo, item) != 0)
+   {
+      TRACE_ERROR("Add item: %s to repository", item->name);
+      throw_exception(fail_parse);
+   }
 
-         // Get group
-         if ((value = roxml_get_attr_value(node, "group")) != NULL)
-         {
-            int argc, ix;
-            char *argv[CFG_MAXNUM_ITEMS_GROUPS];
-            uhab_item_t *grp = NULL;
-           
-            // Add item to defined groups
-            argc = split_line((char *)value, ',', argv, CFG_MAXNUM_ITEMS_GROUPS);
-            if (argc > 0)
-            {
-               for (ix = 0; ix < argc; ix++)
-               {
-                  str_remove(argv[ix], ' ');
-
-                  // Get group by name
-                  grp = uhab_repository_get_item(repo, argv[ix]);
-                  if (grp == NULL)
-                  {
-                     TRACE_ERROR("Group: %s of item: %s not defined", argv[ix], item->name);
-                     throw_exception(fail_parse);
-                  }
-                  
-                  // Test group type
-                  if (grp->type != UHAB_ITEM_TYPE_GROUP)
-                  {
-                     TRACE_ERROR("Item '%s' specified as group is not group type", grp->name);
-                     throw_exception(fail_parse);
-                  }
-                  
-                  // Add item to group
-                  if (uhab_repository_add_child_item(grp, item) == NULL)
-                  {
-                     TRACE_ERROR("Add item: %s to group: %s", item->name, grp->name);
-                     throw_exception(fail_parse);
-                  }
-               }
-               
-               if (grp != NULL)
-               {
-                  // Set active child item if exists
-                  grp->active_child_item = list_head(grp->child_items);
-               }
-            }
-         }            
-         
-         TRACE("   Item: '%s'  '%s'  '%s'", item->name, elem->name, item->binding.config);     
-      
-         // Add to repository
-         if (uhab_repository_add_item(repo, item) != 0)
+   return 0;
+
+fail_parse:
+   // Group references of the item are dropped by the file rollback
+   if (item != NULL)
+      uhab_item_free(item);
+   return -1;
+}
+
+/** Add items to the referenced groups */
+static int resolve_groups(uhab_repository_t *repo, group_refs_t *refs)
+{
+   uhab_item_t *grp;
+   group_ref_t *pg;
+
+   for (pg = refs->head; pg != NULL; pg = pg->next)
+   {
+      if ((grp = uhab_repository_get_item(repo, pg->name)) == NULL)
+      {
+         TRACE_ERROR("Group: %s of item: %s not defined", pg->name, pg->item->name);
+         return -1;
+      }
+
+      if (add_to_group(grp, pg->item) != 0)
+         return -1;
+   }
+
+   return 0;
+}
+
+/** Add item to the group */
+static int add_to_group(uhab_item_t *grp, uhab_item_t *item)
+{
+   // Test group type
+   if (grp->type != UHAB_ITEM_TYPE_GROUP)
+   {
+      TRACE_ERROR("Item '%s' specified as group is not group type", grp->name);
+      return -1;
+   }
+
+   // Add item to group
+   if (uhab_repository_add_child_item(grp, item) != 0)
+   {
+      TRACE_ERROR("Add item: %s to group: %s", item->name, grp->name);
+      return -1;
+   }
+
+   // Set active child item
+   grp->active_child = 0;
+
+   return 0;
+}
+
+/** Free group references */
+static void free_refs(group_refs_t *refs)
+{
+   group_ref_t *pg;
+
+   while ((pg = refs->head) != NULL)
+   {
+      refs->head = pg->next;
+      os_free(pg);
+   }
+   refs->tail = &refs->head;
+}
+
+/** List items files sorted by name */
+static int list_files(const char *dirname, items_loader_t *loader)
+{
+   DIR *d;
+   struct dirent *dir;
+   staged_file_t *file;
+   int count = 0;
+   char txt[512];
+
+   if ((d = opendir(dirname)) == NULL)
+   {
+      TRACE_ERROR("Can't open dir %s", dirname);
+      throw_exception(fail_opendir);
+   }
+
+   while ((dir = readdir(d)) != NULL)
+   {
+      if (strstr(dir->d_name, ".items") != NULL)
+         count++;
+   }
+
+   if (count > 0 && (loader->files = os_malloc(count * sizeof(staged_file_t))) == NULL)
+   {
+      TRACE_ERROR("Alloc items files");
+      throw_exception(fail_alloc);
+   }
+
+   rewinddir(d);
+   while ((dir = readdir(d)) != NULL && loader->count < count)
+   {
+      if (strstr(dir->d_name, ".items") != NULL)
+      {
+         file = &loader->files[loader->count];
+         os_memset(file, 0, sizeof(staged_file_t));
+         uhab_arena_init(&file->arena, "items staging");
+
+         snprintf(txt, sizeof(txt), "%s/%s", dirname, dir->d_name);
+         if ((file->path = os_strdup(txt)) == NULL)
          {
-            TRACE_ERROR("Add item: %s to repository", item->name);
-            throw_exception(fail_parse);
+            TRACE_ERROR("Alloc items file %s", txt);
+            throw_exception(fail_alloc);
          }
-         
-         
-         
+
+         loader->count++;
       }
    }
 
-	roxml_release(RELEASE_ALL);
-	roxml_close(doc);
-	close(fd);
-   
-   TRACE("Parse done");
+   closedir(d);
+
+   // Items IDs don't depend on the directory order
+   if (loader->count > 0)
+      qsort(loader->files, loader->count, sizeof(staged_file_t), compare_files);
 
    return 0;
 
-fail_parse:
-	roxml_release(RELEASE_ALL);
-	roxml_close(doc);
-fail_load:	
-	close(fd);
-fail_open:   
+fail_alloc:
+   closedir(d);
+   free_files(loader);
+fail_opendir:
    return -1;
 }
+
+/** Free items files and their staged items */
+static void free_files(items_loader_t *loader)
+{
+   int ix;
+
+   for (ix = 0; ix < loader->count; ix++)
+   {
+      uhab_arena_free(&loader->files[ix].arena);
+      os_free(loader->files[ix].path);
+   }
+
+   if (loader->files != NULL)
+      os_free(loader->files);
+
+   loader->files = NULL;
+   loader->count = 0;
+}
+
+static int compare_files(const void *a, const void *b)
+{
+   return strcmp(((const staged_file_t *)a)->path, ((const staged_file_t *)b)->path);
+}
@@ -3,7 +3,7 @@
  */
 
 #include "uhab.h"
-#include "roxml.h"
+#include "config_xml.h"
 
 TRACE_TAG(cfg_rules);
 #if !ENABLE_TRACE_CONFIG
@@ -13,236 +13,296 @@ TRACE_TAG(cfg_rules);
 
 // Prototypes:
 static void encode_script_string(char *str);
-static int parse_script(uhab_automation_t *au, node_t *script_node);
+static uhab_rule_t *parse_rule(uhab_config_xml_t *xml, uhab_arena_t *arena, uhab_item_t *item);
+static uhab_rule_action_t *parse_action(uhab_config_xml_t *xml, uhab_arena_t *arena, uhab_rule_t *rule);
+static int parse_script(uhab_automation_t *au, uhab_config_xml_t *xml, uhab_automation_script_t **pscript);
 
 
 /** Load rules configuration */
 int uhab_config_rules_load(const char *path, uhab_automation_t *au)
 {
-   int fd;
-   node_t *doc_node, *root_node, *node, *rule_node, *action_node;
-   uhab_item_t *item;
-   uhab_rule_t *rule;
-   uhab_rule_action_t *action;
+   int res;
+   uhab_config_xml_t *xml;
+   uhab_item_t *item = NULL;
+   uhab_rule_t *rule = NULL;
+   uhab_rule_action_t *action = NULL;
+   uhab_automation_script_t *script = NULL;
    char *value;
 
-   // Open config file
-   if ((fd = open(path, O_RDONLY)) < 0)
-   {
-      TRACE_ERROR("Can't open items cfg file %s", path);
-      throw_exception(fail_open);
-   }
    TRACE("Open rules cfg: %s", path);
 
-   if ((doc_node = roxml_load_fd(fd)) == NULL)
+   if ((xml = uhab_config_xml_open(path)) == NULL)
    {
       TRACE_ERROR("Load rules xml failed");
-      throw_exception(fail_load);
+      throw_exception(fail_open);
    }
 
-   if ((root_node = roxml_get_chld(doc_node, "rules", 0)) == NULL)
+   // Level 1: rules, 2: script or item, 3: rule, 4: action
+   while ((res = uhab_config_xml_next(xml)) != UHAB_CONFIG_XML_EOF)
    {
-      TRACE_ERROR("Rules not found");
-      throw_exception(fail_parse);
-   }
+      if (res < 0)
+         throw_exception(fail_parse);
 
-   for (node = roxml_get_chld(root_node, NULL, 0); node != NULL; node = roxml_get_next_sibling(node))
-   {
-      if (!strcasecmp(roxml_get_name(node, NULL, 0), "script"))
-      {
-         if (parse_script(au, node) != 0)
-         {
-            TRACE_ERROR("Parse script failed");
-            throw_exception(fail_parse);
-         }
-      }
-      else
+      if (res == UHAB_CONFIG_XML_START)
       {
-
-         if ((item = uhab_repository_get_item(&repository, roxml_get_name(node, NULL, 0))) == NULL)
+         switch(uhab_config_xml_depth(xml))
          {
-            TRACE_ERROR("Item '%s' not defined", roxml_get_name(node, NULL, 0));
-            throw_exception(fail_parse);
-         }
-
-         TRACE("Item: %s", item->name);
-
-         // Rules
-         for (rule_node = roxml_get_chld(node, "rule", 0); rule_node != NULL; rule_node = roxml_get_next_sibling(rule_node))
-         {
-            if ((rule = uhab_rule_alloc()) == NULL)
-            {
-               TRACE_ERROR("Alloc rule");
-               throw_exception(fail_parse);
-            }
-
-            // Rule name
-            if ((value = roxml_get_attr_value(rule_node, "name")) != NULL)
-            {
-               if ((rule->name = os_strdup(value)) == NULL)
-                  throw_exception(fail_parse);
-            }
-
-            // Rule event
-            if ((value = roxml_get_attr_value(rule_node, "event")) == NULL)
-            {
-               TRACE_ERROR("Undefined rule '%s' event", rule->name);
-               throw_exception(fail_parse);
-            }
-            if ((rule->evtdef = uhab_rule_get_definition(value)) == NULL)
-            {
-               TRACE_ERROR("Not supported rule '%s' event: %s", rule->name, value);
-               throw_exception(fail_parse);
-            }
-            rule->event = rule->evtdef->type;
-            TRACE("   Rule: %s  Event: %s", rule->name, rule->evtdef->name);
-
-            // Add to rules list
-            if (uhab_item_add_rule(item, rule) != 0)
-            {
-               TRACE_ERROR("Add rule to item: %s", item->name);
-               throw_exception(fail_parse);
-            }
-
-            // Actions
-            for (action_node = roxml_get_chld(rule_node, "action", 0); action_node != NULL; action_node = roxml_get_next_sibling(action_node))
-            {
-               if ((action = uhab_rule_action_alloc()) == NULL)
+            case 1:
+               if (strcmp(uhab_config_xml_name(xml), "rules") != 0)
                {
-                  TRACE_ERROR("Alloc action");
+                  TRACE_ERROR("Rules not found");
                   throw_exception(fail_parse);
                }
+               break;
 
-               // Action type
-               if ((value = roxml_get_attr_value(action_node, "type")) != NULL)
+            case 2:
+               if (!strcasecmp(uhab_config_xml_name(xml), "script"))
                {
-                  if ((action->actdef = uhab_rule_action_get_definition(value)) == NULL)
+                  item = NULL;
+                  if (parse_script(au, xml, &script) != 0)
                   {
-                     TRACE_ERROR("Not supported action type: %s", roxml_get_attr_value(action_node, "type"));
+                     TRACE_ERROR("Parse script failed");
                      throw_exception(fail_parse);
                   }
-                  action->type = action->actdef->type;
                }
                else
                {
-                  TRACE_ERROR("Not defined action type of rule: %s", rule->name);
-                  throw_exception(fail_parse);
-               }
-
-               // Action condition
-               if ((value = roxml_get_attr_value(action_node, "condition")) != NULL)
-               {
-                  if ((action->condition = os_strdup(value)) == NULL)
+                  if ((item = uhab_repository_get_item(&repository, uhab_config_xml_name(xml))) == NULL)
+                  {
+                     TRACE_ERROR("Item '%s' not defined", uhab_config_xml_name(xml));
                      throw_exception(fail_parse);
+                  }
+
+                  TRACE("Item: %s", item->name);
                }
+               break;
 
-               switch(action->type)
-               {
-                  case UHAB_ACTION_EXEC_JSCRIPT:
-                  {
-                     if ((value = roxml_get_content(action_node, NULL, 0, NULL)) != NULL)
-                     {
-                        // Replace tab and remove spaces
-                        encode_script_string(value);
-
-                        if ((action->param = os_strdup(value)) == NULL)
-                           throw_exception(fail_parse);
-                     }
-                     else
-                     {
-                        TRACE_ERROR("Not defined action javascript body of rule: %s", rule->name);
-                        throw_exception(fail_parse);
-                     }
-                  }
-                  break;
+            case 3:
+               if (item != NULL && (rule = parse_rule(xml, &au->arena, item)) == NULL)
+                  throw_exception(fail_parse);
+               break;
 
-                  case UHAB_ACTION_SEND_COMMAND:
-                  {
-                     // Action item
-                     if ((value = roxml_get_attr_value(action_node, "item")) != NULL)
-                     {
-                        if ((action->item = uhab_repository_get_item(&repository, value)) == NULL)
-                        {
-                           TRACE_ERROR("Undefined action item: %s of rule: %s", value, rule->name);
-                           throw_exception(fail_parse);
-                        }
-                     }
-                     else
-                     {
-                        TRACE_ERROR("Not defined action item of rule: %s", rule->name);
-                        throw_exception(fail_parse);
-                     }
-
-                     // Action param
-                     if ((value = roxml_get_attr_value(action_node, "param")) != NULL)
-                     {
-                        if ((action->param = os_strdup(value)) == NULL)
-                           throw_exception(fail_parse);
-                     }
-                     else
-                     {
-                        TRACE_ERROR("Not defined action param of rule: %s", rule->name);
-                        throw_exception(fail_parse);
-                     }
-
-                     TRACE("      '%s'  '%s'  '%s'", action->actdef->name, action->item->name, action->param);
-                  }
-                  break;
+            case 4:
+               if (rule != NULL && (action = parse_action(xml, &au->arena, rule)) == NULL)
+                  throw_exception(fail_parse);
+               break;
+         }
+      }
+      else if (uhab_config_xml_depth(xml) == 2)
+      {
+         // Inline script body
+         if (script != NULL)
+         {
+            if ((value = uhab_config_xml_content(xml)) != NULL)
+            {
+               // Replace tab and remove spaces
+               encode_script_string(value);
 
-                  case UHAB_ACTION_DELAY:
-                  {
-                     // Action param
-                     if ((value = roxml_get_attr_value(action_node, "param")) != NULL)
-                     {
-                        if ((action->param = os_strdup(value)) == NULL)
-                           throw_exception(fail_parse);
-                     }
-                     else
-                     {
-                        TRACE_ERROR("Not defined action param of rule: %s", rule->name);
-                        throw_exception(fail_parse);
-                     }
-
-                     TRACE("      '%s'   '%s'", action->actdef->name, action->param);
-                  }
-                  break;
-               }
+               if ((script->body = os_strdup(value)) == NULL)
+                  throw_exception(fail_parse);
+
+               list_add(au->scripts, script);
+            }
+            else
+            {
+               os_free(script);
+            }
+            script = NULL;
+         }
+         item = NULL;
+      }
+      else if (uhab_config_xml_depth(xml) == 3)
+      {
+         rule = NULL;
+      }
+      else if (uhab_config_xml_depth(xml) == 4 && action != NULL)
+      {
+         if (action->type == UHAB_ACTION_EXEC_JSCRIPT)
+         {
+            if ((value = uhab_config_xml_content(xml)) != NULL)
+            {
+               // Replace tab and remove spaces
+               encode_script_string(value);
 
-               // Add to actions list
-               list_add(rule->actions, action);
+               if ((action->param = uhab_arena_strdup(&au->arena, value)) == NULL)
+                  throw_exception(fail_parse);
+            }
+            else
+            {
+               TRACE_ERROR("Not defined action javascript body of rule: %s", rule->name);
+               throw_exception(fail_parse);
             }
          }
+
+         // Add to actions list
+         list_add(rule->actions, action);
+         action = NULL;
       }
    }
 
-   roxml_release(RELEASE_ALL);
-   roxml_close(doc_node);
-   close(fd);
+   uhab_config_xml_close(xml);
 
    return 0;
 
 fail_parse:
-   roxml_release(RELEASE_ALL);
-   roxml_close(doc_node);
-fail_load:
-   close(fd);
+   // Rules and actions are allocated in the automation arena, they are released by the automation init failure
+   if (script != NULL)
+      os_free(script);
+   uhab_config_xml_close(xml);
 fail_open:
    return -1;
 }
 
+/** Create rule of the started element and add it to the item */
+static uhab_rule_t *parse_rule(uhab_config_xml_t *xml, uhab_arena_t *arena, uhab_item_t *item)
+{
+   uhab_rule_t *rule;
+   char *value;
+
+   if ((rule = uhab_rule_alloc(arena)) == NULL)
+   {
+      TRACE_ERROR("Alloc rule");
+      return NULL;
+   }
+
+   // Rule name
+   if ((value = uhab_config_xml_attr(xml, "name")) != NULL)
+   {
+      if ((rule->name = uhab_arena_strdup(arena, value)) == NULL)
+         return NULL;
+   }
+
+   // Rule event
+   if ((value = uhab_config_xml_attr(xml, "event")) == NULL)
+   {
+      TRACE_ERROR("Undefined rule '%s' event", rule->name);
+      return NULL;
+   }
+   if ((rule->evtdef = uhab_rule_get_definition(value)) == NULL)
+   {
+      TRACE_ERROR("Not supported rule '%s' event: %s", rule->name, value);
+      return NULL;
+   }
+   rule->event = rule->evtdef->type;
+   TRACE("   Rule: %s  Event: %s", rule->name, rule->evtdef->name);
+
+   // Add to rules list
+   if (uhab_item_add_rule(item, rule) != 0)
+   {
+      TRACE_ERROR("Add rule to item: %s", item->name);
+      return NULL;
+   }
+
+   return rule;
+}
+
+/** Create action of the started element, javascript action body is captured until the element end */
+static uhab_rule_action_t *parse_action(uhab_config_xml_t *xml, uhab_arena_t *arena, uhab_rule_t *rule)
+{
+   uhab_rule_action_t *action;
+   char *value;
+
+   if ((action = uhab_rule_action_alloc(arena)) == NULL)
+   {
+      TRACE_ERROR("Alloc action");
+      return NULL;
+   }
+
+   // Action type
+   if ((value = uhab_config_xml_attr(xml, "type")) != NULL)
+   {
+      if ((action->actdef = uhab_rule_action_get_definition(value)) == NULL)
+      {
+         TRACE_ERROR("Not supported action type: %s", value);
+         return NULL;
+      }
+      action->type = action->actdef->type;
+   }
+   else
+   {
+      TRACE_ERROR("Not defined action type of rule: %s", rule->name);
+      return NULL;
+   }
+
+   // Action condition
+   if ((value = uhab_config_xml_attr(xml, "condition")) != NULL)
+   {
+      if ((action->condition = uhab_arena_strdup(arena, value)) == NULL)
+         return NULL;
+   }
+
+   switch(action->type)
+   {
+      case UHAB_ACTION_EXEC_JSCRIPT:
+      {
+         uhab_config_xml_capture(xml);
+      }
+      break;
+
+      case UHAB_ACTION_SEND_COMMAND:
+      {
+         // Action item
+         if ((value = uhab_config_xml_attr(xml, "item")) != NULL)
+         {
+            if ((action->item = uhab_repository_get_item(&repository, value)) == NULL)
+            {
+               TRACE_ERROR("Undefined action item: %s of rule: %s", value, rule->name);
+               return NULL;
+            }
+         }
+         else
+         {
+            TRACE_ERROR("Not defined action item of rule: %s", rule->name);
+            return NULL;
+         }
+
+         // Action param
+         if ((value = uhab_config_xml_attr(xml, "param")) != NULL)
+         {
+            if ((action->param = uhab_arena_strdup(arena, value)) == NULL)
+               return NULL;
+         }
+         else
+         {
+            TRACE_ERROR("Not defined action param of rule: %s", rule->name);
+            return NULL;
+         }
+
+         TRACE("      '%s'  '%s'  '%s'", action->actdef->name, action->item->name, action->param);
+      }
+      break;
+
+      case UHAB_ACTION_DELAY:
+      {
+         // Action param
+         if ((value = uhab_config_xml_attr(xml, "param")) != NULL)
+         {
+            if ((action->param = uhab_arena_strdup(arena, value)) == NULL)
+               return NULL;
+         }
+         else
+         {
+            TRACE_ERROR("Not defined action param of rule: %s", rule->name);
+            return NULL;
+         }
+
+         TRACE("      '%s'   '%s'", action->actdef->name, action->param);
+      }
+      break;
+   }
+
+   return action;
+}
+
 
 static void encode_script_string(char *str)
 {
+   // Entities are decoded by the xml parser
    str_replace(str, '\t', ' ');
-   str_replace_str(str, "&lt;", "<");
-   str_replace_str(str, "&gt;", "<");
-   str_replace_str(str, "&amp;", "&");
-   str_replace_str(str, "&quot;", "\"");
-   str_replace_str(str, "&apos;", "'");
 }
 
 
-static int parse_script(uhab_automation_t *au, node_t *script_node)
+static int parse_script(uhab_automation_t *au, uhab_config_xml_t *xml, uhab_automation_script_t **pscript)
 {
    int fd = -1;
    struct stat st;
@@ -255,8 +315,9 @@ static int parse_script(uhab_automation_t *au, node_t *script_node)
       TRACE_ERROR("Alloc script");
       throw_exception(fail);
    }
+   os_memset(script, 0, sizeof(uhab_automation_script_t));
 
-   if ((value = roxml_get_attr_value(script_node, "src")) != NULL)
+   if ((value = uhab_config_xml_attr(xml, "src")) != NULL)
    {
       // Include from file
 
@@ -292,21 +353,19 @@ static int parse_script(uhab_automation_t *au, node_t *script_node)
 
          TRACE("Include script %s  size: %d", path, st.st_size);
       }
+      else
+      {
+         // Empty script is not added
+         os_free(script);
+      }
 
       close(fd);
    }
    else
    {
-      if ((value = roxml_get_content(script_node, NULL, 0, NULL)) != NULL)
-      {
-         // Replace tab and remove spaces
-         encode_script_string(value);
-
-         if ((script->body = os_strdup(value)) == NULL)
-            throw_exception(fail);
-
-         list_add(au->scripts, script);
-      }
+      // Inline body is taken at the element end
+      uhab_config_xml_capture(xml);
+      *pscript = script;
    }
 
    return 0;
@@ -316,6 +375,10 @@ fail:
       close(fd);
 
    if (script != NULL)
+   {
+      if (script->body != NULL)
+         os_free(script->body);
       os_free(script);
+   }
    return -1;
 }
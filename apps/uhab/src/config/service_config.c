@@ -1,8 +1,13 @@
 /**
  * \file service_config.c        \brief Services configuration
+ *
+ * Service config file is parsed once on the first access into the hashed key/value table,
+ * keys are matched exactly (case insensitive). Reloaded config notifies subscribers about
+ * each changed key.
  */
- 
+
 #include "uhab.h"
+#include <ctype.h>
 
 TRACE_TAG(cfg_service);
 #if !ENABLE_TRACE_CONFIG
@@ -10,44 +15,449 @@ TRACE_TAG(cfg_service);
 #endif
 
 
+/** Service config key/value entry */
+typedef struct
+{
+   char *key;
+   char *value;
+
+} service_entry_t;
+
+
+/** Parsed service config */
+typedef struct service_config
+{
+   struct service_config *next;
+   char *name;
+
+   /** Hashed entries (open addressing, linear probing), size is power of 2 */
+   service_entry_t *entries;
+   uint32_t size;
+   int count;
+
+} service_config_t;
+
+
+/** Service config change subscriber */
+typedef struct service_subscriber
+{
+   struct service_subscriber *next;
+   char *service;
+   uhab_config_service_cb_t cb;
+   void *arg;
+
+} service_subscriber_t;
+
+
+// Prototypes:
+static service_config_t *get_service(const char *service);
+static int parse_file(const char *service, service_config_t *cfg);
+static int entries_put(service_config_t *cfg, const char *key, const char *value);
+static service_entry_t *entries_find(const service_config_t *cfg, const char *key);
+static void entries_free(service_entry_t *entries, uint32_t size);
+static void notify_changes(const char *service, const service_config_t *oldcfg, const service_config_t *newcfg);
+static uint32_t key_hash(const char *key);
+
+// Locals:
+LIST(services);
+LIST(subscribers);
+static osMutexId config_mutex = NULL;
+static osMutexId reload_mutex = NULL;
+
+
+/** Initialize services config store */
+int uhab_config_service_init(void)
+{
+   list_init(services);
+   list_init(subscribers);
+
+   if ((config_mutex = osMutexCreate(NULL)) == NULL)
+      throw_exception(fail_mutex);
+
+   if ((reload_mutex = osMutexCreate(NULL)) == NULL)
+      throw_exception(fail_reload_mutex);
+
+   return 0;
+
+fail_reload_mutex:
+   osMutexDelete(config_mutex);
+   config_mutex = NULL;
+fail_mutex:
+   TRACE_ERROR("Create config mutex");
+   return -1;
+}
+
+/** Free all parsed services config */
+int uhab_config_service_deinit(void)
+{
+   service_config_t *cfg;
+
+   if (config_mutex == NULL)
+      return 0;
+
+   VERIFY(osMutexWait(config_mutex, osWaitForever) == osOK);
+
+   while ((cfg = list_pop(services)) != NULL)
+   {
+      entries_free(cfg->entries, cfg->size);
+      os_free(cfg->name);
+      os_free(cfg);
+   }
+
+   VERIFY(osMutexRelease(config_mutex) == osOK);
+
+   return 0;
+}
+
 /** Get binding config key/value */
 int uhab_config_service_get_value(const char *service, const char *key, char *buf, int bufsize)
 {
-   int fd, keylen;
-   char *pp;
+   int res = -1;
+   service_config_t *cfg;
+   service_entry_t *entry;
+
+   VERIFY(osMutexWait(config_mutex, osWaitForever) == osOK);
+
+   if ((cfg = get_service(service)) != NULL && (entry = entries_find(cfg, key)) != NULL)
+   {
+      strlcpy(buf, entry->value, bufsize);
+      res = 0;
+   }
+
+   VERIFY(osMutexRelease(config_mutex) == osOK);
+
+   return res;
+}
+
+/** Get service config integer value, default value is returned when key is not defined */
+int uhab_config_service_get_int(const char *service, const char *key, int defvalue)
+{
+   char value[32];
+
+   return (uhab_config_service_get_value(service, key, value, sizeof(value)) == 0) ? atoi(value) : defvalue;
+}
+
+/** Get service config bool value (1|0|true|false|yes|no|on|off), default value is returned when key is not defined */
+int uhab_config_service_get_bool(const char *service, const char *key, int defvalue)
+{
+   char value[32];
+
+   if (uhab_config_service_get_value(service, key, value, sizeof(value)) != 0)
+      return defvalue;
+
+   if (!strcasecmp(value, "true") || !strcasecmp(value, "yes") || !strcasecmp(value, "on"))
+      return 1;
+
+   if (!strcasecmp(value, "false") || !strcasecmp(value, "no") || !strcasecmp(value, "off"))
+      return 0;
+
+   return atoi(value) != 0;
+}
+
+/** Get service config comma separated list, items are split in the buffer, returns number of items or -1 */
+int uhab_config_service_get_list(const char *service, const char *key, char *buf, int bufsize, char **argv, int maxargs)
+{
+   if (uhab_config_service_get_value(service, key, buf, bufsize) != 0)
+      return -1;
+
+   return split_line(buf, ',', argv, maxargs);
+}
+
+/** Reload service config file, subscribers are notified about changed keys */
+int uhab_config_service_reload(const char *service)
+{
+   service_config_t *cfg;
+   service_config_t newcfg, oldcfg;
+
+   os_memset(&newcfg, 0, sizeof(newcfg));
+
+   VERIFY(osMutexWait(reload_mutex, osWaitForever) == osOK);
+
+   if (parse_file(service, &newcfg) != 0)
+   {
+      entries_free(newcfg.entries, newcfg.size);
+      throw_exception(fail);
+   }
+
+   // Replace entries of the loaded service, readers copy values under the same lock
+   VERIFY(osMutexWait(config_mutex, osWaitForever) == osOK);
+
+   for (cfg = list_head(services); cfg != NULL && strcasecmp(cfg->name, service); cfg = list_item_next(cfg));
+
+   if (cfg == NULL)
+   {
+      // Service was not used yet, it is loaded on the first access
+      VERIFY(osMutexRelease(config_mutex) == osOK);
+      entries_free(newcfg.entries, newcfg.size);
+      VERIFY(osMutexRelease(reload_mutex) == osOK);
+      return 0;
+   }
+
+   oldcfg = *cfg;
+   cfg->entries = newcfg.entries;
+   cfg->size = newcfg.size;
+   cfg->count = newcfg.count;
+
+   VERIFY(osMutexRelease(config_mutex) == osOK);
+
+   // Tables are not changed while reload lock is held, subscribers may read the config
+   notify_changes(service, &oldcfg, &newcfg);
+   entries_free(oldcfg.entries, oldcfg.size);
+
+   VERIFY(osMutexRelease(reload_mutex) == osOK);
+
+   TRACE("Service '%s' config reloaded", service);
+
+   return 0;
+
+fail:
+   VERIFY(osMutexRelease(reload_mutex) == osOK);
+   return -1;
+}
+
+/** Subscribe to the service config changes, callback is called for each changed key */
+int uhab_config_service_subscribe(const char *service, uhab_config_service_cb_t cb, void *arg)
+{
+   service_subscriber_t *sub;
+
+   if ((sub = os_malloc(sizeof(service_subscriber_t))) == NULL)
+      throw_exception(fail_alloc);
+
+   if ((sub->service = os_strdup(service)) == NULL)
+   {
+      os_free(sub);
+      throw_exception(fail_alloc);
+   }
+
+   sub->cb = cb;
+   sub->arg = arg;
+
+   VERIFY(osMutexWait(config_mutex, osWaitForever) == osOK);
+   list_add(subscribers, sub);
+   VERIFY(osMutexRelease(config_mutex) == osOK);
+
+   return 0;
+
+fail_alloc:
+   TRACE_ERROR("Alloc config subscriber");
+   return -1;
+}
+
+/** Get parsed service config, file is parsed on the first access */
+static service_config_t *get_service(const char *service)
+{
+   service_config_t *cfg;
+
+   for (cfg = list_head(services); cfg != NULL; cfg = list_item_next(cfg))
+   {
+      if (!strcasecmp(cfg->name, service))
+         return cfg;
+   }
+
+   if ((cfg = os_malloc(sizeof(service_config_t))) == NULL)
+      throw_exception(fail_alloc);
+
+   os_memset(cfg, 0, sizeof(service_config_t));
+
+   if ((cfg->name = os_strdup(service)) == NULL)
+   {
+      os_free(cfg);
+      throw_exception(fail_alloc);
+   }
+
+   // Not existing config is kept empty to not open it again
+   if (parse_file(service, cfg) != 0)
+   {
+      entries_free(cfg->entries, cfg->size);
+      cfg->entries = NULL;
+      cfg->size = 0;
+      cfg->count = 0;
+   }
+
+   list_add(services, cfg);
+
+   return cfg;
+
+fail_alloc:
+   TRACE_ERROR("Alloc service '%s' config", service);
+   return NULL;
+}
+
+/** Parse service config file to the hashed entries */
+static int parse_file(const char *service, service_config_t *cfg)
+{
+   int fd;
+   char *pp, *key, *end;
    char linebuf[255];
-   
-   keylen = strlen(key);
-   
-   // Open config file
+
    snprintf(linebuf, sizeof(linebuf), CFG_UHAB_SERVICES_CFG_FILENAME, service);
    if ((fd = open(linebuf, O_RDONLY)) < 0)
    {
-      TRACE_ERROR("Can't open items cfg file %s", linebuf);
-      throw_exception(fail_open);
+      TRACE_ERROR("Can't open service cfg file %s", linebuf);
+      return -1;
    }
-   
+
    while(readline(fd, linebuf, sizeof(linebuf)) > 0)
    {
-      if (!strncasecmp(linebuf, key, keylen))
+      for (key = linebuf; *key == ' ' || *key == '\t'; key++);
+
+      if (*key == '#' || (pp = strchr(key, '=')) == NULL)
+         continue;
+
+      // Key without trailing spaces
+      for (end = pp; end > key && (end[-1] == ' ' || end[-1] == '\t'); end--);
+      *end = '\0';
+
+      // Value without leading and trailing spaces and line end
+      for (pp++; *pp == ' ' || *pp == '\t'; pp++);
+      for (end = pp + strlen(pp); end > pp && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r' || end[-1] == '\n'); end--);
+      *end = '\0';
+
+      if (*key != '\0' && entries_put(cfg, key, pp) != 0)
       {
-         if ((pp = strchr(linebuf, '=')) == NULL)
-            throw_exception(fail_parse);
-            
-         strncpy(buf, ++pp, bufsize);
+         TRACE_ERROR("Alloc service '%s' config key: %s", service, key);
          close(fd);
+         return -1;
+      }
+   }
+
+   close(fd);
+
+   TRACE("Service '%s' config parsed, %d keys", service, cfg->count);
+
+   return 0;
+}
+
+/** Put key/value to the entries, first definition of the key is used */
+static int entries_put(service_config_t *cfg, const char *key, const char *value)
+{
+   uint32_t ix, size, slot;
+   service_entry_t *entries;
+
+   // Keep load factor under 3/4
+   if ((cfg->count + 1) * 4 > cfg->size * 3)
+   {
+      size = (cfg->size > 0) ? cfg->size * 2 : 32;
+
+      if ((entries = os_malloc(size * sizeof(service_entry_t))) == NULL)
+         return -1;
+
+      os_memset(entries, 0, size * sizeof(service_entry_t));
+
+      for (ix = 0; ix < cfg->size; ix++)
+      {
+         if (cfg->entries[ix].key == NULL)
+            continue;
+
+         for (slot = key_hash(cfg->entries[ix].key) & (size - 1); entries[slot].key != NULL; slot = (slot + 1) & (size - 1));
+         entries[slot] = cfg->entries[ix];
+      }
+
+      if (cfg->entries != NULL)
+         os_free(cfg->entries);
+
+      cfg->entries = entries;
+      cfg->size = size;
+   }
 
+   for (slot = key_hash(key) & (cfg->size - 1); cfg->entries[slot].key != NULL; slot = (slot + 1) & (cfg->size - 1))
+   {
+      if (!strcasecmp(cfg->entries[slot].key, key))
          return 0;
+   }
+
+   if ((cfg->entries[slot].key = os_strdup(key)) == NULL)
+      return -1;
+
+   if ((cfg->entries[slot].value = os_strdup(value)) == NULL)
+   {
+      os_free(cfg->entries[slot].key);
+      cfg->entries[slot].key = NULL;
+      return -1;
+   }
+
+   cfg->count++;
+
+   return 0;
+}
+
+/** Find entry by exact key */
+static service_entry_t *entries_find(const service_config_t *cfg, const char *key)
+{
+   uint32_t slot;
+
+   if (cfg->size == 0)
+      return NULL;
+
+   for (slot = key_hash(key) & (cfg->size - 1); cfg->entries[slot].key != NULL; slot = (slot + 1) & (cfg->size - 1))
+   {
+      if (!strcasecmp(cfg->entries[slot].key, key))
+         return &cfg->entries[slot];
+   }
+
+   return NULL;
+}
+
+/** Free entries table */
+static void entries_free(service_entry_t *entries, uint32_t size)
+{
+   uint32_t ix;
+
+   if (entries == NULL)
+      return;
+
+   for (ix = 0; ix < size; ix++)
+   {
+      if (entries[ix].key != NULL)
+      {
+         os_free(entries[ix].key);
+         os_free(entries[ix].value);
       }
    }
 
-   close(fd);
-      
-   // key not found   
-   return -1;
+   os_free(entries);
+}
 
-fail_parse:
-   close(fd);
-fail_open:
-   return -1;   
+/** Notify subscribers about added, changed and removed keys */
+static void notify_changes(const char *service, const service_config_t *oldcfg, const service_config_t *newcfg)
+{
+   uint32_t ix;
+   const service_entry_t *entry;
+   service_subscriber_t *sub;
+
+   // Subscribers are only added, list is walked without lock
+   for (sub = list_head(subscribers); sub != NULL; sub = list_item_next(sub))
+   {
+      if (strcasecmp(sub->service, service))
+         continue;
+
+      for (ix = 0; ix < newcfg->size; ix++)
+      {
+         if (newcfg->entries[ix].key == NULL)
+            continue;
+
+         if ((entry = entries_find(oldcfg, newcfg->entries[ix].key)) == NULL || strcmp(entry->value, newcfg->entries[ix].value))
+            sub->cb(service, newcfg->entries[ix].key, sub->arg);
+      }
+
+      for (ix = 0; ix < oldcfg->size; ix++)
+      {
+         if (oldcfg->entries[ix].key != NULL && entries_find(newcfg, oldcfg->entries[ix].key) == NULL)
+            sub->cb(service, oldcfg->entries[ix].key, sub->arg);
+      }
+   }
+}
+
+/** Case insensitive key hash (FNV-1a) */
+static uint32_t key_hash(const char *key)
+{
+   uint32_t hash = 2166136261U;
+
+   while (*key != '\0')
+   {
+      hash ^= (uint8_t)tolower((uint8_t)*key++);
+      hash *= 16777619U;
+   }
+
+   return hash;
 }
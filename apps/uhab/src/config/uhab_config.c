@@ -20,6 +20,9 @@ int uhab_config_init(void)
    struct romfs_fsdata_file *file = NULL;
    char path[255];
 
+   if (uhab_config_service_init() != 0)
+      throw_exception(fail);
+
    // Initialize defaults if configurations does not exists
    while((file = romfs_next_file(file)) != NULL)
    {
@@ -56,7 +59,7 @@ fail:
 /** Deinitialize config */
 int uhab_config_deinit(void)
 {
-   return 0;
+   return uhab_config_service_deinit();
 }
 
 // Parse string in fromat: dmx=dmx1:3,4,5
@@ -18,17 +18,41 @@ int uhab_config_parse_params(char *str, char **key, char **value, char **argv, i
 
 
 
+/** Service config change callback, called for each added, changed or removed key */
+typedef void (*uhab_config_service_cb_t)(const char *service, const char *key, void *arg);
+
+/** Initialize services config store */
+int uhab_config_service_init(void);
+
+/** Free all parsed services config */
+int uhab_config_service_deinit(void);
+
 /** Get service config key/value */
 int uhab_config_service_get_value(const char *service, const char *key, char *buf, int bufsize);
 
-/** Load items */
-int uhab_config_items_load(const char *path, uhab_repository_t *repo);
+/** Get service config integer value, default value is returned when key is not defined */
+int uhab_config_service_get_int(const char *service, const char *key, int defvalue);
+
+/** Get service config bool value (1|0|true|false|yes|no|on|off), default value is returned when key is not defined */
+int uhab_config_service_get_bool(const char *service, const char *key, int defvalue);
+
+/** Get service config comma separated list, items are split in the buffer, returns number of items or -1 */
+int uhab_config_service_get_list(const char *service, const char *key, char *buf, int bufsize, char **argv, int maxargs);
+
+/** Reload service config file, subscribers are notified about changed keys */
+int uhab_config_service_reload(const char *service);
+
+/** Subscribe to the service config changes */
+int uhab_config_service_subscribe(const char *service, uhab_config_service_cb_t cb, void *arg);
+
+/** Load items of all files in directory, files are parsed in parallel and merged in the name order */
+int uhab_config_items_load(const char *dirname, uhab_repository_t *repo);
 
 /** Load rules */
 int uhab_config_rules_load(const char *path, uhab_automation_t *au);
 
 /** Load sitemap */
-int uhab_config_sitemap_load(const char *path, uhab_sitemap_t *sitemap);
+int uhab_config_sitemap_load(const char *path, uhab_arena_t *arena, uhab_sitemap_t *sitemap);
 
 
 
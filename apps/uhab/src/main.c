@@ -47,6 +47,8 @@ int main(void)
 void uhab_system_shutdown(void)
 {
    TRACE("Shutdown system");
+   uhab_persist_deinit();
+   uhab_history_deinit();
    board_deinit();
 }
 
@@ -80,6 +82,7 @@ void uhab_system_factory_reset(void)
 static void uhab_system_init_thread(void *arg)
 {
    int res = 0;
+   hal_time_t start_time = hal_time_ms();
 
    // Clear status flags
    system_status.init_flags = 0;
@@ -87,25 +90,33 @@ static void uhab_system_init_thread(void *arg)
    // 1) Initialize configuraton
    VERIFY_SYSTEM_INIT(uhab_config_init(), SYSTEM_INIT_CONFIG);
 
-   // 2) Start BUS
+   // 2) Start timer service
+   VERIFY_SYSTEM_INIT(uhab_timer_init(), SYSTEM_INIT_TIMER_FLAG);
+
+   // 3) Start BUS
    VERIFY_SYSTEM_INIT(uhab_bus_init(), SYSTEM_INIT_BUS_FLAG);
 
-   // 3) Initialize protocols bindings
+   // 4) Initialize protocols bindings
    VERIFY_SYSTEM_INIT(uhab_binding_init(), SYSTEM_INIT_BINDING_FLAG);
 
-   // 4) Open items repository
+   // 5) Open items repository
    VERIFY_SYSTEM_INIT(uhab_repository_init(&repository), SYSTEM_INIT_REPOSITORY_FLAG);
 
-   // 5) Initialize automation
+   // 6) Start sitemaps loading in parallel to the automation rules loading
+   if (res == 0)
+      uhab_uiprovider_load(&uiprovider);
+
+   // 7) Initialize automation
    VERIFY_SYSTEM_INIT(uhab_automation_init(&automation), SYSTEM_INIT_AUTOMATION_FLAG);
 
-   // 6) Initialize UI provider (must be always started !)
+   // 8) Initialize UI provider (must be always started !)
    SYSTEM_INIT(uhab_uiprovider_init(&uiprovider), SYSTEM_INIT_UIPROVIDER_FLAG);
 
-   // 7) Start protocols bindings
+   // 9) Start protocols bindings
    VERIFY_SYSTEM_INIT(uhab_binding_start(), SYSTEM_START_BINDING_FLAG);
 
-   TRACE("uHAB server is running in %s mode", (system_status.init_flags == SYSTEM_READY_FLAGS) ? "normal" : "fail");
+   TRACE("uHAB server is running in %s mode, init time: %d ms", (system_status.init_flags == SYSTEM_READY_FLAGS) ? "normal" : "fail",
+         (int)(hal_time_ms() - start_time));
 
    // Terminate init thread
    VERIFY(osThreadTerminate(osThreadGetId()) == osOK);
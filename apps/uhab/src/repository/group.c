@@ -0,0 +1,262 @@
+/**
+ * \file group.c         \brief uHAB group item aggregates
+ */
+ 
+#include "uhab.h"
+
+TRACE_TAG(repository_group);
+#if !ENABLE_TRACE_REPOSITORY
+#include "trace_undef.h"
+#endif
+
+// Prototypes:
+static int get_child_value(uhab_group_aggregate_func_t func, const uhab_item_state_t *state, double *value);
+static int is_beyond(uhab_group_aggregate_func_t func, double value, double extreme);
+static void rescan_extreme(uhab_item_t *group);
+static double get_value(const uhab_group_aggregate_t *aggregate);
+static inline void aggregate_lock(uhab_group_aggregate_t *aggregate);
+static inline void aggregate_unlock(uhab_group_aggregate_t *aggregate);
+
+/** Aggregate function names */
+static const char *aggregate_names[] =
+{
+   [UHAB_GROUP_AGGREGATE_NONE] = "none",
+   [UHAB_GROUP_AGGREGATE_COUNT] = "count",
+   [UHAB_GROUP_AGGREGATE_SUM] = "sum",
+   [UHAB_GROUP_AGGREGATE_AVG] = "avg",
+   [UHAB_GROUP_AGGREGATE_MIN] = "min",
+   [UHAB_GROUP_AGGREGATE_MAX] = "max",
+};
+
+
+/** Get aggregate function by name, returns -1 when not known */
+int uhab_group_get_aggregate_func(const char *name)
+{
+   int ix;
+
+   for (ix = 0; ix < sizeof(aggregate_names) / sizeof(aggregate_names[0]); ix++)
+   {
+      if (!strcasecmp(aggregate_names[ix], name))
+         return ix;
+   }
+
+   return -1;
+}
+
+/** Set group aggregate function */
+int uhab_group_set_aggregate(uhab_item_t *group, uhab_group_aggregate_func_t func)
+{
+   uhab_item_meta_t *meta = uhab_item_get_meta(group);
+
+   ASSERT(group->type == UHAB_ITEM_TYPE_GROUP);
+
+   if (func == UHAB_GROUP_AGGREGATE_NONE)
+      return 0;
+
+   if (meta->aggregate == NULL)
+   {
+      if ((meta->aggregate = os_malloc(sizeof(uhab_group_aggregate_t))) == NULL)
+      {
+         TRACE_ERROR("Alloc group: %s aggregate", group->name);
+         return -1;
+      }
+   }
+
+   os_memset(meta->aggregate, 0, sizeof(uhab_group_aggregate_t));
+   meta->aggregate->func = func;
+   group->state.type = UHAB_ITEM_STATE_TYPE_NUMBER;
+
+   return 0;
+}
+
+/** Compute group aggregate from all child items states and set it to the group state */
+int uhab_group_aggregate_init(uhab_item_t *group)
+{
+   int ix;
+   double value;
+   uhab_group_aggregate_t *aggregate = uhab_item_get_meta(group)->aggregate;
+   uhab_item_array_t *children = &uhab_item_get_meta(group)->children;
+
+   if (aggregate == NULL)
+      return 0;
+
+   aggregate->count = 0;
+   aggregate->sum = 0;
+
+   for (ix = 0; ix < children->count; ix++)
+   {
+      if (get_child_value(aggregate->func, &children->items[ix]->state, &value))
+      {
+         if (aggregate->count == 0 || is_beyond(aggregate->func, value, aggregate->extreme))
+            aggregate->extreme = value;
+
+         aggregate->count++;
+         aggregate->sum += value;
+      }
+   }
+
+   aggregate->value = get_value(aggregate);
+
+   return uhab_item_state_set_number(&group->state, aggregate->value);
+}
+
+/** Update group aggregate by the child state change */
+int uhab_group_aggregate_update(uhab_item_t *group, const uhab_item_state_t *oldstate, const uhab_item_state_t *newstate)
+{
+   int res = 0;
+   int has_old, has_new;
+   double oldval = 0, newval = 0, value;
+   uhab_group_aggregate_t *aggregate = uhab_item_get_meta(group)->aggregate;
+
+   if (aggregate == NULL)
+      return 0;
+
+   has_old = get_child_value(aggregate->func, oldstate, &oldval);
+   has_new = get_child_value(aggregate->func, newstate, &newval);
+
+   // Not changed aggregate is posted again when the last group update was lost
+   if (((!has_old && !has_new) || (has_old && has_new && oldval == newval)) && !__atomic_load_n(&aggregate->stale, __ATOMIC_RELAXED))
+      return 0;
+
+   aggregate_lock(aggregate);
+
+   if (has_old)
+   {
+      aggregate->count--;
+      aggregate->sum -= oldval;
+   }
+
+   if (has_new)
+   {
+      aggregate->count++;
+      aggregate->sum += newval;
+   }
+
+   if (aggregate->func == UHAB_GROUP_AGGREGATE_MIN || aggregate->func == UHAB_GROUP_AGGREGATE_MAX)
+   {
+      if (has_old && oldval == aggregate->extreme && (!has_new || is_beyond(aggregate->func, aggregate->extreme, newval)))
+      {
+         // Extreme value child is leaving it, find the new extreme
+         rescan_extreme(group);
+      }
+      else if (has_new && (aggregate->count == 1 || is_beyond(aggregate->func, newval, aggregate->extreme)))
+      {
+         aggregate->extreme = newval;
+      }
+   }
+
+   value = get_value(aggregate);
+
+   if (value != aggregate->value || aggregate->stale)
+   {
+      aggregate->value = value;
+      aggregate->stale = 0;
+      res = 1;
+   }
+
+   aggregate_unlock(aggregate);
+
+   return res;
+}
+
+/** Get current aggregate value, group state is set from it when the group update is processed */
+double uhab_group_aggregate_get_value(uhab_item_t *group)
+{
+   double value;
+   uhab_group_aggregate_t *aggregate = uhab_item_get_meta(group)->aggregate;
+
+   aggregate_lock(aggregate);
+   value = aggregate->value;
+   aggregate_unlock(aggregate);
+
+   return value;
+}
+
+/** Mark group state stale, it is updated by the next child change */
+void uhab_group_aggregate_set_stale(uhab_item_t *group)
+{
+   uhab_group_aggregate_t *aggregate = uhab_item_get_meta(group)->aggregate;
+
+   if (aggregate != NULL)
+      __atomic_store_n(&aggregate->stale, 1, __ATOMIC_RELAXED);
+}
+
+/** Lock aggregate, children may be updated from more bus workers */
+static inline void aggregate_lock(uhab_group_aggregate_t *aggregate)
+{
+   while (__atomic_test_and_set(&aggregate->lock, __ATOMIC_ACQUIRE));
+}
+
+/** Unlock aggregate */
+static inline void aggregate_unlock(uhab_group_aggregate_t *aggregate)
+{
+   __atomic_clear(&aggregate->lock, __ATOMIC_RELEASE);
+}
+
+/** Get aggregated value of the child state, returns 0 when the state is not aggregated */
+static int get_child_value(uhab_group_aggregate_func_t func, const uhab_item_state_t *state, double *value)
+{
+   uhab_item_state_cmd_t cmd;
+
+   if (func == UHAB_GROUP_AGGREGATE_COUNT)
+   {
+      if (uhab_item_state_get_command(state, &cmd) == 0)
+      {
+         *value = (cmd == UHAB_ITEM_STATE_CMD_ON);
+         return 1;
+      }
+
+      if (uhab_item_state_get_number(state, value) == 0)
+      {
+         *value = (*value != 0);
+         return 1;
+      }
+
+      return 0;
+   }
+
+   return (uhab_item_state_get_number(state, value) == 0);
+}
+
+/** Test value is beyond the extreme value of the min/max function */
+static int is_beyond(uhab_group_aggregate_func_t func, double value, double extreme)
+{
+   return (func == UHAB_GROUP_AGGREGATE_MIN) ? value < extreme : value > extreme;
+}
+
+/** Find min/max value of the child items states */
+static void rescan_extreme(uhab_item_t *group)
+{
+   int ix, found = 0;
+   double value;
+   uhab_group_aggregate_t *aggregate = uhab_item_get_meta(group)->aggregate;
+   uhab_item_array_t *children = &uhab_item_get_meta(group)->children;
+
+   for (ix = 0; ix < children->count; ix++)
+   {
+      if (get_child_value(aggregate->func, &children->items[ix]->state, &value))
+      {
+         if (!found || is_beyond(aggregate->func, value, aggregate->extreme))
+            aggregate->extreme = value;
+
+         found = 1;
+      }
+   }
+}
+
+/** Get aggregate value of the function */
+static double get_value(const uhab_group_aggregate_t *aggregate)
+{
+   switch(aggregate->func)
+   {
+      case UHAB_GROUP_AGGREGATE_AVG:
+         return (aggregate->count > 0) ? aggregate->sum / aggregate->count : 0;
+
+      case UHAB_GROUP_AGGREGATE_MIN:
+      case UHAB_GROUP_AGGREGATE_MAX:
+         return (aggregate->count > 0) ? aggregate->extreme : 0;
+
+      default:
+         return aggregate->sum;
+   }
+}
@@ -0,0 +1,74 @@
+/**
+ * \file group.h         \brief uHAB group item aggregates
+ */
+
+#ifndef __UHAB_GROUP_H
+#define __UHAB_GROUP_H
+
+#include "item.h"
+
+
+/** Group aggregate functions */
+typedef enum
+{
+   UHAB_GROUP_AGGREGATE_NONE,
+   UHAB_GROUP_AGGREGATE_COUNT,      // Count of child items with ON (non zero) state
+   UHAB_GROUP_AGGREGATE_SUM,
+   UHAB_GROUP_AGGREGATE_AVG,
+   UHAB_GROUP_AGGREGATE_MIN,
+   UHAB_GROUP_AGGREGATE_MAX,
+
+} uhab_group_aggregate_func_t;
+
+
+/** Group aggregate, maintained incrementally by child state changes */
+typedef struct uhab_group_aggregate
+{
+   /** Aggregate function */
+   uhab_group_aggregate_func_t func;
+
+   /** Aggregate spinlock, children may be updated from more bus workers */
+   uint8_t lock;
+
+   /** Number of child items with aggregated value */
+   int count;
+
+   /** Sum of aggregated values (count of ON child items) */
+   double sum;
+
+   /** Min/max of aggregated values */
+   double extreme;
+
+   /** Last aggregate value */
+   double value;
+
+   /** Group update with the last value was lost (dropped event) */
+   uint8_t stale;
+
+} uhab_group_aggregate_t;
+
+
+/** Get aggregate function by name, returns -1 when not known */
+int uhab_group_get_aggregate_func(const char *name);
+
+/** Set group aggregate function */
+int uhab_group_set_aggregate(uhab_item_t *group, uhab_group_aggregate_func_t func);
+
+/** Compute group aggregate from all child items states and set it to the group state */
+int uhab_group_aggregate_init(uhab_item_t *group);
+
+/**
+ * Update group aggregate by the child state change (O(1) delta, min/max is rescanned
+ * only when the current extreme value leaves it).
+ * Returns 1 when the group state has to be updated, 0 when not.
+ */
+int uhab_group_aggregate_update(uhab_item_t *group, const uhab_item_state_t *oldstate, const uhab_item_state_t *newstate);
+
+/** Get current aggregate value, group state is set from it when the group update is processed */
+double uhab_group_aggregate_get_value(uhab_item_t *group);
+
+/** Mark group state stale, it is updated by the next child change */
+void uhab_group_aggregate_set_stale(uhab_item_t *group);
+
+
+#endif // __UHAB_GROUP_H
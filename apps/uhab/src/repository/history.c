@@ -0,0 +1,723 @@
+/**
+ * \file history.c         \brief uHAB item states history store
+ *
+ * Every item with history has a slot of fixed size in the memory mapped history file, so the disk
+ * usage is bounded. The slot holds a ring of raw samples segments and retention tiers of rollup
+ * records (min/max/sum of one rollup period) which keep the history after the raw samples are
+ * overwritten. Finished period of a tier is added to the next tier with the longer period.
+ *
+ * Samples are queued by the bus to the lock free queue and written by the history thread,
+ * queries read the mapped file without locking.
+ */
+ 
+#include "uhab.h"
+#include <sys/mman.h>
+#include <sys/time.h>
+
+TRACE_TAG(repository_history);
+#if !ENABLE_TRACE_REPOSITORY
+#include "trace_undef.h"
+#endif
+
+#if (CFG_UHAB_HISTORY_QUEUE_SIZE & (CFG_UHAB_HISTORY_QUEUE_SIZE - 1)) != 0
+#error "History queue size must be power of 2"
+#endif
+
+#define HISTORY_MAGIC            0x55484849     // UHHI
+#define HISTORY_VERSION          2
+
+/** Max. size of one encoded sample (time varint, value control byte and 8 bytes) */
+#define HISTORY_MAX_SAMPLE_SIZE  19
+
+
+/** Queued sample */
+typedef struct
+{
+   uint32_t seq;
+   uhab_item_id_t id;
+   int64_t time;
+   double value;
+
+} history_sample_t;
+
+
+/** Item history writer state */
+typedef struct
+{
+   uhab_history_slot_t *slot;
+
+   /** Encoder state of the open segment */
+   int64_t last_time;
+   int64_t last_delta;
+   uint64_t last_bits;
+
+} history_item_t;
+
+
+// Prototypes:
+static void history_thread(void *arg);
+static int take_sample(history_sample_t *sample);
+static void append_sample(history_item_t *hi, int64_t time, double value);
+static uhab_history_segment_t *open_segment(history_item_t *hi);
+static int encode_sample(const history_item_t *hi, int first, int64_t time, uint64_t bits, uint8_t *buf);
+static void update_rollup(uhab_history_slot_t *slot, int tier, uint32_t time, uint32_t count, float min, float max, double sum);
+static int read_segment(const uhab_history_segment_t *seg, uhab_history_segment_t *snap);
+static void add_bucket(uhab_history_bucket_t *bucket, uint32_t count, float min, float max, double sum);
+static int find_slot(const uhab_history_slot_t *slot, int slots, uint32_t hash);
+static history_item_t *get_history_item(const uhab_item_t *item);
+
+// Locals:
+static const osThreadDef(HISTORY, history_thread, CFG_HISTORY_THREAD_PRIORITY, 0, CFG_HISTORY_THREAD_STACK_SIZE);
+static int fd = -1;
+static uint8_t *map = NULL;
+static size_t map_size;
+static history_item_t *hitems = NULL;
+static int16_t *slot_of_id = NULL;
+static uhab_item_id_t ids_count;
+static int slots_count;
+static const uint32_t rollup_periods[CFG_UHAB_HISTORY_ROLLUP_TIERS] = CFG_UHAB_HISTORY_ROLLUP_PERIODS;
+static history_sample_t *queue = NULL;
+static uint32_t queue_head;
+static uint32_t queue_tail;
+static osMutexId history_mutex;
+static uhab_history_stats_t stats;
+
+
+/** Open history file of the items with history */
+int uhab_history_init(void)
+{
+   int ix, count;
+   uint32_t hash;
+   uhab_item_id_t id;
+   uhab_item_t *item;
+   uhab_item_array_t *groups;
+   uhab_history_header_t *header, file_header;
+   uhab_history_slot_t *slot;
+   struct stat st;
+
+   os_memset(&stats, 0, sizeof(stats));
+   ids_count = uhab_item_get_max_id();
+
+   for (ix = 1; ix < CFG_UHAB_HISTORY_ROLLUP_TIERS; ix++)
+      ASSERT(rollup_periods[ix] % rollup_periods[ix - 1] == 0);
+
+   // Items in the groups with history have history too
+   for (id = 0, count = 0; id < ids_count; id++)
+   {
+      if ((item = uhab_item_get(id)) == NULL)
+         continue;
+
+      groups = &uhab_item_get_meta(item)->groups;
+      for (ix = 0; ix < groups->count && !item->history; ix++)
+         item->history = groups->items[ix]->history;
+
+      count += item->history;
+   }
+
+   if (count == 0)
+   {
+      TRACE("No items with history");
+      return 0;
+   }
+
+   if ((fd = open(CFG_UHAB_HISTORY_FILENAME, O_RDWR | O_CREAT, 0644)) < 0)
+   {
+      TRACE_ERROR("Can't open history file %s", CFG_UHAB_HISTORY_FILENAME);
+      throw_exception(fail_open);
+   }
+
+   // Slots of the removed items are kept for reuse, the file never shrinks below its slots
+   slots_count = count;
+
+   if (pread(fd, &file_header, sizeof(file_header), 0) == sizeof(file_header) && file_header.magic == HISTORY_MAGIC &&
+       file_header.version == HISTORY_VERSION && file_header.slot_size == sizeof(uhab_history_slot_t) &&
+       file_header.slots > (uint32_t)count && file_header.slots <= 0x7FFF)
+   {
+      slots_count = file_header.slots;
+   }
+
+   if ((slot_of_id = os_malloc(ids_count * sizeof(int16_t))) == NULL || (hitems = os_malloc(slots_count * sizeof(history_item_t))) == NULL)
+   {
+      TRACE_ERROR("Alloc history items");
+      throw_exception(fail_alloc);
+   }
+
+   os_memset(hitems, 0, slots_count * sizeof(history_item_t));
+
+   map_size = sizeof(uhab_history_header_t) + slots_count * sizeof(uhab_history_slot_t);
+
+   if (fstat(fd, &st) != 0 || (st.st_size < (off_t)map_size && ftruncate(fd, map_size) != 0))
+   {
+      TRACE_ERROR("Resize history file");
+      throw_exception(fail_alloc);
+   }
+
+   if ((map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+   {
+      TRACE_ERROR("Map history file");
+      map = NULL;
+      throw_exception(fail_alloc);
+   }
+
+   header = (uhab_history_header_t *)map;
+
+   if (header->magic != HISTORY_MAGIC || header->version != HISTORY_VERSION || header->slot_size != sizeof(uhab_history_slot_t))
+   {
+      TRACE("History file %s is empty or not valid, history is cleared", CFG_UHAB_HISTORY_FILENAME);
+      os_memset(map, 0, map_size);
+   }
+
+   header->magic = HISTORY_MAGIC;
+   header->version = HISTORY_VERSION;
+   header->slot_size = sizeof(uhab_history_slot_t);
+   header->slots = slots_count;
+
+   // Items keep their slots by the name hash, so the history follows the item when the items order changes
+   slot = (uhab_history_slot_t *)(map + sizeof(uhab_history_header_t));
+
+   for (id = 0; id < ids_count; id++)
+   {
+      slot_of_id[id] = -1;
+
+      if ((item = uhab_item_get(id)) == NULL || !item->history || (hash = uhab_repository_name_hash(item->name)) == 0)
+         continue;
+
+      if ((ix = find_slot(slot, slots_count, hash)) >= 0)
+      {
+         hitems[ix].slot = &slot[ix];
+         slot_of_id[id] = ix;
+      }
+   }
+
+   // New items take a free slot or a slot of the removed item, only those slots are cleared
+   for (id = 0; id < ids_count; id++)
+   {
+      if ((item = uhab_item_get(id)) == NULL || !item->history || slot_of_id[id] >= 0)
+         continue;
+
+      if ((ix = find_slot(slot, slots_count, 0)) < 0)
+      {
+         for (ix = 0; hitems[ix].slot != NULL; ix++);
+      }
+
+      os_memset(&slot[ix], 0, sizeof(uhab_history_slot_t));
+      slot[ix].name_hash = uhab_repository_name_hash(item->name);
+      hitems[ix].slot = &slot[ix];
+      slot_of_id[id] = ix;
+   }
+
+   // Samples after restart are written to the new segment
+   for (ix = 0; ix < slots_count; ix++)
+   {
+      if (hitems[ix].slot != NULL)
+         open_segment(&hitems[ix]);
+   }
+
+   if ((queue = os_malloc(CFG_UHAB_HISTORY_QUEUE_SIZE * sizeof(history_sample_t))) == NULL)
+   {
+      TRACE_ERROR("Alloc history queue");
+      throw_exception(fail_queue);
+   }
+
+   for (ix = 0; ix < CFG_UHAB_HISTORY_QUEUE_SIZE; ix++)
+      queue[ix].seq = ix;
+
+   queue_head = queue_tail = 0;
+
+   if ((history_mutex = osMutexCreate(NULL)) == NULL)
+      throw_exception(fail_mutex);
+
+   if (osThreadCreate(osThread(HISTORY), NULL) == 0)
+   {
+      TRACE_ERROR("Start history thread");
+      throw_exception(fail_thread);
+   }
+
+   TRACE("Items with history: %d  slots: %d  file size: %d kB", count, slots_count, (int)(map_size / 1024));
+
+   return 0;
+
+fail_thread:
+   osMutexDelete(history_mutex);
+fail_mutex:
+   os_free(queue);
+   queue = NULL;
+fail_queue:
+   munmap(map, map_size);
+   map = NULL;
+fail_alloc:
+   if (hitems != NULL)
+      os_free(hitems);
+   if (slot_of_id != NULL)
+      os_free(slot_of_id);
+   hitems = NULL;
+   slot_of_id = NULL;
+   close(fd);
+   fd = -1;
+fail_open:
+   return -1;
+}
+
+/** Sync and close history file */
+int uhab_history_deinit(void)
+{
+   history_sample_t sample;
+
+   if (queue == NULL)
+      return 0;
+
+   VERIFY(osMutexWait(history_mutex, osWaitForever) == osOK);
+
+   while (take_sample(&sample))
+      append_sample(&hitems[slot_of_id[sample.id]], sample.time, sample.value);
+
+   // File stays mapped for running queries, it is released on exit
+   if (msync(map, map_size, MS_SYNC) != 0)
+      TRACE_ERROR("Sync history file");
+
+   VERIFY(osMutexRelease(history_mutex) == osOK);
+
+   TRACE("History closed");
+
+   return 0;
+}
+
+/** Record item state change, sample is queued and never blocks the caller */
+void uhab_history_record(const uhab_item_t *item, hal_time_t timestamp)
+{
+   uint32_t pos, seq;
+   double value;
+   uhab_item_state_cmd_t cmd;
+   history_sample_t *cell;
+
+   if (!item->history || queue == NULL)
+      return;
+
+   if (uhab_item_state_get_number(&item->state, &value) != 0)
+   {
+      if (uhab_item_state_get_command(&item->state, &cmd) != 0)
+         return;
+
+      value = (cmd == UHAB_ITEM_STATE_CMD_ON);
+   }
+
+   // Reserve queue cell (bounded MPSC queue with cell sequence numbers)
+   pos = __atomic_load_n(&queue_tail, __ATOMIC_RELAXED);
+   for (;;)
+   {
+      cell = &queue[pos & (CFG_UHAB_HISTORY_QUEUE_SIZE - 1)];
+      seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+
+      if (seq == pos)
+      {
+         if (__atomic_compare_exchange_n(&queue_tail, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            break;
+      }
+      else if ((int32_t)(seq - pos) < 0)
+      {
+         // Queue is full, history thread is behind
+         __atomic_add_fetch(&stats.dropped, 1, __ATOMIC_RELAXED);
+         return;
+      }
+      else
+      {
+         pos = __atomic_load_n(&queue_tail, __ATOMIC_RELAXED);
+      }
+   }
+
+   cell->id = item->id;
+   cell->time = uhab_history_time() - (int64_t)(hal_time_ms() - timestamp);
+   cell->value = value;
+
+   __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+}
+
+/** Query item history downsampled to buckets of step length from time [ms since epoch] */
+int uhab_history_query(const uhab_item_t *item, int64_t from, int64_t to, int64_t step, uhab_history_bucket_t *buckets, int count)
+{
+   int ix, tier, pos, len, shift, nbytes;
+   int64_t time, delta, start, limit, period, oldest[CFG_UHAB_HISTORY_ROLLUP_TIERS];
+   uint64_t bits, x, zz;
+   uint8_t ctrl;
+   double value;
+   history_item_t *hi;
+   uhab_history_slot_t *slot;
+   uhab_history_segment_t snap;
+   uhab_history_rollup_t rollup;
+   uhab_history_tier_t *rollups;
+
+   if ((hi = get_history_item(item)) == NULL)
+      return -1;
+
+   ASSERT(step > 0);
+
+   slot = hi->slot;
+   os_memset(buckets, 0, count * sizeof(uhab_history_bucket_t));
+
+   // Oldest raw sample, older time is covered by rollups only
+   for (ix = 0, oldest[0] = to; ix < CFG_UHAB_HISTORY_SEGMENTS; ix++)
+   {
+      if (__atomic_load_n(&slot->segments[ix].count, __ATOMIC_ACQUIRE) > 0 && slot->segments[ix].first_time < oldest[0])
+         oldest[0] = slot->segments[ix].first_time;
+   }
+
+   // Tier covers the time before the oldest data of the shorter tiers
+   for (tier = 0; tier + 1 < CFG_UHAB_HISTORY_ROLLUP_TIERS; tier++)
+   {
+      for (ix = 0, oldest[tier + 1] = oldest[tier]; ix < CFG_UHAB_HISTORY_ROLLUPS; ix++)
+      {
+         time = slot->tiers[tier].records[ix].time * 1000LL;
+
+         if (time != 0 && time < oldest[tier + 1])
+            oldest[tier + 1] = time;
+      }
+   }
+
+   // Tiers are added from the longest period, record overlapping the shorter tier data replaces the data of its period
+   for (tier = CFG_UHAB_HISTORY_ROLLUP_TIERS - 1, start = INT64_MIN; tier >= 0; tier--)
+   {
+      rollups = &slot->tiers[tier];
+      period = rollup_periods[tier] * 1000LL;
+
+      for (ix = 0, limit = start; ix < CFG_UHAB_HISTORY_ROLLUPS; ix++)
+      {
+         rollup = rollups->records[ix];
+         time = rollup.time * 1000LL;
+
+         if (rollup.time == 0 || time < start || time >= oldest[tier])
+            continue;
+
+         if (time + period > limit)
+            limit = time + period;
+
+         if (time >= from && time < to && (pos = (time - from) / step) < count)
+            add_bucket(&buckets[pos], rollup.count, rollup.min, rollup.max, rollup.sum);
+      }
+
+      start = limit;
+   }
+
+   for (ix = 0; ix < CFG_UHAB_HISTORY_SEGMENTS; ix++)
+   {
+      if (!read_segment(&slot->segments[ix], &snap) || snap.last_time < from || snap.first_time >= to)
+         continue;
+
+      // Decode samples directly to buckets
+      time = snap.first_time;
+      delta = 0;
+      bits = 0;
+
+      for (pos = 0, len = 0; len < snap.count && pos < snap.size; len++)
+      {
+         // Time delta of delta (zigzag varint)
+         for (zz = 0, shift = 0; pos < snap.size && shift < 64; shift += 7)
+         {
+            zz |= (uint64_t)(snap.data[pos] & 0x7F) << shift;
+            if ((snap.data[pos++] & 0x80) == 0)
+               break;
+         }
+
+         if (len > 0)
+         {
+            delta += (int64_t)(zz >> 1) ^ -(int64_t)(zz & 1);
+            time += delta;
+         }
+
+         // Value XOR with previous value
+         if (pos >= snap.size)
+            break;
+
+         ctrl = snap.data[pos++];
+         x = 0;
+
+         if (ctrl != 0)
+         {
+            nbytes = ctrl & 0x0F;
+
+            for (shift = 0; shift < nbytes && pos < snap.size; shift++)
+               x |= (uint64_t)snap.data[pos++] << (8 * shift);
+
+            x <<= 8 * (8 - (ctrl >> 4) - nbytes);
+         }
+
+         bits ^= x;
+         memcpy(&value, &bits, sizeof(value));
+
+         if (time >= start && time >= from && time < to && (time - from) / step < count)
+            add_bucket(&buckets[(time - from) / step], 1, value, value, value);
+      }
+   }
+
+   return 0;
+}
+
+/** Get current time [ms since epoch] */
+int64_t uhab_history_time(void)
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+
+   return (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+/** Get history store statistics */
+void uhab_history_get_stats(uhab_history_stats_t *pstats)
+{
+   *pstats = stats;
+}
+
+/** History writer thread */
+static void history_thread(void *arg)
+{
+   history_sample_t sample;
+   hal_time_t sync_time = hal_time_ms();
+
+   TRACE("History thread is running");
+
+   for (;;)
+   {
+      VERIFY(osMutexWait(history_mutex, osWaitForever) == osOK);
+
+      while (take_sample(&sample))
+         append_sample(&hitems[slot_of_id[sample.id]], sample.time, sample.value);
+
+      // Written pages are synced in batches to limit SD card writes
+      if (hal_time_ms() - sync_time >= CFG_UHAB_HISTORY_SYNC_PERIOD)
+      {
+         if (msync(map, map_size, MS_ASYNC) != 0)
+            TRACE_ERROR("Sync history file");
+
+         sync_time = hal_time_ms();
+      }
+
+      VERIFY(osMutexRelease(history_mutex) == osOK);
+
+      osDelay(CFG_UHAB_HISTORY_POLL_PERIOD);
+   }
+}
+
+/** Take sample from the queue */
+static int take_sample(history_sample_t *sample)
+{
+   history_sample_t *cell = &queue[queue_head & (CFG_UHAB_HISTORY_QUEUE_SIZE - 1)];
+
+   if (__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) != queue_head + 1)
+      return 0;
+
+   *sample = *cell;
+   __atomic_store_n(&cell->seq, queue_head + CFG_UHAB_HISTORY_QUEUE_SIZE, __ATOMIC_RELEASE);
+   queue_head++;
+
+   return 1;
+}
+
+/** Append sample to the open segment of the item */
+static void append_sample(history_item_t *hi, int64_t time, double value)
+{
+   int len, first;
+   uint64_t bits;
+   uint8_t buf[HISTORY_MAX_SAMPLE_SIZE];
+   uhab_history_segment_t *seg = &hi->slot->segments[hi->slot->seg_head];
+
+   update_rollup(hi->slot, 0, (uint32_t)(time / 1000), 1, value, value, value);
+   memcpy(&bits, &value, sizeof(bits));
+
+   first = (seg->count == 0);
+   len = encode_sample(hi, first, time, bits, buf);
+
+   if (seg->size + len > sizeof(seg->data) || seg->count == 0xFFFF)
+   {
+      seg = open_segment(hi);
+      first = 1;
+      len = encode_sample(hi, first, time, bits, buf);
+   }
+
+   if (first)
+   {
+      seg->first_time = time;
+      seg->min = seg->max = value;
+   }
+
+   memcpy(&seg->data[seg->size], buf, len);
+   seg->size += len;
+   seg->last_time = time;
+
+   if (value < seg->min)
+      seg->min = value;
+   if (value > seg->max)
+      seg->max = value;
+
+   hi->last_delta = first ? 0 : time - hi->last_time;
+   hi->last_time = time;
+   hi->last_bits = bits;
+
+   // Sample is visible for queries after it is written
+   __atomic_store_n(&seg->count, seg->count + 1, __ATOMIC_RELEASE);
+   stats.samples++;
+}
+
+/** Open next segment of the ring, the oldest segment is overwritten */
+static uhab_history_segment_t *open_segment(history_item_t *hi)
+{
+   uhab_history_slot_t *slot = hi->slot;
+   uhab_history_segment_t *seg = &slot->segments[slot->seg_head];
+
+   if (seg->seq != 0 && seg->count > 0)
+   {
+      slot->seg_head = (slot->seg_head + 1) % CFG_UHAB_HISTORY_SEGMENTS;
+      seg = &slot->segments[slot->seg_head];
+   }
+
+   // Invalidate segment for running queries before it is rewritten
+   __atomic_store_n(&seg->seq, 0, __ATOMIC_RELEASE);
+   __atomic_thread_fence(__ATOMIC_RELEASE);
+   seg->count = 0;
+   seg->size = 0;
+   seg->first_time = 0;
+   seg->last_time = 0;
+
+   if (++slot->seg_seq == 0)
+      slot->seg_seq = 1;
+
+   __atomic_store_n(&seg->seq, slot->seg_seq, __ATOMIC_RELEASE);
+
+   // Segment is decoded from its first sample
+   hi->last_time = 0;
+   hi->last_delta = 0;
+   hi->last_bits = 0;
+
+   stats.segments++;
+
+   return seg;
+}
+
+/** Encode sample (time delta of delta as zigzag varint, value XOR with previous value), returns encoded length */
+static int encode_sample(const history_item_t *hi, int first, int64_t time, uint64_t bits, uint8_t *buf)
+{
+   int len = 0, lead, trail, nbytes;
+   int64_t dod;
+   uint64_t zz, x;
+
+   // First sample of the segment is the segment first time
+   dod = first ? 0 : (time - hi->last_time) - hi->last_delta;
+   zz = ((uint64_t)dod << 1) ^ (uint64_t)(dod >> 63);
+
+   do
+   {
+      buf[len++] = (zz & 0x7F) | ((zz >> 7) ? 0x80 : 0);
+      zz >>= 7;
+
+   } while (zz != 0);
+
+   // Unchanged value is one zero byte, changed value has control byte with leading zero bytes and length
+   if ((x = bits ^ hi->last_bits) == 0)
+   {
+      buf[len++] = 0;
+   }
+   else
+   {
+      lead = __builtin_clzll(x) / 8;
+      trail = __builtin_ctzll(x) / 8;
+      nbytes = 8 - lead - trail;
+
+      buf[len++] = (lead << 4) | nbytes;
+
+      for (x >>= 8 * trail; nbytes > 0; nbytes--, x >>= 8)
+         buf[len++] = x & 0xFF;
+   }
+
+   return len;
+}
+
+/** Add samples to the period in progress of the tier, finished period is written to the tier ring and added to the next tier */
+static void update_rollup(uhab_history_slot_t *slot, int tier, uint32_t time, uint32_t count, float min, float max, double sum)
+{
+   uhab_history_tier_t *rollups = &slot->tiers[tier];
+   uhab_history_rollup_t *current = &rollups->current;
+   uhab_history_rollup_t finished;
+   uint32_t period = time / rollup_periods[tier] * rollup_periods[tier];
+
+   if (current->count > 0 && period != current->time)
+   {
+      finished = *current;
+      rollups->records[rollups->head] = finished;
+      rollups->head = (rollups->head + 1) % CFG_UHAB_HISTORY_ROLLUPS;
+      current->count = 0;
+      stats.rollups++;
+
+      if (tier + 1 < CFG_UHAB_HISTORY_ROLLUP_TIERS)
+         update_rollup(slot, tier + 1, finished.time, finished.count, finished.min, finished.max, finished.sum);
+   }
+
+   if (current->count == 0)
+   {
+      current->time = period;
+      current->min = min;
+      current->max = max;
+      current->sum = 0;
+   }
+
+   current->count += count;
+   current->sum += sum;
+
+   if (min < current->min)
+      current->min = min;
+   if (max > current->max)
+      current->max = max;
+}
+
+/** Read consistent segment snapshot, returns 0 for empty or concurrently rewritten segment */
+static int read_segment(const uhab_history_segment_t *seg, uhab_history_segment_t *snap)
+{
+   uint16_t count;
+   uint32_t seq = __atomic_load_n(&seg->seq, __ATOMIC_ACQUIRE);
+
+   if (seq == 0)
+      return 0;
+
+   // Open segment may be appended during the copy, only the samples published before the copy are decoded
+   count = __atomic_load_n(&seg->count, __ATOMIC_ACQUIRE);
+
+   memcpy(snap, seg, sizeof(uhab_history_segment_t));
+   __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+   snap->count = count;
+
+   return (count > 0 && __atomic_load_n(&seg->seq, __ATOMIC_RELAXED) == seq);
+}
+
+/** Add aggregated samples to the bucket */
+static void add_bucket(uhab_history_bucket_t *bucket, uint32_t count, float min, float max, double sum)
+{
+   if (bucket->count == 0 || min < bucket->min)
+      bucket->min = min;
+   if (bucket->count == 0 || max > bucket->max)
+      bucket->max = max;
+
+   bucket->count += count;
+   bucket->sum += sum;
+}
+
+/** Find slot of the name hash not assigned yet, returns slot index or -1 */
+static int find_slot(const uhab_history_slot_t *slot, int slots, uint32_t hash)
+{
+   int ix;
+
+   for (ix = 0; ix < slots; ix++)
+   {
+      if (hitems[ix].slot == NULL && slot[ix].name_hash == hash)
+         return ix;
+   }
+
+   return -1;
+}
+
+/** Get history writer state of the item */
+static history_item_t *get_history_item(const uhab_item_t *item)
+{
+   if (hitems == NULL || item->id >= ids_count || slot_of_id[item->id] < 0)
+      return NULL;
+
+   return &hitems[slot_of_id[item->id]];
+}
@@ -0,0 +1,146 @@
+/**
+ * \file history.h         \brief uHAB item states history store
+ */
+
+#ifndef __UHAB_HISTORY_H
+#define __UHAB_HISTORY_H
+
+#include "item.h"
+
+
+/** Raw samples segment header size */
+#define UHAB_HISTORY_SEGMENT_HEADER_SIZE   32
+
+
+/** Raw samples segment, samples are compressed (time delta of delta, value XOR with previous value) */
+typedef struct
+{
+   /** Segment sequence number, 0 for empty segment */
+   uint32_t seq;
+
+   /** Number of samples and used data size */
+   uint16_t count;
+   uint16_t size;
+
+   /** Time of the first and last sample [ms] */
+   int64_t first_time;
+   int64_t last_time;
+
+   /** Min/max of the segment samples */
+   float min;
+   float max;
+
+   /** Compressed samples */
+   uint8_t data[CFG_UHAB_HISTORY_SEGMENT_SIZE - UHAB_HISTORY_SEGMENT_HEADER_SIZE];
+
+} uhab_history_segment_t;
+
+
+/** Rollup record of the retention tier, aggregated samples of one rollup period */
+typedef struct
+{
+   /** Period start time [s], 0 for empty record */
+   uint32_t time;
+   uint32_t count;
+   float min;
+   float max;
+   double sum;
+
+} uhab_history_rollup_t;
+
+
+/** Rollup retention tier, records of one period length */
+typedef struct
+{
+   /** Index of the next rollup record */
+   uint32_t head;
+   uint32_t reserved;
+
+   /** Period in progress, kept in the slot so it survives restart */
+   uhab_history_rollup_t current;
+
+   /** Rollup records ring */
+   uhab_history_rollup_t records[CFG_UHAB_HISTORY_ROLLUPS];
+
+} uhab_history_tier_t;
+
+
+/** Item history slot of the history file */
+typedef struct
+{
+   /** Item name hash, 0 for free slot */
+   uint32_t name_hash;
+
+   /** Index of the open segment */
+   uint32_t seg_head;
+
+   /** Last used segment sequence number */
+   uint32_t seg_seq;
+   uint32_t reserved;
+
+   /** Raw samples segments ring */
+   uhab_history_segment_t segments[CFG_UHAB_HISTORY_SEGMENTS];
+
+   /** Rollup tiers from the shortest period */
+   uhab_history_tier_t tiers[CFG_UHAB_HISTORY_ROLLUP_TIERS];
+
+} uhab_history_slot_t;
+
+
+/** History file header */
+typedef struct
+{
+   uint32_t magic;
+   uint16_t version;
+   uint16_t reserved;
+   uint32_t slot_size;
+   uint32_t slots;
+
+} uhab_history_header_t;
+
+
+/** Downsampled history bucket */
+typedef struct
+{
+   uint32_t count;
+   float min;
+   float max;
+   double sum;
+
+} uhab_history_bucket_t;
+
+
+/** History store statistics */
+typedef struct
+{
+   uint32_t samples;
+   uint32_t dropped;
+   uint32_t segments;
+   uint32_t rollups;
+
+} uhab_history_stats_t;
+
+
+/** Open history file of the items with history */
+int uhab_history_init(void);
+
+/** Sync and close history file */
+int uhab_history_deinit(void);
+
+/** Record item state change, sample is queued and never blocks the caller */
+void uhab_history_record(const uhab_item_t *item, hal_time_t timestamp);
+
+/**
+ * Query item history downsampled to buckets of step length from time [ms since epoch].
+ * Samples are decoded directly into buckets, raw samples are not loaded into memory.
+ */
+int uhab_history_query(const uhab_item_t *item, int64_t from, int64_t to, int64_t step, uhab_history_bucket_t *buckets, int count);
+
+/** Get current time [ms since epoch] */
+int64_t uhab_history_time(void);
+
+/** Get history store statistics */
+void uhab_history_get_stats(uhab_history_stats_t *stats);
+
+
+#endif // __UHAB_HISTORY_H
@@ -9,30 +9,154 @@ TRACE_TAG(repository_item);
 #include "trace_undef.h"
 #endif
 
-/** Alloc item */
+// Prototypes:
+static int alloc_chunk(void);
+static int push_free_id(uhab_item_id_t id);
+
+/** Items table chunk, hot items, their cold metadata and bus side data are kept in separate arrays */
+typedef struct
+{
+   uhab_item_t items[CFG_UHAB_ITEMS_CHUNK_SIZE];
+   uhab_item_meta_t meta[CFG_UHAB_ITEMS_CHUNK_SIZE];
+   uhab_item_bus_t bus[CFG_UHAB_ITEMS_CHUNK_SIZE];
+
+} items_chunk_t;
+
+
+// Locals:
+static items_chunk_t **chunks = NULL;
+static int chunks_size = 0;
+static uhab_item_id_t max_id = 0;
+
+/** Stack of the freed ids */
+static uhab_item_id_t *free_ids = NULL;
+static int free_count = 0;
+static int free_size = 0;
+
+
+/** Alloc item in the items table */
 uhab_item_t *uhab_item_alloc(uhab_item_type_t type)
 {
+   uhab_item_id_t id;
    uhab_item_t *item;
 
-   if ((item = os_malloc(sizeof(uhab_item_t))) != NULL)
+   if (free_count > 0)
    {
-      os_memset(item, 0, sizeof(uhab_item_t));
-      LIST_STRUCT_INIT(item, child_items);
-      LIST_STRUCT_INIT(item, automation.rules);
-      item->type = type;      
+      // Reuse freed id
+      id = free_ids[--free_count];
+      item = &chunks[id / CFG_UHAB_ITEMS_CHUNK_SIZE]->items[id % CFG_UHAB_ITEMS_CHUNK_SIZE];
    }
+   else
+   {
+      if (max_id == UHAB_ITEM_ID_NONE)
+      {
+         TRACE_ERROR("Items table is full");
+         return NULL;
+      }
+
+      if ((max_id % CFG_UHAB_ITEMS_CHUNK_SIZE) == 0 && alloc_chunk() != 0)
+      {
+         TRACE_ERROR("Alloc items chunk");
+         return NULL;
+      }
+
+      id = max_id++;
+      item = &chunks[id / CFG_UHAB_ITEMS_CHUNK_SIZE]->items[id % CFG_UHAB_ITEMS_CHUNK_SIZE];
+   }
+
+   os_memset(item, 0, sizeof(uhab_item_t));
+   os_memset(uhab_item_get_meta(item), 0, sizeof(uhab_item_meta_t));
+   os_memset(uhab_item_get_bus(item), 0, sizeof(uhab_item_bus_t));
+   LIST_STRUCT_INIT(item, automation.rules);
+   item->active_child = -1;
+   item->id = id;
+   item->type = type;      
    
    return item;
 }
 
-/** Free item */
+/** Free item and its containers, its id is reused (name and metadata strings are in the config arena) */
 void uhab_item_free(uhab_item_t *item)
 {
-   // TODO: free all containers
-   
-   os_free(item);
+   uhab_item_meta_t *meta = uhab_item_get_meta(item);
+
+   if (meta->aggregate != NULL)
+      os_free(meta->aggregate);
+   if (meta->children.items != NULL)
+      os_free(meta->children.items);
+   if (meta->groups.items != NULL)
+      os_free(meta->groups.items);
+
+   uhab_item_state_release(&item->state);
+
+   meta->aggregate = NULL;
+   item->name = NULL;
+
+   // Id is lost only when the free stack can't grow
+   if (push_free_id(item->id) != 0)
+      TRACE_ERROR("Alloc free item id: %d", item->id);
+}
+
+/** Get item by id, returns NULL for the free id or not yet named item */
+uhab_item_t *uhab_item_get(uhab_item_id_t id)
+{
+   uhab_item_t *item;
+
+   if (id >= max_id)
+      return NULL;
+
+   item = &chunks[id / CFG_UHAB_ITEMS_CHUNK_SIZE]->items[id % CFG_UHAB_ITEMS_CHUNK_SIZE];
+
+   return (item->name != NULL) ? item : NULL;
+}
+
+/** Get upper bound of the allocated item ids */
+uhab_item_id_t uhab_item_get_max_id(void)
+{
+   return max_id;
+}
+
+/** Get first item of the items table in the id order, NULL when there is no item */
+uhab_item_t *uhab_item_first(void)
+{
+   uhab_item_id_t id;
+   uhab_item_t *item;
+
+   for (id = 0; id < max_id; id++)
+   {
+      if ((item = uhab_item_get(id)) != NULL)
+         return item;
+   }
+
+   return NULL;
+}
+
+/** Get next item of the items table in the id order, freed ids are skipped */
+uhab_item_t *uhab_item_next(const uhab_item_t *item)
+{
+   uhab_item_id_t id;
+   uhab_item_t *next;
+
+   for (id = item->id + 1; id < max_id; id++)
+   {
+      if ((next = uhab_item_get(id)) != NULL)
+         return next;
+   }
+
+   return NULL;
 }
 
+/** Get item cold metadata */
+uhab_item_meta_t *uhab_item_get_meta(const uhab_item_t *item)
+{
+   return &chunks[item->id / CFG_UHAB_ITEMS_CHUNK_SIZE]->meta[item->id % CFG_UHAB_ITEMS_CHUNK_SIZE];
+}
+
+/** Get item bus side data */
+uhab_item_bus_t *uhab_item_get_bus(const uhab_item_t *item)
+{
+   return &chunks[item->id / CFG_UHAB_ITEMS_CHUNK_SIZE]->bus[item->id % CFG_UHAB_ITEMS_CHUNK_SIZE];
+}
 
 /** Add item automation rule */
 int uhab_item_add_rule(uhab_item_t *item, struct uhab_rule *rule)
@@ -53,3 +177,61 @@ int uhab_item_add_rule(uhab_item_t *item, struct uhab_rule *rule)
    
    return 0;
 }
+
+/** Add new chunk to the items table, items keep their addresses */
+static int alloc_chunk(void)
+{
+   int size;
+   items_chunk_t **table;
+   int chunk = max_id / CFG_UHAB_ITEMS_CHUNK_SIZE;
+
+   if (chunk >= chunks_size)
+   {
+      size = (chunks_size > 0) ? chunks_size * 2 : 4;
+
+      if ((table = os_malloc(size * sizeof(items_chunk_t *))) == NULL)
+         return -1;
+
+      if (chunks != NULL)
+      {
+         memcpy(table, chunks, chunks_size * sizeof(items_chunk_t *));
+         os_free(chunks);
+      }
+
+      chunks = table;
+      chunks_size = size;
+   }
+
+   if ((chunks[chunk] = os_malloc(sizeof(items_chunk_t))) == NULL)
+      return -1;
+
+   return 0;
+}
+
+/** Push freed id to the free ids stack, stack capacity is doubled when full */
+static int push_free_id(uhab_item_id_t id)
+{
+   int size;
+   uhab_item_id_t *ids;
+
+   if (free_count == free_size)
+   {
+      size = (free_size > 0) ? free_size * 2 : 16;
+
+      if ((ids = os_malloc(size * sizeof(uhab_item_id_t))) == NULL)
+         return -1;
+
+      if (free_ids != NULL)
+      {
+         memcpy(ids, free_ids, free_count * sizeof(uhab_item_id_t));
+         os_free(free_ids);
+      }
+
+      free_ids = ids;
+      free_size = size;
+   }
+
+   free_ids[free_count++] = id;
+
+   return 0;
+}
@@ -28,6 +28,9 @@ typedef enum
    
 } uhab_item_type_t;
 
+/** Count of the item types */
+#define UHAB_ITEM_TYPE_COUNT     (UHAB_ITEM_TYPE_ROLLERSHUTTER + 1)
+
 
 /** Item stereotypes */
 typedef enum
@@ -38,23 +41,29 @@ typedef enum
 } uhab_item_stereotype_t;
 
 
-/** Item definition */
-typedef struct uhab_item
+/** Dense item id, index to the items table */
+typedef uint16_t uhab_item_id_t;
+
+/** Not valid item id */
+#define UHAB_ITEM_ID_NONE     ((uhab_item_id_t)0xFFFF)
+
+
+/** Max. number of items in the items array (16 bit count) */
+#define UHAB_ITEM_ARRAY_MAX_SIZE    0xFFFF
+
+/** Compact array of items links */
+typedef struct
+{
+   struct uhab_item **items;
+   uint16_t count;
+   uint16_t size;
+
+} uhab_item_array_t;
+
+
+/** Item cold metadata, stored apart from the hot items table */
+typedef struct
 {
-   struct uhab_item *next;
-   
-   /** Current item state */
-   uhab_item_state_t state;
-   
-   /** Item type */
-   uhab_item_type_t type;
-   
-   /** Item stereotype */
-   uhab_item_stereotype_t stereotype;
-  
-   /** Item name */
-   const char *name;
-   
    /** Item label */
    const char *label;
    
@@ -63,12 +72,99 @@ typedef struct uhab_item
 
    /** Additional tag type */
    const char *tag;
+
+   /** Binding configuration */
+   char *binding_config;
+
+   /** Child items of the group */
+   uhab_item_array_t children;
+
+   /** Groups containing the item */
+   uhab_item_array_t groups;
+
+   /** Group aggregate of child items states, NULL when not defined */
+   struct uhab_group_aggregate *aggregate;
+
+} uhab_item_meta_t;
+
+
+/** Contact click measurement, allocated on the first click */
+typedef struct
+{
+   hal_time_t start_time;
+   hal_time_t release_time;
+   int count;
+   uhab_timer_t *timer;
+
+} uhab_item_click_t;
+
+
+/** Item bus side data, stored apart from the hot items table */
+typedef struct
+{
+   /** Contact click measurement */
+   uhab_item_click_t *click;
+
+   /** Sequence number of the last change in the bus journal */
+   uint32_t seq;
+
+   /** Coalesced pending update */
+   struct
+   {
+      /** Pending state spinlock */
+      uint8_t lock;
+
+      /** Event with pending state is queued */
+      uint8_t queued;
+
+      /** Another event was queued after the pending one, updates are not merged into it */
+      uint8_t closed;
+
+      /** Latest pending state */
+      uhab_item_state_t state;
+
+      /** Number of coalesced updates */
+      uint32_t count;
+
+   } pending;
+
+   /** Sitemap pages (widgets) containing the item, built with sitemap widgets index */
+   struct
+   {
+      struct uhab_sitemap_widget **widgets;
+      int count;
+
+   } pages;
+
+} uhab_item_bus_t;
+
+
+/** Item definition (hot data) */
+typedef struct uhab_item
+{
+   /** Current item state */
+   uhab_item_state_t state;
    
-   /** Child items */
-   LIST_STRUCT(child_items);
+   /** Dense item id */
+   uhab_item_id_t id;
+
+   /** Item stereotype */
+   uint8_t stereotype;
+
+   /** Item state is persisted */
+   uint8_t persist;
+
+   /** Item state changes are recorded to the history */
+   uint8_t history;
+
+   /** Item type */
+   uhab_item_type_t type;
+  
+   /** Item name */
+   const char *name;
    
-   /** Selected child item */
-   struct uhab_child_item *active_child_item;
+   /** Index of the selected child item, -1 when not selected */
+   int16_t active_child;
 
    
    /** Binding data */
@@ -77,9 +173,6 @@ typedef struct uhab_item
       /** Protocol binding */
       const struct uhab_protocol_binding *protocol;
 
-      /** Binding configuration */
-      char *config;
-      
       /** Ptr to item used by protocol */
       void *protocol_item;
       
@@ -89,18 +182,9 @@ typedef struct uhab_item
    /** BUS data */
    struct
    {
-      /** Contact click measurement */
-      struct
-      {
-         hal_time_t start_time;
-         int count;
-         osTimerId timer;
-         
-      } click;
-      
       /** Last update time */
       hal_time_t update_time;
-      
+
    } bus;
    
    
@@ -122,23 +206,29 @@ typedef struct uhab_item
 } uhab_item_t;
 
 
-/** Child item */
-typedef struct uhab_child_item
-{
-   struct uhab_child_item *next;
-   
-   /** Ptr to item link */
-   uhab_item_t *item;
-      
-} uhab_child_item_t;
+/** Alloc item in the items table */
+uhab_item_t *uhab_item_alloc(uhab_item_type_t type);
 
+/** Free item, its id is reused */
+void uhab_item_free(uhab_item_t *item);
 
+/** Get item by id, returns NULL for the free id or not yet named item */
+uhab_item_t *uhab_item_get(uhab_item_id_t id);
 
-/** Alloc item */
-uhab_item_t *uhab_item_alloc(uhab_item_type_t type);
+/** Get upper bound of the allocated item ids */
+uhab_item_id_t uhab_item_get_max_id(void);
 
-/** Free item */
-void uhab_item_free(uhab_item_t *item);
+/** Get first item of the items table in the id order, NULL when there is no item */
+uhab_item_t *uhab_item_first(void);
+
+/** Get next item of the items table in the id order, NULL after the last item */
+uhab_item_t *uhab_item_next(const uhab_item_t *item);
+
+/** Get item cold metadata */
+uhab_item_meta_t *uhab_item_get_meta(const uhab_item_t *item);
+
+/** Get item bus side data */
+uhab_item_bus_t *uhab_item_get_bus(const uhab_item_t *item);
 
 /** Add item automation rule */
 int uhab_item_add_rule(uhab_item_t *item, struct uhab_rule *rule);
@@ -9,6 +9,22 @@ TRACE_TAG(repository_state);
 #include "trace_undef.h"
 #endif
 
+/** Max. busy spins on the locked state before the thread sleeps */
+#define STATE_MAX_SPINS       100
+
+// Prototypes:
+static void state_lock(const uhab_item_state_t *state);
+static void state_unlock(const uhab_item_state_t *state);
+static void state_read(const uhab_item_state_t *state, uhab_item_state_t *snap);
+static void state_publish(uhab_item_state_t *state, const uhab_item_state_t *newstate);
+static const char *state_str(const uhab_item_state_t *state);
+static int str_make(uhab_item_state_t *state, const char *str);
+static int str_retain(uhab_item_state_t *state);
+static void str_release(uhab_item_state_t *state);
+
+// Locals:
+static uhab_item_state_stats_t stats;
+
 
 /** String to item state command type */
 int uhab_item_state_str2command(const char *str, uhab_item_state_cmd_t *cmd)
@@ -38,11 +54,15 @@ int uhab_item_state_str2command(const char *str, uhab_item_state_cmd_t *cmd)
 /** Get item state value as string */
 const char *uhab_item_state_get_value_fmt(const uhab_item_state_t *state, const char *fmt, char *buf, int bufsize)
 {
-   switch(state->type)
+   uhab_item_state_t snap;
+
+   state_read(state, &snap);
+
+   switch(snap.type)
    {
       case UHAB_ITEM_STATE_TYPE_CMD:
       {
-         switch(state->value.cmd)
+         switch(snap.value.cmd)
          {
             case UHAB_ITEM_STATE_CMD_OFF:
                snprintf(buf, bufsize, (fmt != NULL) ? fmt : "%s", "OFF");
@@ -80,21 +100,17 @@ const char *uhab_item_state_get_value_fmt(const uhab_item_state_t *state, const
       break;
          
       case UHAB_ITEM_STATE_TYPE_NUMBER:
-      {
-         double num;
-
-         if (uhab_item_state_get_number(state, &num) != 0)
-            return NULL;
-         
-         snprintf(buf, bufsize, (fmt != NULL) ? fmt : "%g", num);   
-      }
-      break;
+         snprintf(buf, bufsize, (fmt != NULL) ? fmt : "%g", snap.value.number);   
+         break;
          
       case UHAB_ITEM_STATE_TYPE_STRING:
       {
-         osMutexWait(repository.items_mutex, osWaitForever);
-         snprintf(buf, bufsize, (fmt != NULL) ? fmt : "%s", state->value.str != NULL ? state->value.str : "null");
-         osMutexRelease(repository.items_mutex);
+         const char *str;
+
+         state_lock(state);
+         str = state_str(state);
+         snprintf(buf, bufsize, (fmt != NULL) ? fmt : "%s", str != NULL ? str : "null");
+         state_unlock(state);
       }
       break;
          
@@ -142,169 +158,212 @@ int uhab_item_state_set_value(uhab_item_state_t *state, const char *buf)
 int uhab_item_state_compare(const uhab_item_state_t *curstate, const uhab_item_state_t *newstate)
 {
    int res = -1;
+   uhab_item_state_t cur, new;
+   const uhab_item_state_t *first, *second;
    
    ASSERT(curstate != NULL);
    ASSERT(newstate != NULL);
    
-   osMutexWait(repository.items_mutex, osWaitForever);
-   
-   if (curstate->type == newstate->type)
+   state_read(curstate, &cur);
+   state_read(newstate, &new);
+
+   if (cur.type == new.type)
    {
-      switch(curstate->type)
+      switch(cur.type)
       {
          case UHAB_ITEM_STATE_TYPE_CMD:
-            res = (curstate->value.cmd == newstate->value.cmd) ? 0 : -1;
+            res = (cur.value.cmd == new.value.cmd) ? 0 : -1;
             break;
             
          case UHAB_ITEM_STATE_TYPE_NUMBER:
-            res = (curstate->value.number == newstate->value.number) ? 0 : -1;
+            res = (cur.value.number == new.value.number) ? 0 : -1;
             break;
             
          case UHAB_ITEM_STATE_TYPE_STRING:
-            if (curstate->value.str != NULL && newstate->value.str != NULL)
-               res = strcmp(curstate->value.str, newstate->value.str);
-            break;
+         {
+            const char *curstr, *newstr;
+
+            // Strings are compared under both states locks, locked in the address order
+            first = (curstate < newstate) ? curstate : newstate;
+            second = (curstate < newstate) ? newstate : curstate;
+
+            state_lock(first);
+            if (second != first)
+               state_lock(second);
+
+            if (curstate->type == UHAB_ITEM_STATE_TYPE_STRING && newstate->type == UHAB_ITEM_STATE_TYPE_STRING)
+            {
+               curstr = state_str(curstate);
+               newstr = state_str(newstate);
+
+               // Shared buffer copies are equal without compare
+               if (curstr == newstr && curstr != NULL)
+                  res = 0;
+               else if (curstr != NULL && newstr != NULL)
+                  res = strcmp(curstr, newstr);
+            }
+
+            if (second != first)
+               state_unlock(second);
+            state_unlock(first);
+         }
+         break;
             
          default:
             break;
       }
    }
 
-   osMutexRelease(repository.items_mutex);
-   
    return res;
 }
 
 /** Set item state */
 int uhab_item_state_set(uhab_item_state_t *dest, const uhab_item_state_t *src)
 {
+   int res;
+   uhab_item_state_t snap;
+
    ASSERT(dest != NULL);
    ASSERT(src != NULL);
-   
-   // Release current state
-   if (uhab_item_state_release(dest) != 0)
-      return -1;
 
-   osMutexWait(repository.items_mutex, osWaitForever);
+   if (dest == src)
+      return 0;
+
+   state_read(src, &snap);
 
-   switch(src->type)
+   if (snap.type == UHAB_ITEM_STATE_TYPE_STRING)
    {
-      case UHAB_ITEM_STATE_TYPE_STRING:
-         dest->type = UHAB_ITEM_STATE_TYPE_STRING;
-         if (src->value.str != NULL)
-         {
-            if ((dest->value.str = os_strdup(src->value.str)) == NULL)
-               throw_exception(fail);
-         }
-         break;
-         
-      default:
-         *dest = *src;
-         break;
+      // Share source string under its lock
+      state_lock(src);
+      snap.type = src->type;
+      snap.value = src->value;
+      snap.storage = src->storage;
+      res = str_retain(&snap);
+      state_unlock(src);
+
+      if (res != 0)
+         return -1;
    }
 
-   osMutexRelease(repository.items_mutex);
+   state_publish(dest, &snap);
 
    return 0;
-
-fail:
-   osMutexRelease(repository.items_mutex);
-   return -1;
 }
 
 int uhab_item_state_set_command(uhab_item_state_t *state, uhab_item_state_cmd_t cmd)
 { 
-   uhab_item_state_release(state);
-
-   osMutexWait(repository.items_mutex, osWaitForever);
-
-   state->type = UHAB_ITEM_STATE_TYPE_CMD;
-   state->value.cmd = cmd;
+   uhab_item_state_t newstate = UHAB_ITEM_STATE_INIT_CMD(cmd);
 
-   osMutexRelease(repository.items_mutex);
+   state_publish(state, &newstate);
 
    return 0;
 }
 
 int uhab_item_state_get_command(const uhab_item_state_t *state, uhab_item_state_cmd_t *cmd)
 {
-   if (state->type != UHAB_ITEM_STATE_TYPE_CMD)
+   uhab_item_state_t snap;
+
+   state_read(state, &snap);
+
+   if (snap.type != UHAB_ITEM_STATE_TYPE_CMD)
       return -1;
 
-   osMutexWait(repository.items_mutex, osWaitForever);
-   *cmd = state->value.cmd;
-   osMutexRelease(repository.items_mutex);
+   *cmd = snap.value.cmd;
    
    return 0;
 }
 
 int uhab_item_state_set_number(uhab_item_state_t *state, double number)
 { 
-   uhab_item_state_release(state);
-
-   osMutexWait(repository.items_mutex, osWaitForever);
-
-   state->type = UHAB_ITEM_STATE_TYPE_NUMBER;
-   state->value.number = number;
+   uhab_item_state_t newstate = UHAB_ITEM_STATE_INIT_NUMBER(number);
 
-   osMutexRelease(repository.items_mutex);
+   state_publish(state, &newstate);
 
    return 0;
 }
 
 int uhab_item_state_get_number(const uhab_item_state_t *state, double *number)
 {
+   uhab_item_state_t snap;
+
    ASSERT(number != NULL);
    
-   if (state->type != UHAB_ITEM_STATE_TYPE_NUMBER)
+   state_read(state, &snap);
+
+   if (snap.type != UHAB_ITEM_STATE_TYPE_NUMBER)
       return -1;
 
-   osMutexWait(repository.items_mutex, osWaitForever);
-   *number = state->value.number;
-   osMutexRelease(repository.items_mutex);
+   *number = snap.value.number;
 
    return 0;
 }
 
 int uhab_item_state_set_string(uhab_item_state_t *state, const char *str)
 { 
-   ASSERT(str != NULL);
+   uhab_item_state_t newstate = UHAB_ITEM_STATE_INIT(UHAB_ITEM_STATE_TYPE_STRING);
 
-   uhab_item_state_release(state);
-
-   osMutexWait(repository.items_mutex, osWaitForever);
+   ASSERT(str != NULL);
 
-   state->type = UHAB_ITEM_STATE_TYPE_STRING;
-   if ((state->value.str = os_strdup(str)) == NULL)
-      throw_exception(fail);
+   if (str_make(&newstate, str) != 0)
+      return -1;
 
-   osMutexRelease(repository.items_mutex);
+   state_publish(state, &newstate);
 
    return 0;
-   
-fail:   
-   osMutexRelease(repository.items_mutex);
-   return -1;
 }
 
 int uhab_item_state_get_string(const uhab_item_state_t *state, char *buf, int bufsize)
 {
-   if (state->type != UHAB_ITEM_STATE_TYPE_STRING)
-      return -1;
+   int res = -1;
+   const char *str;
+
+   state_lock(state);
+
+   if (state->type == UHAB_ITEM_STATE_TYPE_STRING)
+   {
+      str = state_str(state);
+      snprintf(buf, bufsize, "%s", str != NULL ? str : "null");
+      res = 0;
+   }
 
-   osMutexWait(repository.items_mutex, osWaitForever);
-   snprintf(buf, bufsize, "%s", state->value.str != NULL ? state->value.str : "null");
-   osMutexRelease(repository.items_mutex);
+   state_unlock(state);
    
-   return 0;
+   return res;
+}
+
+/** Get string of the state owned by caller */
+const char *uhab_item_state_str(const uhab_item_state_t *state)
+{
+   return (state->type == UHAB_ITEM_STATE_TYPE_STRING) ? state_str(state) : NULL;
 }
 
-/** Shalow item state copy */
+/** Copy item state to not initialized dest, string buffer is shared */
 int uhab_item_state_copy(uhab_item_state_t *dest, const uhab_item_state_t *src)
 {
-   osMutexWait(repository.items_mutex, osWaitForever);
-   *dest = *src;
-   osMutexRelease(repository.items_mutex);
+   int res;
+
+   state_lock(src);
+   dest->seq = 0;
+   dest->type = src->type;
+   dest->value = src->value;
+   dest->storage = src->storage;
+   res = str_retain(dest);
+   state_unlock(src);
+
+   return res;
+}
+
+/** Move item state, src string ownership is passed to the dest */
+int uhab_item_state_move(uhab_item_state_t *dest, uhab_item_state_t *src)
+{
+   ASSERT(dest != NULL);
+   ASSERT(src != NULL);
+
+   state_publish(dest, src);
+
+   src->type = UHAB_ITEM_STATE_TYPE_NONE;
+   src->storage = UHAB_ITEM_STATE_STR_REF;
+   os_memset(&src->value, 0, sizeof(src->value));
 
    return 0;
 }
@@ -314,22 +373,180 @@ int uhab_item_state_release(uhab_item_state_t *state)
 {
    ASSERT(state != NULL);
 
-   osMutexWait(repository.items_mutex, osWaitForever);
+   state_publish(state, NULL);
 
-   switch(state->type)
+   return 0;
+}
+
+/** Get item state access statistics */
+void uhab_item_state_get_stats(uhab_item_state_stats_t *st)
+{
+   st->writes = __atomic_load_n(&stats.writes, __ATOMIC_RELAXED);
+   st->lock_spins = __atomic_load_n(&stats.lock_spins, __ATOMIC_RELAXED);
+   st->read_retries = __atomic_load_n(&stats.read_retries, __ATOMIC_RELAXED);
+}
+
+/** Lock state, sequence is odd while the state is locked */
+static void state_lock(const uhab_item_state_t *state)
+{
+   uint32_t *pseq = (uint32_t *)&state->seq;
+   uint32_t seq;
+   int spins = 0;
+
+   while(1)
    {
-      case UHAB_ITEM_STATE_TYPE_STRING:
-         if (state->value.str != NULL)
-            os_free(state->value.str);
+      seq = __atomic_load_n(pseq, __ATOMIC_RELAXED);
+      if (!(seq & 1) && __atomic_compare_exchange_n(pseq, &seq, seq + 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
          break;
-         
+
+      // Other thread holds the lock, let it finish when it was preempted
+      __atomic_add_fetch(&stats.lock_spins, 1, __ATOMIC_RELAXED);
+      if (++spins % STATE_MAX_SPINS == 0)
+         osDelay(1);
+   }
+}
+
+/** Unlock state, publish new sequence */
+static void state_unlock(const uhab_item_state_t *state)
+{
+   uint32_t *pseq = (uint32_t *)&state->seq;
+
+   __atomic_store_n(pseq, *pseq + 1, __ATOMIC_RELEASE);
+}
+
+/** Read consistent snapshot of the state type and value without lock */
+static void state_read(const uhab_item_state_t *state, uhab_item_state_t *snap)
+{
+   uint32_t seq;
+   int spins = 0;
+
+   while(1)
+   {
+      seq = __atomic_load_n(&state->seq, __ATOMIC_ACQUIRE);
+      if (!(seq & 1))
+      {
+         snap->type = state->type;
+         snap->value = state->value;
+         snap->storage = state->storage;
+
+         __atomic_thread_fence(__ATOMIC_ACQUIRE);
+         if (__atomic_load_n(&state->seq, __ATOMIC_RELAXED) == seq)
+            break;
+      }
+
+      __atomic_add_fetch(&stats.read_retries, 1, __ATOMIC_RELAXED);
+      if (++spins % STATE_MAX_SPINS == 0)
+         osDelay(1);
+   }
+
+   snap->seq = seq;
+}
+
+/** Publish new state type and value (NULL clears state), previous string is released after publication */
+static void state_publish(uhab_item_state_t *state, const uhab_item_state_t *newstate)
+{
+   uhab_item_state_t oldstate;
+
+   state_lock(state);
+
+   oldstate.type = state->type;
+   oldstate.value = state->value;
+   oldstate.storage = state->storage;
+
+   if (newstate != NULL)
+   {
+      state->type = newstate->type;
+      state->value = newstate->value;
+      state->storage = newstate->storage;
+   }
+   else
+   {
+      state->type = UHAB_ITEM_STATE_TYPE_NONE;
+      state->storage = UHAB_ITEM_STATE_STR_REF;
+      os_memset(&state->value, 0, sizeof(state->value));
+   }
+
+   state_unlock(state);
+
+   __atomic_add_fetch(&stats.writes, 1, __ATOMIC_RELAXED);
+
+   str_release(&oldstate);
+}
+
+/** Get string of the string state by its storage */
+static const char *state_str(const uhab_item_state_t *state)
+{
+   switch(state->storage)
+   {
+      case UHAB_ITEM_STATE_STR_INLINE:
+         return state->value.inl;
+
+      case UHAB_ITEM_STATE_STR_SHARED:
+         return state->value.buf->str;
+
       default:
-         break;
+         return state->value.str;
+   }
+}
+
+/** Set state string, short string is stored inline, longer one in a new shared buffer */
+static int str_make(uhab_item_state_t *state, const char *str)
+{
+   int len = strlen(str);
+
+   state->type = UHAB_ITEM_STATE_TYPE_STRING;
+
+   if (len < UHAB_ITEM_STATE_INLINE_SIZE)
+   {
+      memcpy(state->value.inl, str, len + 1);
+      state->storage = UHAB_ITEM_STATE_STR_INLINE;
+   }
+   else
+   {
+      if ((state->value.buf = os_malloc(sizeof(uhab_item_state_strbuf_t) + len + 1)) == NULL)
+      {
+         TRACE_ERROR("Alloc string state");
+         return -1;
+      }
+
+      state->value.buf->refcount = 1;
+      memcpy(state->value.buf->str, str, len + 1);
+      state->storage = UHAB_ITEM_STATE_STR_SHARED;
    }
 
-   os_memset(state, 0, sizeof(uhab_item_state_t));
+   return 0;
+}
+
+/** Take reference of the copied string state, not owned string reference is stored */
+static int str_retain(uhab_item_state_t *state)
+{
+   if (state->type != UHAB_ITEM_STATE_TYPE_STRING)
+      return 0;
 
-   osMutexRelease(repository.items_mutex);
+   switch(state->storage)
+   {
+      case UHAB_ITEM_STATE_STR_SHARED:
+         __atomic_add_fetch(&state->value.buf->refcount, 1, __ATOMIC_RELAXED);
+         break;
+
+      case UHAB_ITEM_STATE_STR_REF:
+         if (state->value.str != NULL)
+            return str_make(state, state->value.str);
+         break;
+
+      default:
+         break;
+   }
 
    return 0;
 }
+
+/** Release string state reference, buffer is freed by the last reference */
+static void str_release(uhab_item_state_t *state)
+{
+   if (state->type == UHAB_ITEM_STATE_TYPE_STRING && state->storage == UHAB_ITEM_STATE_STR_SHARED)
+   {
+      if (__atomic_sub_fetch(&state->value.buf->refcount, 1, __ATOMIC_ACQ_REL) == 0)
+         os_free(state->value.buf);
+   }
+}
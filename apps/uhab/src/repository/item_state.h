@@ -5,7 +5,10 @@
 #define UHAB_ITEM_STATE_INIT(_type) {.type = _type}
 #define UHAB_ITEM_STATE_INIT_CMD(_cmd) {.type = UHAB_ITEM_STATE_TYPE_CMD, .value.cmd = _cmd}
 #define UHAB_ITEM_STATE_INIT_NUMBER(_num) {.type = UHAB_ITEM_STATE_TYPE_NUMBER, .value.number = _num}
-#define UAHB_ITEM_STATE_INIT_STRING_REF(_str) {.type = UHAB_ITEM_STATE_TYPE_STRING, .value.str = (char *)_str}
+#define UAHB_ITEM_STATE_INIT_STRING_REF(_str) {.type = UHAB_ITEM_STATE_TYPE_STRING, .value.str = (char *)_str, .storage = UHAB_ITEM_STATE_STR_REF}
+
+/** Max. length of the string stored inline in the state (including terminator) */
+#define UHAB_ITEM_STATE_INLINE_SIZE    16
 
 
 /** Item state types */
@@ -35,9 +38,31 @@ typedef enum
 } uhab_item_state_cmd_t;
 
 
+/** String state storage */
+typedef enum
+{
+   UHAB_ITEM_STATE_STR_REF,           // Reference to not owned string (source states only)
+   UHAB_ITEM_STATE_STR_INLINE,        // Short string stored in the state
+   UHAB_ITEM_STATE_STR_SHARED,        // Refcounted immutable string buffer
+
+} uhab_item_state_str_t;
+
+
+/** Refcounted immutable string buffer, shared by the states copies */
+typedef struct
+{
+   uint32_t refcount;
+   char str[];
+
+} uhab_item_state_strbuf_t;
+
+
 /** Item state */
 typedef struct uhab_item_state
 {
+   /** State sequence lock, odd while the state is written */
+   uint32_t seq;
+
    /** Item state type */
    uhab_item_state_type_t type;
    
@@ -46,9 +71,14 @@ typedef struct uhab_item_state
    {
       uhab_item_state_cmd_t cmd;         // Command value
       double number;                     // Number
-      char *str;                         // String 
+      char *str;                         // String reference
+      char inl[UHAB_ITEM_STATE_INLINE_SIZE];  // Inline short string
+      uhab_item_state_strbuf_t *buf;     // Shared string buffer
       
    } value;
+
+   /** String storage of the string state */
+   uint8_t storage;
    
 } uhab_item_state_t;
 
@@ -85,11 +115,17 @@ int uhab_item_state_set_string(uhab_item_state_t *state, const char *str);
 /** Get state string */
 int uhab_item_state_get_string(const uhab_item_state_t *state, char *buf, int bufsize);
 
+/** Get string of the state owned by caller (not shared item state), returns NULL for not string state */
+const char *uhab_item_state_str(const uhab_item_state_t *state);
+
 
 
-/** Copy item state */
+/** Copy item state to not initialized dest, string buffer is shared */
 int uhab_item_state_copy(uhab_item_state_t *dest, const uhab_item_state_t *src);
 
+/** Move item state, src string ownership is passed to the dest */
+int uhab_item_state_move(uhab_item_state_t *dest, uhab_item_state_t *src);
+
 /** Release state allocated resource */
 int uhab_item_state_release(uhab_item_state_t *state);
 
@@ -97,4 +133,17 @@ int uhab_item_state_release(uhab_item_state_t *state);
 int uhab_item_state_compare(const uhab_item_state_t *curstate, const uhab_item_state_t *newstate);
 
 
+/** Item state access statistics */
+typedef struct
+{
+   uint32_t writes;           // Published states
+   uint32_t lock_spins;       // Waits for locked state (writers and strings readers)
+   uint32_t read_retries;     // Lock-free reads repeated due to concurrent write
+
+} uhab_item_state_stats_t;
+
+/** Get item state access statistics */
+void uhab_item_state_get_stats(uhab_item_state_stats_t *stats);
+
+
 #endif // __ITEM_STATE_H
\ No newline at end of file
@@ -0,0 +1,413 @@
+/**
+ * \file persist.c         \brief uHAB persistent item state store
+ *
+ * States of the persisted items are kept in the memory mapped file of fixed size records
+ * indexed by the item id. Records keep the item name hash, so the state of the item moved
+ * to the other id by the config change is found by the hash. Changed states are only marked
+ * by the bus and written in batches by the flush thread to limit writes to the SD card.
+ */
+ 
+#include "uhab.h"
+#include <sys/mman.h>
+
+TRACE_TAG(repository_persist);
+#if !ENABLE_TRACE_REPOSITORY
+#include "trace_undef.h"
+#endif
+
+#define PERSIST_MAGIC      0x55484153     // UHAS
+#define PERSIST_VERSION    1
+
+// Prototypes:
+static void persist_thread(void *arg);
+static void flush_records(void);
+static int restore_state(uhab_item_t *item, const uhab_persist_record_t *rec);
+static void store_state(const uhab_item_t *item, const uhab_item_state_t *state, uhab_persist_record_t *rec);
+static const uhab_persist_record_t *find_record(uint32_t hash, uint32_t count, uint32_t **index);
+static int compare_records(const void *a, const void *b);
+static int compare_hash(const void *key, const void *b);
+
+// Locals:
+static const osThreadDef(PERSIST, persist_thread, CFG_PERSIST_THREAD_PRIORITY, 0, CFG_PERSIST_THREAD_STACK_SIZE);
+static int fd = -1;
+static uint8_t *map = NULL;
+static size_t map_size;
+static uhab_persist_header_t *header;
+static uhab_persist_record_t *records;
+static uint32_t *dirty = NULL;
+static int dirty_words;
+static osMutexId flush_mutex;
+static uint32_t flush_period = CFG_UHAB_PERSIST_FLUSH_PERIOD;
+static uhab_persist_stats_t stats;
+
+
+/** Open state file and restore states of the persisted items */
+int uhab_persist_init(void)
+{
+   uhab_item_id_t id;
+   uhab_item_t *item;
+   uhab_item_array_t *groups;
+   const uhab_persist_record_t *rec;
+   uint32_t *index = NULL;
+   uint32_t hash, old_count = 0;
+   struct stat st;
+   int ix, count, valid, changed;
+   char value[32];
+
+   os_memset(&stats, 0, sizeof(stats));
+
+   if (uhab_config_service_get_value(CFG_SYSTEM_BINDING_NAME, CFG_SYSTEM_CONFIG_KEY_PERSIST_FLUSH_PERIOD, value, sizeof(value)) == 0)
+      flush_period = atoi(value);
+
+   // Items in the persisted groups are persisted too, passes are repeated until nested groups are resolved
+   do
+   {
+      changed = 0;
+
+      for (id = 0; id < uhab_item_get_max_id(); id++)
+      {
+         if ((item = uhab_item_get(id)) == NULL || item->persist)
+            continue;
+
+         groups = &uhab_item_get_meta(item)->groups;
+         for (ix = 0; ix < groups->count && !item->persist; ix++)
+            item->persist = groups->items[ix]->persist;
+
+         changed |= item->persist;
+      }
+   } while (changed);
+
+   for (id = 0, count = 0; id < uhab_item_get_max_id(); id++)
+   {
+      if ((item = uhab_item_get(id)) != NULL)
+         count += item->persist;
+   }
+
+   if (count == 0)
+   {
+      TRACE("No persisted items");
+      return 0;
+   }
+
+   if ((fd = open(CFG_UHAB_PERSIST_FILENAME, O_RDWR | O_CREAT, 0644)) < 0)
+   {
+      TRACE_ERROR("Can't open state file %s", CFG_UHAB_PERSIST_FILENAME);
+      throw_exception(fail_open);
+   }
+
+   if (fstat(fd, &st) != 0)
+      throw_exception(fail_map);
+
+   map_size = sizeof(uhab_persist_header_t) + uhab_item_get_max_id() * sizeof(uhab_persist_record_t);
+
+   // File is extended to all items of the table, new records are zero filled.
+   // Larger file of more items is mapped whole, so the states of the items moved to the lower ids are found.
+   if (st.st_size < (off_t)map_size && ftruncate(fd, map_size) != 0)
+   {
+      TRACE_ERROR("Resize state file");
+      throw_exception(fail_map);
+   }
+
+   if (st.st_size > (off_t)map_size)
+      map_size = st.st_size;
+
+   if ((map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+   {
+      TRACE_ERROR("Map state file");
+      map = NULL;
+      throw_exception(fail_map);
+   }
+
+   header = (uhab_persist_header_t *)map;
+   records = (uhab_persist_record_t *)(map + sizeof(uhab_persist_header_t));
+
+   valid = (header->magic == PERSIST_MAGIC && header->version == PERSIST_VERSION && header->record_size == sizeof(uhab_persist_record_t));
+   if (!valid)
+   {
+      TRACE("State file %s is empty or not valid, states are not restored", CFG_UHAB_PERSIST_FILENAME);
+      os_memset(map, 0, map_size);
+   }
+   else
+   {
+      old_count = (map_size - sizeof(uhab_persist_header_t)) / sizeof(uhab_persist_record_t);
+      if (header->count < old_count)
+         old_count = header->count;
+   }
+
+   dirty_words = (uhab_item_get_max_id() + 31) / 32;
+   if ((dirty = os_malloc(dirty_words * sizeof(uint32_t))) == NULL)
+      throw_exception(fail_dirty);
+
+   os_memset(dirty, 0, dirty_words * sizeof(uint32_t));
+
+   // Restore states, bindings and automation are not started yet.
+   // Record at the other id than the item has now is found by the name hash, all records not at the item id
+   // and records of the other state type are rewritten by the first flush.
+   for (id = 0; id < uhab_item_get_max_id(); id++)
+   {
+      if ((item = uhab_item_get(id)) == NULL || !item->persist)
+         continue;
+
+      hash = uhab_repository_name_hash(item->name);
+
+      if (id < old_count && records[id].name_hash == hash)
+      {
+         if (restore_state(item, &records[id]) != 0)
+            uhab_persist_mark(item);
+      }
+      else
+      {
+         if (old_count > 0 && hash != 0 && (rec = find_record(hash, old_count, &index)) != NULL)
+            restore_state(item, rec);
+
+         uhab_persist_mark(item);
+      }
+   }
+
+   if (index != NULL)
+      os_free(index);
+
+   header->magic = PERSIST_MAGIC;
+   header->version = PERSIST_VERSION;
+   header->record_size = sizeof(uhab_persist_record_t);
+   header->count = uhab_item_get_max_id();
+
+   if ((flush_mutex = osMutexCreate(NULL)) == NULL)
+      throw_exception(fail_mutex);
+
+   if (osThreadCreate(osThread(PERSIST), NULL) == 0)
+   {
+      TRACE_ERROR("Start persist thread");
+      throw_exception(fail_thread);
+   }
+
+   TRACE("Persisted items: %d  restored: %d  flush period: %d ms", count, stats.restored, flush_period);
+
+   return 0;
+
+fail_thread:
+   osMutexDelete(flush_mutex);
+fail_mutex:
+   os_free(dirty);
+   dirty = NULL;
+fail_dirty:
+   munmap(map, map_size);
+   map = NULL;
+fail_map:
+   close(fd);
+   fd = -1;
+fail_open:
+   return -1;
+}
+
+/** Flush changed states and close state file */
+int uhab_persist_deinit(void)
+{
+   if (map == NULL)
+      return 0;
+
+   VERIFY(osMutexWait(flush_mutex, osWaitForever) == osOK);
+
+   flush_records();
+
+   // Marks of the following changes are ignored by the flush
+   munmap(map, map_size);
+   map = NULL;
+   close(fd);
+   fd = -1;
+
+   VERIFY(osMutexRelease(flush_mutex) == osOK);
+
+   TRACE("Persistent store closed");
+
+   return 0;
+}
+
+/** Mark persisted item state changed, written by the next flush */
+void uhab_persist_mark(const uhab_item_t *item)
+{
+   if (!item->persist || dirty == NULL || item->id >= dirty_words * 32)
+      return;
+
+   __atomic_or_fetch(&dirty[item->id / 32], 1U << (item->id % 32), __ATOMIC_RELAXED);
+}
+
+/** Write all changed states to the state file */
+int uhab_persist_flush(void)
+{
+   if (dirty == NULL)
+      return 0;
+
+   VERIFY(osMutexWait(flush_mutex, osWaitForever) == osOK);
+
+   if (map != NULL)
+      flush_records();
+
+   VERIFY(osMutexRelease(flush_mutex) == osOK);
+
+   return 0;
+}
+
+/** Get persistent store statistics */
+void uhab_persist_get_stats(uhab_persist_stats_t *pstats)
+{
+   *pstats = stats;
+}
+
+/** Flush thread */
+static void persist_thread(void *arg)
+{
+   TRACE("Persist thread is running");
+
+   while(map != NULL)
+   {
+      osDelay(flush_period);
+      uhab_persist_flush();
+   }
+}
+
+/** Write marked records and sync the file, must be called with locked flush mutex */
+static void flush_records(void)
+{
+   int ix, bit, count = 0;
+   uint32_t bits;
+   uhab_item_t *item;
+   uhab_snapshot_t *snap;
+
+   // Records are written from one snapshot version, changes are marked after they are published
+   snap = uhab_snapshot_acquire();
+
+   for (ix = 0; ix < dirty_words; ix++)
+   {
+      if ((bits = __atomic_exchange_n(&dirty[ix], 0, __ATOMIC_RELAXED)) == 0)
+         continue;
+
+      for (bit = 0; bit < 32; bit++)
+      {
+         if ((bits & (1U << bit)) != 0 && (item = uhab_item_get(ix * 32 + bit)) != NULL)
+         {
+            store_state(item, uhab_snapshot_get_state(snap, item), &records[item->id]);
+            count++;
+         }
+      }
+   }
+
+   uhab_snapshot_release(snap);
+
+   // One sync per batch of changes
+   if (count > 0 && msync(map, map_size, MS_SYNC) != 0)
+      TRACE_ERROR("Sync state file");
+
+   stats.flushes += (count > 0);
+   stats.records_written += count;
+}
+
+/** Restore item state from the record, record of the other state type than the item has is skipped */
+static int restore_state(uhab_item_t *item, const uhab_persist_record_t *rec)
+{
+   char str[UHAB_PERSIST_STR_SIZE];
+
+   if (rec->type != item->state.type)
+   {
+      TRACE("Item: %s state type %d doesn't match record type %d, not restored", item->name, item->state.type, rec->type);
+      return -1;
+   }
+
+   switch(rec->type)
+   {
+      case UHAB_ITEM_STATE_TYPE_CMD:
+         uhab_item_state_set_command(&item->state, rec->value.cmd);
+         break;
+
+      case UHAB_ITEM_STATE_TYPE_NUMBER:
+         uhab_item_state_set_number(&item->state, rec->value.number);
+         break;
+
+      case UHAB_ITEM_STATE_TYPE_STRING:
+         strlcpy(str, rec->value.str, sizeof(str));
+         uhab_item_state_set_string(&item->state, str);
+         break;
+
+      default:
+         return -1;
+   }
+
+   stats.restored++;
+
+   return 0;
+}
+
+/** Store item state to the record */
+static void store_state(const uhab_item_t *item, const uhab_item_state_t *state, uhab_persist_record_t *rec)
+{
+   uhab_item_state_t copy;
+   uhab_item_state_cmd_t cmd;
+   const char *str;
+
+   os_memset(rec, 0, sizeof(uhab_persist_record_t));
+
+   if (uhab_item_state_get_number(state, &rec->value.number) == 0)
+   {
+      rec->type = UHAB_ITEM_STATE_TYPE_NUMBER;
+   }
+   else if (uhab_item_state_get_command(state, &cmd) == 0)
+   {
+      rec->type = UHAB_ITEM_STATE_TYPE_CMD;
+      rec->value.cmd = cmd;
+   }
+   else if (uhab_item_state_copy(&copy, state) == 0)
+   {
+      if ((str = uhab_item_state_str(&copy)) != NULL && strlen(str) < UHAB_PERSIST_STR_SIZE)
+      {
+         rec->type = UHAB_ITEM_STATE_TYPE_STRING;
+         strlcpy(rec->value.str, str, sizeof(rec->value.str));
+      }
+
+      uhab_item_state_release(&copy);
+   }
+
+   rec->name_hash = uhab_repository_name_hash(item->name);
+}
+
+/**
+ * Find record of the name hash in the records of the previous file, index of the records sorted by the hash
+ * is built by the first search and released by the caller. Returns NULL if not found.
+ */
+static const uhab_persist_record_t *find_record(uint32_t hash, uint32_t count, uint32_t **index)
+{
+   uint32_t ix, *found;
+
+   if (*index == NULL)
+   {
+      if ((*index = os_malloc(count * sizeof(uint32_t))) == NULL)
+         return NULL;
+
+      for (ix = 0; ix < count; ix++)
+         (*index)[ix] = ix;
+
+      qsort(*index, count, sizeof(uint32_t), compare_records);
+   }
+
+   if ((found = bsearch(&hash, *index, count, sizeof(uint32_t), compare_hash)) == NULL)
+      return NULL;
+
+   return &records[*found];
+}
+
+/** Compare records of the index by the name hash */
+static int compare_records(const void *a, const void *b)
+{
+   uint32_t ha = records[*(const uint32_t *)a].name_hash;
+   uint32_t hb = records[*(const uint32_t *)b].name_hash;
+
+   return (ha > hb) - (ha < hb);
+}
+
+/** Compare name hash with the record of the index */
+static int compare_hash(const void *key, const void *b)
+{
+   uint32_t ha = *(const uint32_t *)key;
+   uint32_t hb = records[*(const uint32_t *)b].name_hash;
+
+   return (ha > hb) - (ha < hb);
+}
@@ -0,0 +1,74 @@
+/**
+ * \file persist.h         \brief uHAB persistent item state store
+ */
+
+#ifndef __UHAB_PERSIST_H
+#define __UHAB_PERSIST_H
+
+#include "item.h"
+
+
+/** Size of the persisted string state including terminator, longer strings are not persisted */
+#define UHAB_PERSIST_STR_SIZE       24
+
+
+/** State file header */
+typedef struct
+{
+   uint32_t magic;
+   uint16_t version;
+   uint16_t record_size;
+   uint32_t count;
+   uint32_t reserved;
+
+} uhab_persist_header_t;
+
+
+/** State file record, record index is the item id */
+typedef struct
+{
+   /** Item name hash, record of the other item (changed config) is not restored */
+   uint32_t name_hash;
+
+   /** State type, NONE for not stored state */
+   uint8_t type;
+   uint8_t reserved[3];
+
+   union
+   {
+      double number;
+      uint32_t cmd;
+      char str[UHAB_PERSIST_STR_SIZE];
+
+   } value;
+
+} uhab_persist_record_t;
+
+
+/** Persistent store statistics */
+typedef struct
+{
+   uint32_t restored;
+   uint32_t flushes;
+   uint32_t records_written;
+
+} uhab_persist_stats_t;
+
+
+/** Open state file and restore states of the persisted items */
+int uhab_persist_init(void);
+
+/** Flush changed states and close state file */
+int uhab_persist_deinit(void);
+
+/** Mark persisted item state changed, written by the next flush */
+void uhab_persist_mark(const uhab_item_t *item);
+
+/** Write all changed states to the state file */
+int uhab_persist_flush(void);
+
+/** Get persistent store statistics */
+void uhab_persist_get_stats(uhab_persist_stats_t *stats);
+
+
+#endif // __UHAB_PERSIST_H
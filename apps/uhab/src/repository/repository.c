@@ -9,66 +9,67 @@ TRACE_TAG(repository);
 #include "trace_undef.h"
 #endif
 
+#if (CFG_UHAB_REPOSITORY_INDEX_SIZE & (CFG_UHAB_REPOSITORY_INDEX_SIZE - 1)) != 0
+#error "Repository index size must be power of 2"
+#endif
+
+// Prototypes:
+static uint32_t index_find_slot(uhab_repository_t *repo, const char *name);
+static int index_grow(uhab_repository_t *repo);
+static int array_append(uhab_item_array_t *array, uhab_item_t *item);
+static int index_items(uhab_repository_t *repo);
+static int tag_find(uhab_repository_t *repo, const char *name, int *pos);
+static uhab_repository_tag_t *tag_insert(uhab_repository_t *repo, const char *name);
 
 /** Open repository */
 int uhab_repository_init(uhab_repository_t *repo)
 {
    char *pp;
    uhab_item_t *item;
-   DIR *d = NULL;
-   struct dirent *dir;
    char txt[512];
 
    memset(repo, 0, sizeof(uhab_repository_t));
-   LIST_STRUCT_INIT(repo, items);
-
-   if ((repo->items_mutex = osMutexCreate(NULL)) == NULL)
-      throw_exception(fail);
+   uhab_arena_init(&repo->arena, "items");
 
    // Add default system items
    if (repository_add_new_item(repo, CFG_UHAB_SYSTEM_ITEM_NAME, UHAB_ITEM_TYPE_SYSTEM) == NULL)
       throw_exception(fail);
 
-   // List files
-   if ((d = opendir(CFG_UHAB_ITEMS_CFG_DIR)) == NULL)
+   // Load config files
+   if (uhab_config_items_load(CFG_UHAB_ITEMS_CFG_DIR, repo) != 0)
    {
-      TRACE_ERROR("Can't open dir %s", CFG_UHAB_ITEMS_CFG_DIR);
-      return -1;
+      TRACE_ERROR("Load items config");
+      throw_exception(fail);
    }
 
-   // Load config
-   while ((dir = readdir(d)) != NULL)
+   // Index items by tags and types for the filtered queries
+   if (index_items(repo) != 0)
    {
-      if (strstr(dir->d_name, ".items") != NULL)
-      {
-         snprintf(txt, sizeof(txt), "%s/%s", CFG_UHAB_ITEMS_CFG_DIR, dir->d_name);
-         if (uhab_config_items_load(txt, repo) != 0)
-         {
-            TRACE_ERROR("Load items file %s", txt);
-            throw_exception(fail);
-         }
-      }
+      TRACE_ERROR("Index repository items");
+      throw_exception(fail);
    }
 
-   for (item = list_head(repo->items); item != NULL; item = list_item_next(item))
+   for (item = uhab_item_first(); item != NULL; item = uhab_item_next(item))
    {
-      if (item->binding.config != NULL)
+      const char *config = uhab_item_get_meta(item)->binding_config;
+
+      if (config != NULL)
       {
          // Get binding name from config
-         if ((pp = strchr(item->binding.config, '=')) == NULL)
+         if ((pp = strchr(config, '=')) == NULL)
          {
-            TRACE_ERROR("Not specified binding name in config '%s'", item->binding.config);
+            TRACE_ERROR("Not specified binding name in config '%s'", config);
             throw_exception(fail);
          }
 
-         if (pp - item->binding.config > sizeof(txt))
+         if (pp - config > sizeof(txt))
          {
             TRACE_ERROR("Binding name length overflow");
             throw_exception(fail);
          }
 
-         strncpy(txt, item->binding.config, pp - item->binding.config);
-         txt[pp - item->binding.config] = '\0';
+         strncpy(txt, config, pp - config);
+         txt[pp - config] = '\0';
 
          if ((item->binding.protocol = uhab_binding_get_by_name(txt)) == NULL)
          {
@@ -77,7 +78,7 @@ int uhab_repository_init(uhab_repository_t *repo)
          }
 
          // Configure bindings
-         if (item->binding.protocol->configure(item, item->binding.config) != 0)
+         if (item->binding.protocol->configure(item, config) != 0)
          {
             TRACE_ERROR("Configure item: %s binding to %s", item->name, item->binding.protocol->name);
             throw_exception(fail);
@@ -85,26 +86,77 @@ int uhab_repository_init(uhab_repository_t *repo)
       }
    }
 
-   closedir(d);
-   TRACE("Repository items count: %d", uhab_repository_get_items_count(repo));
+   // Restore persisted states before bindings and automation are started
+   if (uhab_persist_init() != 0)
+      TRACE_ERROR("Persistent store init failed, states are not persisted");
+
+   if (uhab_history_init() != 0)
+      TRACE_ERROR("History store init failed, history is not recorded");
+
+   // Compute initial group aggregates
+   for (item = uhab_item_first(); item != NULL; item = uhab_item_next(item))
+   {
+      if (uhab_item_get_meta(item)->aggregate != NULL && uhab_group_aggregate_init(item) != 0)
+      {
+         TRACE_ERROR("Init group: %s aggregate", item->name);
+         throw_exception(fail);
+      }
+   }
+
+   // Readers get consistent view of the states from the first snapshot version
+   if (uhab_snapshot_init() != 0)
+   {
+      TRACE_ERROR("Init repository snapshot");
+      throw_exception(fail);
+   }
+
+   TRACE("Repository items count: %d  config arena used: %d", uhab_repository_get_items_count(repo), repo->arena.used);
 
    return 0;
 
 fail:
-   if (d != NULL)
-      closedir(d);
    return -1;
 }
 
 /** Close repository */
 int uhab_repository_deinit(uhab_repository_t *repo)
 {
-   if (repo->items_mutex != NULL)
+   int ix;
+
+   uhab_persist_deinit();
+   uhab_history_deinit();
+   uhab_snapshot_deinit();
+
+   for (ix = 0; ix < repo->tags_count; ix++)
+   {
+      os_free(repo->tags[ix].name);
+      if (repo->tags[ix].items.items != NULL)
+         os_free(repo->tags[ix].items.items);
+   }
+
+   if (repo->tags != NULL)
+   {
+      os_free(repo->tags);
+      repo->tags = NULL;
+      repo->tags_count = repo->tags_size = 0;
+   }
+
+   for (ix = 0; ix < UHAB_ITEM_TYPE_COUNT; ix++)
+   {
+      if (repo->types[ix].items != NULL)
+         os_free(repo->types[ix].items);
+      os_memset(&repo->types[ix], 0, sizeof(uhab_item_array_t));
+   }
+
+   if (repo->index != NULL)
    {
-      osMutexDelete(repo->items_mutex);
-      repo->items_mutex = NULL;
+      os_free(repo->index);
+      repo->index = NULL;
+      repo->index_size = 0;
    }
 
+   uhab_arena_free(&repo->arena);
+
    TRACE("Repository closed");
    return 0;
 }
@@ -112,41 +164,32 @@ int uhab_repository_deinit(uhab_repository_t *repo)
 /** Get item by name from repository */
 uhab_item_t *uhab_repository_get_item(uhab_repository_t *repo, const char *name)
 {
-   uhab_item_t *item;
-
-   for (item = list_head(repo->items); item != NULL; item = list_item_next(item))
-   {
-      if (!strcmp(item->name, name))
-         break;
-   }
+   if (repo->index == NULL)
+      return NULL;
 
-   return item;
+   return repo->index[index_find_slot(repo, name)];
 }
 
 /** Get owned child item by name */
 uhab_item_t *uhab_repository_get_child_item(uhab_item_t *parent, const char *name)
 {
-   uhab_child_item_t *li;
+   int ix;
+   uhab_item_array_t *children = &uhab_item_get_meta(parent)->children;
 
-   for (li = list_head(parent->child_items); li != NULL; li = list_item_next(li))
+   for (ix = 0; ix < children->count; ix++)
    {
-      if (!strcmp(li->item->name, name))
-         break;
+      if (!strcmp(children->items[ix]->name, name))
+         return children->items[ix];
    }
 
-   return (li != NULL) ? li->item : NULL;
+   return NULL;
 }
 
 
 /** Get repository items count */
 int uhab_repository_get_items_count(uhab_repository_t *repo)
 {
-   int count = 0;
-   uhab_item_t *item;
-
-   for (item = list_head(repo->items); item != NULL; item = list_item_next(item), count++);
-
-   return count;
+   return repo->items_count;
 }
 
 /** Add item to repository */
@@ -161,7 +204,51 @@ int uhab_repository_add_item(uhab_repository_t *repo, uhab_item_t *item)
       return -1;
    }
 
-   list_add(repo->items, item);
+   // Keep index load factor under 3/4
+   if ((repo->items_count + 1) * 4 > repo->index_size * 3 && index_grow(repo) != 0)
+   {
+      TRACE_ERROR("Alloc items index");
+      return -1;
+   }
+
+   repo->index[index_find_slot(repo, item->name)] = item;
+   repo->items_count++;
+
+   return 0;
+}
+
+/** Remove item from repository */
+int uhab_repository_remove_item(uhab_repository_t *repo, uhab_item_t *item)
+{
+   uint32_t slot, next, home;
+   uint32_t mask = repo->index_size - 1;
+
+   ASSERT(item != NULL);
+
+   if (uhab_repository_get_item(repo, item->name) != item)
+   {
+      TRACE_ERROR("Item '%s' not found in the repository", item->name);
+      return -1;
+   }
+
+   slot = index_find_slot(repo, item->name);
+   repo->index[slot] = NULL;
+
+   // Shift back following items of the probe sequence (no tombstones)
+   for (next = (slot + 1) & mask; repo->index[next] != NULL; next = (next + 1) & mask)
+   {
+      home = uhab_repository_name_hash(repo->index[next]->name) & mask;
+
+      // Move item when its home slot is not between the hole and its position
+      if (((next - home) & mask) >= ((next - slot) & mask))
+      {
+         repo->index[slot] = repo->index[next];
+         repo->index[next] = NULL;
+         slot = next;
+      }
+   }
+
+   repo->items_count--;
 
    return 0;
 }
@@ -195,29 +282,280 @@ fail:
    return NULL;
 }
 
+/** Get items with the tag, NULL when no item has the tag */
+const uhab_item_array_t *uhab_repository_get_tagged_items(uhab_repository_t *repo, const char *tag)
+{
+   int pos;
+
+   return (tag_find(repo, tag, &pos) == 0) ? &repo->tags[pos].items : NULL;
+}
+
+/** Check item has the tag */
+int uhab_repository_item_has_tag(const uhab_item_t *item, const char *tag)
+{
+   const char *pp;
+   char name[CFG_UHAB_REPOSITORY_TAG_SIZE];
+
+   for (pp = uhab_item_get_meta(item)->tag; pp != NULL && (pp = uhab_repository_next_tag(pp, name, sizeof(name))) != NULL;)
+   {
+      if (!strcmp(name, tag))
+         return 1;
+   }
+
+   return 0;
+}
+
+/** Get next tag of the comma separated tags to the buffer, returns position after the tag or NULL at the end */
+const char *uhab_repository_next_tag(const char *tags, char *buf, int bufsize)
+{
+   const char *end;
+   int len;
+
+   while (*tags == ' ' || *tags == ',')
+      tags++;
+
+   if (*tags == '\0')
+      return NULL;
+
+   for (end = tags; *end != '\0' && *end != ','; end++);
+   for (len = end - tags; len > 0 && tags[len - 1] == ' '; len--);
+
+   if (len >= bufsize)
+      len = bufsize - 1;
+
+   memcpy(buf, tags, len);
+   buf[len] = '\0';
+
+   return end;
+}
+
 /** Add child item to parent item */
-uhab_child_item_t *uhab_repository_add_child_item(uhab_item_t *parent, uhab_item_t *item)
+int uhab_repository_add_child_item(uhab_item_t *parent, uhab_item_t *item)
 {
-   uhab_child_item_t *child_item;
+   int ix;
+   uhab_item_array_t *children, *groups;
 
    ASSERT(item != NULL);
    ASSERT(item->name != NULL);
 
-   if (uhab_repository_get_child_item(parent, item->name) != NULL)
+   children = &uhab_item_get_meta(parent)->children;
+   groups = &uhab_item_get_meta(item)->groups;
+
+   // Duplicity is checked in the (short) groups array of the item
+   for (ix = 0; ix < groups->count; ix++)
    {
-      TRACE_ERROR("Item: %s already exists in %s", item->name, parent->name);
-      return NULL;
+      if (groups->items[ix] == parent)
+      {
+         TRACE_ERROR("Item: %s already exists in %s", item->name, parent->name);
+         return -1;
+      }
    }
 
-   if ((child_item = os_malloc(sizeof(uhab_child_item_t))) == NULL)
+   if (array_append(children, item) != 0)
+      throw_exception(fail_alloc);
+
+   if (array_append(groups, parent) != 0)
+   {
+      children->count--;
+      throw_exception(fail_alloc);
+   }
+
+   return 0;
+
+fail_alloc:
+   TRACE_ERROR("Alloc child item: %s", item->name);
+   return -1;
+}
+
+/** Append item to items array, array capacity is doubled when full up to the 16 bit count limit */
+static int array_append(uhab_item_array_t *array, uhab_item_t *item)
+{
+   uint32_t size;
+   uhab_item_t **items;
+
+   if (array->count == array->size)
+   {
+      if (array->size == UHAB_ITEM_ARRAY_MAX_SIZE)
+      {
+         TRACE_ERROR("Max. %d items of the array exceeded", UHAB_ITEM_ARRAY_MAX_SIZE);
+         return -1;
+      }
+
+      size = (array->size > 0) ? array->size * 2 : 4;
+      if (size > UHAB_ITEM_ARRAY_MAX_SIZE)
+         size = UHAB_ITEM_ARRAY_MAX_SIZE;
+
+      if ((items = os_malloc(size * sizeof(uhab_item_t *))) == NULL)
+         return -1;
+
+      if (array->items != NULL)
+      {
+         memcpy(items, array->items, array->count * sizeof(uhab_item_t *));
+         os_free(array->items);
+      }
+
+      array->items = items;
+      array->size = size;
+   }
+
+   array->items[array->count++] = item;
+
+   return 0;
+}
+
+/** Build tags and types index of the loaded items */
+static int index_items(uhab_repository_t *repo)
+{
+   const char *pp;
+   uhab_item_t *item;
+   uhab_repository_tag_t *tag;
+   char name[CFG_UHAB_REPOSITORY_TAG_SIZE];
+
+   for (item = uhab_item_first(); item != NULL; item = uhab_item_next(item))
+   {
+      if (array_append(&repo->types[item->type], item) != 0)
+         throw_exception(fail_alloc);
+
+      for (pp = uhab_item_get_meta(item)->tag; pp != NULL && (pp = uhab_repository_next_tag(pp, name, sizeof(name))) != NULL;)
+      {
+         if ((tag = tag_insert(repo, name)) == NULL)
+            throw_exception(fail_alloc);
+
+         // Tag repeated in the item tags is indexed once
+         if (tag->items.count > 0 && tag->items.items[tag->items.count - 1] == item)
+            continue;
+
+         if (array_append(&tag->items, item) != 0)
+            throw_exception(fail_alloc);
+      }
+   }
+
+   TRACE("Indexed tags: %d", repo->tags_count);
+
+   return 0;
+
+fail_alloc:
+   TRACE_ERROR("Alloc item: %s index", item->name);
+   return -1;
+}
+
+/** Find tag by binary search, returns -1 and insert position when not found */
+static int tag_find(uhab_repository_t *repo, const char *name, int *pos)
+{
+   int lo = 0, hi = repo->tags_count, mid, res;
+
+   while (lo < hi)
+   {
+      mid = (lo + hi) / 2;
+
+      if ((res = strcmp(repo->tags[mid].name, name)) == 0)
+      {
+         *pos = mid;
+         return 0;
+      }
+
+      if (res < 0)
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+
+   *pos = lo;
+   return -1;
+}
+
+/** Get tag entry, new tag is inserted to keep the index sorted */
+static uhab_repository_tag_t *tag_insert(uhab_repository_t *repo, const char *name)
+{
+   int pos, size;
+   uhab_repository_tag_t *tags;
+
+   if (tag_find(repo, name, &pos) == 0)
+      return &repo->tags[pos];
+
+   if (repo->tags_count == repo->tags_size)
+   {
+      size = (repo->tags_size > 0) ? repo->tags_size * 2 : 16;
+
+      if ((tags = os_malloc(size * sizeof(uhab_repository_tag_t))) == NULL)
+         return NULL;
+
+      if (repo->tags != NULL)
+      {
+         memcpy(tags, repo->tags, repo->tags_count * sizeof(uhab_repository_tag_t));
+         os_free(repo->tags);
+      }
+
+      repo->tags = tags;
+      repo->tags_size = size;
+   }
+
+   memmove(&repo->tags[pos + 1], &repo->tags[pos], (repo->tags_count - pos) * sizeof(uhab_repository_tag_t));
+   os_memset(&repo->tags[pos], 0, sizeof(uhab_repository_tag_t));
+
+   if ((repo->tags[pos].name = os_strdup(name)) == NULL)
    {
-      TRACE_ERROR("Alloc child item: %s", item->name);
+      memmove(&repo->tags[pos], &repo->tags[pos + 1], (repo->tags_count - pos) * sizeof(uhab_repository_tag_t));
       return NULL;
    }
 
-   memset(child_item, 0, sizeof(uhab_child_item_t));
-   child_item->item = item;
-   list_add(parent->child_items, child_item);
+   repo->tags_count++;
+
+   return &repo->tags[pos];
+}
+
+/** Item name hash (FNV-1a) */
+uint32_t uhab_repository_name_hash(const char *name)
+{
+   uint32_t hash = 2166136261U;
 
-   return child_item;
+   while (*name != '\0')
+   {
+      hash ^= (uint8_t)*name++;
+      hash *= 16777619U;
+   }
+
+   return hash;
+}
+
+/** Find index slot of the item name, returns slot of the item or empty slot */
+static uint32_t index_find_slot(uhab_repository_t *repo, const char *name)
+{
+   uint32_t mask = repo->index_size - 1;
+   uint32_t slot = uhab_repository_name_hash(name) & mask;
+
+   while (repo->index[slot] != NULL && strcmp(repo->index[slot]->name, name))
+      slot = (slot + 1) & mask;
+
+   return slot;
+}
+
+/** Double index size and rehash items */
+static int index_grow(uhab_repository_t *repo)
+{
+   uint32_t ix, size;
+   uhab_item_t **old_index = repo->index;
+   uint32_t old_size = repo->index_size;
+
+   size = (old_size > 0) ? old_size * 2 : CFG_UHAB_REPOSITORY_INDEX_SIZE;
+
+   if ((repo->index = os_malloc(size * sizeof(uhab_item_t *))) == NULL)
+   {
+      repo->index = old_index;
+      return -1;
+   }
+
+   os_memset(repo->index, 0, size * sizeof(uhab_item_t *));
+   repo->index_size = size;
+
+   for (ix = 0; ix < old_size; ix++)
+   {
+      if (old_index[ix] != NULL)
+         repo->index[index_find_slot(repo, old_index[ix]->name)] = old_index[ix];
+   }
+
+   if (old_index != NULL)
+      os_free(old_index);
+
+   return 0;
 }
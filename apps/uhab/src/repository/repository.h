@@ -6,16 +6,41 @@
 #define __UHAB_REPOSITORY_H
 
 #include "item.h" 
+#include "group.h"
+#include "persist.h"
+#include "history.h"
+#include "snapshot.h"
+
+
+/** Tag index entry, items with the tag */
+typedef struct
+{
+   char *name;
+   uhab_item_array_t items;
+
+} uhab_repository_tag_t;
 
 
 /** UHAB repository */
 typedef struct
 {  
-   /** Items list */
-   LIST_STRUCT(items);
-   
-   /** Access items mutex */
-   osMutexId items_mutex;
+   /** Items name hash index (open addressing, linear probing), size is power of 2 */
+   uhab_item_t **index;
+   uint32_t index_size;
+
+   /** Items count */
+   int items_count;
+
+   /** Tags index sorted by the tag name, built at load time */
+   uhab_repository_tag_t *tags;
+   int tags_count;
+   int tags_size;
+
+   /** Items by the item type, built at load time */
+   uhab_item_array_t types[UHAB_ITEM_TYPE_COUNT];
+
+   /** Items config strings */
+   uhab_arena_t arena;
    
 } uhab_repository_t;
 
@@ -28,9 +53,6 @@ int uhab_repository_deinit(uhab_repository_t *repo);
 /** Get item by name from repository */
 uhab_item_t *uhab_repository_get_item(uhab_repository_t *repo, const char *name);
 
-/** Get items list pointer */
-#define uhab_repository_get_items(_repo) ((_repo)->items)
-
 /** Get repository items count */
 int uhab_repository_get_items_count(uhab_repository_t *repo);
 
@@ -40,10 +62,32 @@ uhab_item_t *uhab_repository_get_child_item(uhab_item_t *parent, const char *nam
 /** Add item to repository */
 int uhab_repository_add_item(uhab_repository_t *repo, uhab_item_t *item);
 
+/** Remove item from repository */
+int uhab_repository_remove_item(uhab_repository_t *repo, uhab_item_t *item);
+
 /** Add new item to repository */
 uhab_item_t *repository_add_new_item(uhab_repository_t *repo, const char *name, uhab_item_type_t type);
 
+/** Item name hash */
+uint32_t uhab_repository_name_hash(const char *name);
+
 /** Add child item to parent item */
-uhab_child_item_t *uhab_repository_add_child_item(uhab_item_t *parent, uhab_item_t *item);
+int uhab_repository_add_child_item(uhab_item_t *parent, uhab_item_t *item);
+
+/** Get items with the tag, NULL when no item has the tag */
+const uhab_item_array_t *uhab_repository_get_tagged_items(uhab_repository_t *repo, const char *tag);
+
+/** Get items of the type */
+#define uhab_repository_get_typed_items(_repo, _type) (&(_repo)->types[(_type)])
+
+/** Check item has the tag */
+int uhab_repository_item_has_tag(const uhab_item_t *item, const char *tag);
+
+/** Get next tag of the comma separated tags to the buffer, returns position after the tag or NULL at the end */
+const char *uhab_repository_next_tag(const char *tags, char *buf, int bufsize);
+
+/** Get active child item of the list group */
+#define uhab_repository_get_active_child(_parent) \
+   (((_parent)->active_child >= 0) ? uhab_item_get_meta(_parent)->children.items[(_parent)->active_child] : NULL)
 
 #endif // __UHAB_REPOSITORY_H
\ No newline at end of file
@@ -0,0 +1,274 @@
+/**
+ * \file snapshot.c        \brief uHAB repository state snapshots
+ *
+ * Readers take the current snapshot version in O(1) and keep it until they are done, the bus never
+ * waits for them. New version is built by the bus after each drain or batch, only the chunks with
+ * changed items are copied, the others are shared with the previous version. Version is freed
+ * by its last reader. When a publish fails, the current version is stale and readers get the live
+ * states until the next publish rebuilds the whole version.
+ */
+
+#include "uhab.h"
+
+TRACE_TAG(repository_snapshot);
+#if !ENABLE_TRACE_REPOSITORY
+#include "trace_undef.h"
+#endif
+
+// Prototypes:
+static uhab_snapshot_chunk_t *alloc_chunk(uhab_item_id_t base, const uhab_snapshot_chunk_t *src, uint32_t version);
+static void release_chunk(uhab_snapshot_chunk_t *chunk);
+static void mark_stale(void);
+
+// Locals:
+static uhab_snapshot_t *current = NULL;
+static uint8_t current_lock = 0;
+static uint8_t current_stale = 0;
+static osMutexId publish_mutex = NULL;
+static uhab_snapshot_stats_t stats;
+
+
+/** Publish first snapshot version of all item states */
+int uhab_snapshot_init(void)
+{
+   os_memset(&stats, 0, sizeof(stats));
+
+   if ((publish_mutex = osMutexCreate(NULL)) == NULL)
+   {
+      TRACE_ERROR("Create publish mutex");
+      return -1;
+   }
+
+   if (uhab_snapshot_publish(NULL, 0) != 0)
+   {
+      TRACE_ERROR("Publish first snapshot");
+      osMutexDelete(publish_mutex);
+      publish_mutex = NULL;
+      return -1;
+   }
+
+   return 0;
+}
+
+/** Release current snapshot version */
+int uhab_snapshot_deinit(void)
+{
+   uhab_snapshot_t *snap;
+
+   if (publish_mutex == NULL)
+      return 0;
+
+   VERIFY(osMutexWait(publish_mutex, osWaitForever) == osOK);
+
+   while (__atomic_test_and_set(&current_lock, __ATOMIC_ACQUIRE));
+   snap = current;
+   current = NULL;
+   __atomic_clear(&current_lock, __ATOMIC_RELEASE);
+
+   VERIFY(osMutexRelease(publish_mutex) == osOK);
+
+   // Readers holding the last version free it
+   if (snap != NULL)
+      uhab_snapshot_release(snap);
+
+   return 0;
+}
+
+/** Get current snapshot version, it has to be released by uhab_snapshot_release() */
+uhab_snapshot_t *uhab_snapshot_acquire(void)
+{
+   uhab_snapshot_t *snap;
+
+   // Reference is taken before publisher drops its reference to the replaced version
+   while (__atomic_test_and_set(&current_lock, __ATOMIC_ACQUIRE));
+
+   // Stale version misses some changes, readers get the live states
+   if ((snap = current) != NULL && !current_stale)
+      __atomic_add_fetch(&snap->refcount, 1, __ATOMIC_RELAXED);
+   else
+      snap = NULL;
+
+   __atomic_clear(&current_lock, __ATOMIC_RELEASE);
+
+   return snap;
+}
+
+/** Release snapshot, last reference frees the version */
+void uhab_snapshot_release(uhab_snapshot_t *snap)
+{
+   int ix;
+
+   if (snap == NULL || __atomic_sub_fetch(&snap->refcount, 1, __ATOMIC_ACQ_REL) != 0)
+      return;
+
+   for (ix = 0; ix < (snap->count + CFG_UHAB_ITEMS_CHUNK_SIZE - 1) / CFG_UHAB_ITEMS_CHUNK_SIZE; ix++)
+      release_chunk(snap->chunks[ix]);
+
+   os_free(snap);
+   __atomic_sub_fetch(&stats.live, 1, __ATOMIC_RELAXED);
+}
+
+/** Publish new snapshot version with the current states of the changed items, stale version is rebuilt from all states */
+int uhab_snapshot_publish(uhab_item_t * const items[], int count)
+{
+   int ix, nchunks, oldchunks;
+   uhab_snapshot_t *snap, *old;
+   uhab_snapshot_chunk_t *chunk;
+   uhab_item_state_t *state;
+
+   VERIFY(osMutexWait(publish_mutex, osWaitForever) == osOK);
+
+   // Only the publisher replaces current version, it is read without lock here
+   old = current;
+   oldchunks = (old != NULL && !current_stale) ? (old->count + CFG_UHAB_ITEMS_CHUNK_SIZE - 1) / CFG_UHAB_ITEMS_CHUNK_SIZE : 0;
+   nchunks = (uhab_item_get_max_id() + CFG_UHAB_ITEMS_CHUNK_SIZE - 1) / CFG_UHAB_ITEMS_CHUNK_SIZE;
+
+   if ((snap = os_malloc(sizeof(uhab_snapshot_t) + nchunks * sizeof(uhab_snapshot_chunk_t *))) == NULL)
+   {
+      TRACE_ERROR("Alloc snapshot");
+      throw_exception(fail);
+   }
+
+   snap->refcount = 1;
+   snap->version = (old != NULL) ? old->version + 1 : 1;
+   snap->count = uhab_item_get_max_id();
+   __atomic_add_fetch(&stats.live, 1, __ATOMIC_RELAXED);
+
+   // Share chunks of the previous version, chunks of the new items are taken from the live states
+   for (ix = 0; ix < nchunks; ix++)
+   {
+      if (ix < oldchunks)
+      {
+         snap->chunks[ix] = old->chunks[ix];
+         __atomic_add_fetch(&snap->chunks[ix]->refcount, 1, __ATOMIC_RELAXED);
+      }
+      else if ((snap->chunks[ix] = alloc_chunk(ix * CFG_UHAB_ITEMS_CHUNK_SIZE, NULL, snap->version)) == NULL)
+      {
+         throw_exception(fail_chunk);
+      }
+   }
+
+   for (ix = 0; ix < count; ix++)
+   {
+      chunk = snap->chunks[items[ix]->id / CFG_UHAB_ITEMS_CHUNK_SIZE];
+
+      // Shared chunk is copied on the first change in this version
+      if (chunk->version != snap->version)
+      {
+         if ((chunk = alloc_chunk(items[ix]->id - items[ix]->id % CFG_UHAB_ITEMS_CHUNK_SIZE, chunk, snap->version)) == NULL)
+            throw_exception(fail_copy);
+
+         release_chunk(snap->chunks[items[ix]->id / CFG_UHAB_ITEMS_CHUNK_SIZE]);
+         snap->chunks[items[ix]->id / CFG_UHAB_ITEMS_CHUNK_SIZE] = chunk;
+         stats.chunks_copied++;
+      }
+
+      state = &chunk->states[items[ix]->id % CFG_UHAB_ITEMS_CHUNK_SIZE];
+      uhab_item_state_release(state);
+
+      if (uhab_item_state_copy(state, &items[ix]->state) != 0)
+         os_memset(state, 0, sizeof(uhab_item_state_t));
+   }
+
+   // Replace current version, previous version lives until its readers release it
+   while (__atomic_test_and_set(&current_lock, __ATOMIC_ACQUIRE));
+   current = snap;
+   current_stale = 0;
+   __atomic_clear(&current_lock, __ATOMIC_RELEASE);
+
+   stats.version = snap->version;
+
+   VERIFY(osMutexRelease(publish_mutex) == osOK);
+
+   uhab_snapshot_release(old);
+
+   return 0;
+
+fail_copy:
+   mark_stale();
+   VERIFY(osMutexRelease(publish_mutex) == osOK);
+   uhab_snapshot_release(snap);
+   return -1;
+
+fail_chunk:
+   // Chunks are taken in order, the rest of the table is not filled
+   while (--ix >= 0)
+      release_chunk(snap->chunks[ix]);
+   os_free(snap);
+   __atomic_sub_fetch(&stats.live, 1, __ATOMIC_RELAXED);
+fail:
+   mark_stale();
+   VERIFY(osMutexRelease(publish_mutex) == osOK);
+   return -1;
+}
+
+/** Get item state of the snapshot, live item state is returned without snapshot */
+const uhab_item_state_t *uhab_snapshot_get_state(const uhab_snapshot_t *snap, const uhab_item_t *item)
+{
+   if (snap == NULL || item->id >= snap->count)
+      return &item->state;
+
+   return &snap->chunks[item->id / CFG_UHAB_ITEMS_CHUNK_SIZE]->states[item->id % CFG_UHAB_ITEMS_CHUNK_SIZE];
+}
+
+/** Get snapshots statistics */
+void uhab_snapshot_get_stats(uhab_snapshot_stats_t *pstats)
+{
+   *pstats = stats;
+}
+
+/** Alloc chunk of states copied from the source chunk or from the live item states */
+static uhab_snapshot_chunk_t *alloc_chunk(uhab_item_id_t base, const uhab_snapshot_chunk_t *src, uint32_t version)
+{
+   int ix;
+   uhab_item_t *item;
+   uhab_snapshot_chunk_t *chunk;
+
+   if ((chunk = os_malloc(sizeof(uhab_snapshot_chunk_t))) == NULL)
+   {
+      TRACE_ERROR("Alloc snapshot chunk");
+      return NULL;
+   }
+
+   os_memset(chunk, 0, sizeof(uhab_snapshot_chunk_t));
+   chunk->refcount = 1;
+   chunk->version = version;
+
+   for (ix = 0; ix < CFG_UHAB_ITEMS_CHUNK_SIZE; ix++)
+   {
+      if (src != NULL)
+      {
+         uhab_item_state_copy(&chunk->states[ix], &src->states[ix]);
+      }
+      else if (base + ix < uhab_item_get_max_id() && (item = uhab_item_get(base + ix)) != NULL)
+      {
+         uhab_item_state_copy(&chunk->states[ix], &item->state);
+      }
+   }
+
+   return chunk;
+}
+
+/** Release chunk reference, last reference drops its string states */
+static void release_chunk(uhab_snapshot_chunk_t *chunk)
+{
+   int ix;
+
+   if (__atomic_sub_fetch(&chunk->refcount, 1, __ATOMIC_ACQ_REL) != 0)
+      return;
+
+   for (ix = 0; ix < CFG_UHAB_ITEMS_CHUNK_SIZE; ix++)
+      uhab_item_state_release(&chunk->states[ix]);
+
+   os_free(chunk);
+}
+
+/** Mark current version stale after failed publish, must be called with locked publish mutex */
+static void mark_stale(void)
+{
+   while (__atomic_test_and_set(&current_lock, __ATOMIC_ACQUIRE));
+   current_stale = 1;
+   __atomic_clear(&current_lock, __ATOMIC_RELEASE);
+
+   stats.failed++;
+}
@@ -0,0 +1,73 @@
+/**
+ * \file snapshot.h        \brief uHAB repository state snapshots
+ */
+
+#ifndef __UHAB_SNAPSHOT_H
+#define __UHAB_SNAPSHOT_H
+
+#include "item.h"
+
+
+/** Chunk of the snapshot item states, unchanged chunks are shared by the snapshot versions */
+typedef struct
+{
+   uint32_t refcount;
+
+   /** Snapshot version the chunk was copied for */
+   uint32_t version;
+
+   uhab_item_state_t states[CFG_UHAB_ITEMS_CHUNK_SIZE];
+
+} uhab_snapshot_chunk_t;
+
+
+/** Immutable view of all item states, indexed by the item id */
+typedef struct
+{
+   uint32_t refcount;
+   uint32_t version;
+
+   /** Items count of the snapshot */
+   uhab_item_id_t count;
+
+   uhab_snapshot_chunk_t *chunks[];
+
+} uhab_snapshot_t;
+
+
+/** Snapshots statistics */
+typedef struct
+{
+   uint32_t version;
+   uint32_t chunks_copied;
+   uint32_t live;
+
+   /** Failed publishes, readers get the live states until the next successful one */
+   uint32_t failed;
+
+} uhab_snapshot_stats_t;
+
+
+/** Publish first snapshot version of all item states */
+int uhab_snapshot_init(void);
+
+/** Release current snapshot version */
+int uhab_snapshot_deinit(void);
+
+/** Get current snapshot version, it has to be released by uhab_snapshot_release() (NULL when stale, live states are read) */
+uhab_snapshot_t *uhab_snapshot_acquire(void);
+
+/** Release snapshot, last reference frees the version */
+void uhab_snapshot_release(uhab_snapshot_t *snap);
+
+/** Publish new snapshot version with the current states of the changed items, stale version is rebuilt from all states */
+int uhab_snapshot_publish(uhab_item_t * const items[], int count);
+
+/** Get item state of the snapshot, live item state is returned without snapshot */
+const uhab_item_state_t *uhab_snapshot_get_state(const uhab_snapshot_t *snap, const uhab_item_t *item);
+
+/** Get snapshots statistics */
+void uhab_snapshot_get_stats(uhab_snapshot_stats_t *stats);
+
+
+#endif // __UHAB_SNAPSHOT_H
@@ -0,0 +1,442 @@
+/**
+ * \file timer.c       \brief uHAB timer service (hierarchical timing wheel)
+ */
+
+#include "uhab.h"
+
+TRACE_TAG(timer);
+#if !ENABLE_TRACE_TIMER
+#include "trace_undef.h"
+#endif
+
+/** Wheel geometry, root level with 1 ms slots and upper levels cover whole 32 bit time range */
+#define TIMER_ROOT_BITS       8
+#define TIMER_LEVEL_BITS      6
+#define TIMER_LEVELS          4
+#define TIMER_ROOT_SIZE       (1 << TIMER_ROOT_BITS)
+#define TIMER_LEVEL_SIZE      (1 << TIMER_LEVEL_BITS)
+#define TIMER_ROOT_MASK       (TIMER_ROOT_SIZE - 1)
+#define TIMER_LEVEL_MASK      (TIMER_LEVEL_SIZE - 1)
+
+/** Slot index of the time in the upper level */
+#define LEVEL_INDEX(_time, _level)  (((_time) >> (TIMER_ROOT_BITS + (_level) * TIMER_LEVEL_BITS)) & TIMER_LEVEL_MASK)
+
+/** Max. timer timeout [ms] */
+#define TIMER_MAX_TIMEOUT     0x7FFFFFFF
+
+/** Timer states */
+enum
+{
+   TIMER_STATE_FREE,
+   TIMER_STATE_IDLE,
+   TIMER_STATE_PENDING,
+   TIMER_STATE_DELETED,
+};
+
+
+// Prototypes:
+static void timer_thread(void *arg);
+static void wheel_add(uhab_timer_t *timer);
+static void wheel_remove(uhab_timer_t *timer);
+static void wheel_resync(uint32_t now);
+static int cascade(int level, int index);
+static uint32_t next_timeout(uint32_t now);
+static uhab_timer_t *pool_alloc(void);
+static void pool_free(uhab_timer_t *timer);
+static int pool_grow(void);
+
+// Locals:
+static const osThreadDef(TIMER, timer_thread, CFG_TIMER_THREAD_PRIORITY, 0, CFG_TIMER_THREAD_STACK_SIZE);
+
+/** Timing wheel levels, every slot is a list of timers */
+static uhab_timer_t *root[TIMER_ROOT_SIZE];
+static uhab_timer_t *levels[TIMER_LEVELS][TIMER_LEVEL_SIZE];
+
+/** Wheel time [ms], all timers expiring before are processed */
+static uint32_t wheel_time;
+static int pending_count = 0;
+
+/** Service thread is sleeping until the wakeup time */
+static uint8_t thread_sleeping = 0;
+static uint32_t wakeup_time;
+
+/** Timer with running callback */
+static uhab_timer_t *running_timer = NULL;
+
+/** Pool of free timers */
+static uhab_timer_t *free_timers = NULL;
+
+static osMutexId timer_mutex;
+static osSemaphoreId timer_sem;
+static osThreadId timer_thread_id;
+
+
+/** Current time [ms] */
+static inline uint32_t timer_now(void)
+{
+   return (uint32_t)hal_time_ms();
+}
+
+/** Initialize timer service */
+int uhab_timer_init(void)
+{
+   os_memset(root, 0, sizeof(root));
+   os_memset(levels, 0, sizeof(levels));
+   wheel_time = timer_now();
+
+   if (pool_grow() != 0)
+   {
+      TRACE_ERROR("Alloc timers pool");
+      throw_exception(fail_pool);
+   }
+
+   if ((timer_mutex = osMutexCreate(NULL)) == NULL)
+   {
+      TRACE_ERROR("Alloc timer mutex");
+      throw_exception(fail_mutex);
+   }
+
+   if ((timer_sem = osSemaphoreCreate(NULL, 1)) == NULL)
+   {
+      TRACE_ERROR("Create timer semaphore");
+      throw_exception(fail_sem);
+   }
+   VERIFY(osSemaphoreWait(timer_sem, osWaitForever) == osOK);
+
+   if ((timer_thread_id = osThreadCreate(osThread(TIMER), NULL)) == 0)
+   {
+      TRACE_ERROR("Start timer thread");
+      throw_exception(fail_thread);
+   }
+
+   TRACE("Timer service init");
+
+   return 0;
+
+fail_thread:
+   osSemaphoreDelete(timer_sem);
+fail_sem:
+   osMutexDelete(timer_mutex);
+fail_mutex:
+fail_pool:
+   return -1;
+}
+
+/** Deinitialize timer service */
+int uhab_timer_deinit(void)
+{
+   VERIFY(osThreadTerminate(timer_thread_id) == osOK);
+   VERIFY(osSemaphoreDelete(timer_sem) == osOK);
+   VERIFY(osMutexDelete(timer_mutex) == osOK);
+   return 0;
+}
+
+/** Create timer */
+uhab_timer_t *uhab_timer_create(uhab_timer_cb_t cb, uhab_timer_type_t type, void *arg)
+{
+   uhab_timer_t *timer;
+
+   ASSERT(cb != NULL);
+
+   VERIFY(osMutexWait(timer_mutex, osWaitForever) == osOK);
+
+   if ((timer = pool_alloc()) != NULL)
+   {
+      os_memset(timer, 0, sizeof(uhab_timer_t));
+      timer->type = type;
+      timer->cb = cb;
+      timer->arg = arg;
+      timer->state = TIMER_STATE_IDLE;
+   }
+
+   VERIFY(osMutexRelease(timer_mutex) == osOK);
+
+   return timer;
+}
+
+/** Delete timer */
+void uhab_timer_delete(uhab_timer_t *timer)
+{
+   ASSERT(timer != NULL);
+
+   VERIFY(osMutexWait(timer_mutex, osWaitForever) == osOK);
+
+   if (timer->state == TIMER_STATE_PENDING)
+   {
+      wheel_remove(timer);
+      pending_count--;
+   }
+
+   // Timer with running callback is returned to the pool by the service thread
+   if (timer == running_timer)
+      timer->state = TIMER_STATE_DELETED;
+   else
+      pool_free(timer);
+
+   VERIFY(osMutexRelease(timer_mutex) == osOK);
+}
+
+/** Start or restart timer */
+int uhab_timer_start(uhab_timer_t *timer, uint32_t timeout)
+{
+   ASSERT(timer != NULL);
+
+   if (timeout > TIMER_MAX_TIMEOUT)
+      timeout = TIMER_MAX_TIMEOUT;
+
+   VERIFY(osMutexWait(timer_mutex, osWaitForever) == osOK);
+
+   if (timer->state != TIMER_STATE_IDLE && timer->state != TIMER_STATE_PENDING)
+   {
+      TRACE_ERROR("Start deleted timer[%p]", timer);
+      VERIFY(osMutexRelease(timer_mutex) == osOK);
+      return -1;
+   }
+
+   if (timer->state == TIMER_STATE_PENDING)
+   {
+      wheel_remove(timer);
+   }
+   else
+   {
+      // First pending timer starts the wheel at the current time
+      wheel_resync(timer_now());
+      pending_count++;
+   }
+
+   timer->expires = timer_now() + timeout;
+   timer->period = (timeout > 0) ? timeout : 1;
+   timer->state = TIMER_STATE_PENDING;
+   wheel_add(timer);
+
+   // Wakeup service thread when the timer expires before its wakeup
+   if (thread_sleeping && (int32_t)(timer->expires - wakeup_time) < 0)
+   {
+      thread_sleeping = 0;
+      osSemaphoreRelease(timer_sem);
+   }
+
+   VERIFY(osMutexRelease(timer_mutex) == osOK);
+
+   return 0;
+}
+
+/** Stop timer */
+int uhab_timer_stop(uhab_timer_t *timer)
+{
+   ASSERT(timer != NULL);
+
+   VERIFY(osMutexWait(timer_mutex, osWaitForever) == osOK);
+
+   if (timer->state == TIMER_STATE_PENDING)
+   {
+      wheel_remove(timer);
+      pending_count--;
+      timer->state = TIMER_STATE_IDLE;
+   }
+
+   VERIFY(osMutexRelease(timer_mutex) == osOK);
+
+   return 0;
+}
+
+/** Add timer to the wheel slot by its expiration time */
+static void wheel_add(uhab_timer_t *timer)
+{
+   int level;
+   uint32_t delta = timer->expires - wheel_time;
+   uhab_timer_t **slot;
+
+   if ((int32_t)delta < 0)
+   {
+      // Already expired, process with the next tick
+      slot = &root[wheel_time & TIMER_ROOT_MASK];
+   }
+   else if (delta < TIMER_ROOT_SIZE)
+   {
+      slot = &root[timer->expires & TIMER_ROOT_MASK];
+   }
+   else
+   {
+      for (level = 0; level < TIMER_LEVELS - 1 && delta >= (1UL << (TIMER_ROOT_BITS + (level + 1) * TIMER_LEVEL_BITS)); level++);
+      slot = &levels[level][LEVEL_INDEX(timer->expires, level)];
+   }
+
+   timer->next = *slot;
+   if (timer->next != NULL)
+      timer->next->pprev = &timer->next;
+   timer->pprev = slot;
+   *slot = timer;
+}
+
+/** Remove timer from the wheel slot */
+static void wheel_remove(uhab_timer_t *timer)
+{
+   *timer->pprev = timer->next;
+   if (timer->next != NULL)
+      timer->next->pprev = timer->pprev;
+
+   timer->next = NULL;
+   timer->pprev = NULL;
+}
+
+/** Move empty wheel to the current time, idle wheel is not ticked through the whole sleep time */
+static void wheel_resync(uint32_t now)
+{
+   if (pending_count == 0 && (int32_t)(now - wheel_time) > 0)
+      wheel_time = now;
+}
+
+/** Redistribute timers of the upper level slot to the lower levels, returns slot index */
+static int cascade(int level, int index)
+{
+   uhab_timer_t *timer, *next;
+
+   timer = levels[level][index];
+   levels[level][index] = NULL;
+
+   for (; timer != NULL; timer = next)
+   {
+      next = timer->next;
+      wheel_add(timer);
+   }
+
+   return index;
+}
+
+/** Timeout [ms] to the next root level slot with timers or to the next cascade */
+static uint32_t next_timeout(uint32_t now)
+{
+   int ix, index;
+
+   if (pending_count == 0)
+      return osWaitForever;
+
+   index = wheel_time & TIMER_ROOT_MASK;
+   for (ix = index; ix < TIMER_ROOT_SIZE && root[ix] == NULL; ix++);
+
+   return wheel_time + (ix - index) - now;
+}
+
+/** Timer service thread */
+static void timer_thread(void *arg)
+{
+   int index, level;
+   uint32_t now, timeout;
+   uhab_timer_t *list, *timer;
+   uhab_timer_cb_t cb;
+   void *cb_arg;
+
+   TRACE("Timer thread is running ...");
+
+   while(1)
+   {
+      VERIFY(osMutexWait(timer_mutex, osWaitForever) == osOK);
+
+      thread_sleeping = 0;
+      now = timer_now();
+      wheel_resync(now);
+
+      // Process all expired wheel ticks
+      while ((int32_t)(now - wheel_time) >= 0)
+      {
+         index = wheel_time & TIMER_ROOT_MASK;
+
+         // Root level wraps, cascade upper levels
+         if (index == 0)
+         {
+            for (level = 0; level < TIMER_LEVELS && cascade(level, LEVEL_INDEX(wheel_time, level)) == 0; level++);
+         }
+
+         // Detach expired slot, callbacks may add timers to the same slot index of the next round
+         list = root[index];
+         root[index] = NULL;
+         if (list != NULL)
+            list->pprev = &list;
+
+         wheel_time++;
+
+         while ((timer = list) != NULL)
+         {
+            wheel_remove(timer);
+            pending_count--;
+
+            if (timer->type == UHAB_TIMER_PERIODIC)
+            {
+               // Rearm periodic timer before callback, callback may stop or delete it
+               timer->expires += timer->period;
+               if ((int32_t)(timer->expires - now) <= 0)
+                  timer->expires = now + timer->period;
+
+               wheel_add(timer);
+               pending_count++;
+            }
+            else
+            {
+               timer->state = TIMER_STATE_IDLE;
+            }
+
+            cb = timer->cb;
+            cb_arg = timer->arg;
+            running_timer = timer;
+
+            VERIFY(osMutexRelease(timer_mutex) == osOK);
+            cb(cb_arg);
+            VERIFY(osMutexWait(timer_mutex, osWaitForever) == osOK);
+
+            if (timer->state == TIMER_STATE_DELETED)
+               pool_free(timer);
+
+            running_timer = NULL;
+         }
+      }
+
+      timeout = next_timeout(now);
+      wakeup_time = now + ((timeout != osWaitForever) ? timeout : TIMER_MAX_TIMEOUT);
+      thread_sleeping = 1;
+
+      VERIFY(osMutexRelease(timer_mutex) == osOK);
+
+      osSemaphoreWait(timer_sem, timeout);
+   }
+}
+
+/** Take timer from the pool */
+static uhab_timer_t *pool_alloc(void)
+{
+   uhab_timer_t *timer;
+
+   if (free_timers == NULL && pool_grow() != 0)
+   {
+      TRACE_ERROR("Alloc timers");
+      return NULL;
+   }
+
+   timer = free_timers;
+   free_timers = timer->next;
+
+   return timer;
+}
+
+/** Return timer to the pool */
+static void pool_free(uhab_timer_t *timer)
+{
+   timer->state = TIMER_STATE_FREE;
+   timer->next = free_timers;
+   free_timers = timer;
+}
+
+/** Add block of timers to the pool, blocks are never released */
+static int pool_grow(void)
+{
+   int ix;
+   uhab_timer_t *block;
+
+   if ((block = os_malloc(CFG_UHAB_TIMER_POOL_GROW * sizeof(uhab_timer_t))) == NULL)
+      return -1;
+
+   for (ix = 0; ix < CFG_UHAB_TIMER_POOL_GROW; ix++)
+      pool_free(&block[ix]);
+
+   return 0;
+}
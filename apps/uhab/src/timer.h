@@ -0,0 +1,63 @@
+/**
+ * \file timer.h       \brief uHAB timer service (hierarchical timing wheel)
+ */
+
+#ifndef __UHAB_TIMER_H
+#define __UHAB_TIMER_H
+
+
+/** Timer type, values are equal to the osTimerOnce/osTimerPeriodic */
+typedef enum
+{
+   UHAB_TIMER_ONCE = 0,
+   UHAB_TIMER_PERIODIC = 1,
+
+} uhab_timer_type_t;
+
+
+/** Timer callback, called from the timer service thread */
+typedef void (*uhab_timer_cb_t)(void *arg);
+
+
+/** Timer object */
+typedef struct uhab_timer
+{
+   /** Wheel slot (or free pool) list link */
+   struct uhab_timer *next;
+   struct uhab_timer **pprev;
+
+   /** Expiration time [ms] */
+   uint32_t expires;
+
+   /** Period of the periodic timer [ms] */
+   uint32_t period;
+
+   uhab_timer_type_t type;
+   uint8_t state;
+
+   uhab_timer_cb_t cb;
+   void *arg;
+
+} uhab_timer_t;
+
+
+/** Initialize timer service */
+int uhab_timer_init(void);
+
+/** Deinitialize timer service */
+int uhab_timer_deinit(void);
+
+/** Create timer, timer object is taken from the pool */
+uhab_timer_t *uhab_timer_create(uhab_timer_cb_t cb, uhab_timer_type_t type, void *arg);
+
+/** Delete timer, may be called from the timer callback */
+void uhab_timer_delete(uhab_timer_t *timer);
+
+/** Start or restart timer with timeout [ms] */
+int uhab_timer_start(uhab_timer_t *timer, uint32_t timeout);
+
+/** Stop timer */
+int uhab_timer_stop(uhab_timer_t *timer);
+
+
+#endif // __UHAB_TIMER_H
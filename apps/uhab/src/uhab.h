@@ -11,6 +11,8 @@
 #include <string.h>
 #include <float.h>
 
+#include "timer.h"
+#include "arena.h"
 #include "repository/repository.h"
 #include "binding/binding.h"
 #include "bus.h"
@@ -29,9 +31,10 @@
 #define SYSTEM_INIT_AUTOMATION_FLAG    0x10
 #define SYSTEM_INIT_UIPROVIDER_FLAG    0x20
 #define SYSTEM_START_BINDING_FLAG      0x40
+#define SYSTEM_INIT_TIMER_FLAG         0x80
 
 /** All modules are initialized */
-#define SYSTEM_READY_FLAGS             0x7F
+#define SYSTEM_READY_FLAGS             0xFF
 
 /** Initialize system module always */
 #define SYSTEM_INIT(_func, _flag) do {       \
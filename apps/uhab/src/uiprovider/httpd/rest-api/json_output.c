@@ -115,6 +115,26 @@ int rest_output_value_str(struct httpd_connection *httpcon, const char *name, co
    return res;
 }
 
+int rest_output_array_value_str(struct httpd_connection *httpcon, const char *fmt, ...)
+{
+   int res = 0;
+   va_list args;
+
+   if (httpcon->element_count > 0)
+      res += snprintf(httpcon->buffer, sizeof(httpcon->buffer), ",");
+
+   va_start(args, fmt);
+   res += snprintf(&httpcon->buffer[res], sizeof(httpcon->buffer) - res, "\"");
+   res += vsnprintf(&httpcon->buffer[res], sizeof(httpcon->buffer) - res, fmt, args);
+   res += snprintf(&httpcon->buffer[res], sizeof(httpcon->buffer) - res, "\"");
+   va_end(args);
+
+   httpcon->element_count++;
+   httpd_send(httpcon, httpcon->buffer, res);
+
+   return res;
+}
+
 int rest_output_value_int(struct httpd_connection *httpcon, const char *name, int value)
 {
    int res = 0;
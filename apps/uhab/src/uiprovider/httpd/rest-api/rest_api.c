@@ -39,6 +39,7 @@ const httpd_rest_call_t httpd_restcalls[] =
    {REST_API_V1 "/system/restore",                                            NULL, NULL, rest_api_sys_restore},
    {REST_API_V1 "/system/log",                                                rest_api_sys_get_log},
    {REST_API_V1 "/system/rules",                                              rest_api_sys_get_rules},
+   {REST_API_V1 "/system/bus",                                                rest_api_sys_get_bus},
 
    {REST_API_V1 "",                                                           rest_api_get_root},
    {REST_API_V1 "/",                                                          rest_api_get_root},
@@ -53,7 +54,9 @@ const httpd_rest_call_t httpd_restcalls[] =
    {REST_API_V1 "/sitemaps/{name}/{widget_id}",                               rest_api_get_sitemap_widget},
 
    {REST_API_V1 "/items",                                                     rest_api_get_items},
+   {REST_API_V1 "/items/changes",                                             rest_api_get_items_changes},
    {REST_API_V1 "/items/{name}",                                              rest_api_get_item, NULL, rest_api_set_item},
+   {REST_API_V1 "/items/{name}/history",                                      rest_api_get_item_history},
    {REST_API_V1 "/items/config/{reponame}",                                   rest_api_get_items_config, rest_api_set_items_config, NULL, rest_api_delete_item_config},
 
    {REST_API_V1 "/icon/{name}",                                               rest_api_get_icon, NULL, rest_api_set_icon},
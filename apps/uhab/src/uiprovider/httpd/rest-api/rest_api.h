@@ -38,6 +38,7 @@
 
 const char *rest_get_local_url(struct httpd_connection *con, char *buf, int bufsize);
 const char *rest_get_local_ipaddr(char *buf, int bufsize);
+int rest_output_array_value_str(struct httpd_connection *httpcon, const char *fmt, ...);
 
 
 #endif // __REST_API_H
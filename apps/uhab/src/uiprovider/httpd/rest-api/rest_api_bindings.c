@@ -83,6 +83,10 @@ int rest_api_set_bindings_config(struct httpd_connection *con, const httpd_rest_
       TRACE_ERROR("Rename temp file %s", path);
       throw_exception(fail);
    }
+
+   // Parsed config is replaced, subscribers get changed keys
+   if (uhab_config_service_reload(binding_name) != 0)
+      TRACE_ERROR("Reload binding '%s' configuration", binding_name);
    
    if (!strcasecmp(binding_name, CFG_SYSTEM_BINDING_NAME))
    {
@@ -6,132 +6,282 @@ TRACE_TAG(restapi_item);
 #include "trace_undef.h"
 #endif
 
-int rest_output_item(struct httpd_connection *con, const uhab_item_t *item, const char *objname)
+// Prototypes:
+static int parse_fields(const char *str, uint32_t *fields);
+static int parse_types(const char *str, uint32_t *types);
+static int match_item(const uhab_item_t *item, const uhab_item_state_t *state, const char *tag, const uhab_item_t *group, uint32_t types, const char *value);
+
+/** REST type names indexed by the item type */
+static const char *item_type_names[UHAB_ITEM_TYPE_COUNT] =
+{
+   [UHAB_ITEM_TYPE_SYSTEM] = "Number",
+   [UHAB_ITEM_TYPE_SWITCH] = "Switch",
+   [UHAB_ITEM_TYPE_CONTACT] = "Contact",
+   [UHAB_ITEM_TYPE_NUMBER] = "Number",
+   [UHAB_ITEM_TYPE_GROUP] = "Group",
+   [UHAB_ITEM_TYPE_STRING] = "String",
+   [UHAB_ITEM_TYPE_DIMMER] = "Dimmer",
+   [UHAB_ITEM_TYPE_TIMER] = "Number",
+   [UHAB_ITEM_TYPE_SCENE] = "Number",
+   [UHAB_ITEM_TYPE_COLOR] = "Color",
+   [UHAB_ITEM_TYPE_ROLLERSHUTTER] = "Rollershutter",
+};
+
+/** Item fields names, order is equal to the REST_ITEM_FIELD_xxx bits */
+static const char *item_field_names[] = {"name", "label", "link", "type", "state", "tags", "groupNames", NULL};
+
+
+/** Output all item fields with its state from the snapshot */
+int rest_output_item(struct httpd_connection *con, const uhab_snapshot_t *snap, const uhab_item_t *item, const char *objname)
+{
+   return rest_output_item_fields(con, snap, item, REST_ITEM_FIELD_ALL, objname);
+}
+
+/** Output selected item fields with its state from the snapshot */
+int rest_output_item_fields(struct httpd_connection *con, const uhab_snapshot_t *snap, const uhab_item_t *item, uint32_t fields, const char *objname)
 {
+   int ix;
+   const char *pp;
    char txt[255];
+   const uhab_item_meta_t *meta = uhab_item_get_meta(item);
+   const uhab_item_state_t *state = uhab_snapshot_get_state(snap, item);
+
+   if (item->type >= UHAB_ITEM_TYPE_COUNT)
+   {
+      TRACE_ERROR("Not suported item type: %d", item->type);
+      return -1;
+   }
 
    rest_output_object_begin(con, objname);
 
-   rest_output_value_str(con, "name", item->name);
-   if (item->label != NULL)
+   if (fields & REST_ITEM_FIELD_NAME)
+      rest_output_value_str(con, "name", item->name);
+
+   if (fields & REST_ITEM_FIELD_LABEL)
    {
-      rest_output_value_str(con, "label", uhab_item_state_get_value_fmt(&item->state, item->label, txt, sizeof(txt)));
+      if (meta->label != NULL)
+      {
+         rest_output_value_str(con, "label", uhab_item_state_get_value_fmt(state, meta->label, txt, sizeof(txt)));
+      }
+      else
+      {
+         rest_output_value_str(con, "label", REST_UNDEF);;   
+      }
    }
-   else
+
+   if (fields & REST_ITEM_FIELD_LINK)
+      rest_output_value_str(con, "link", "%s/items/%s", rest_get_local_url(con, txt, sizeof(txt)), item->name);
+
+   if (fields & REST_ITEM_FIELD_TYPE)
+      rest_output_value_str(con, "type", item_type_names[item->type]);
+
+   if (fields & REST_ITEM_FIELD_STATE)
    {
-      rest_output_value_str(con, "label", REST_UNDEF);;   
+      if (item->type != UHAB_ITEM_TYPE_GROUP)
+      {
+         rest_output_value_str(con, "state", uhab_item_state_get_value(state, txt, sizeof(txt)));
+      }
+      else if (item->stereotype == UHAB_ITEM_STEREOTYPE_LIST)
+      {
+         rest_output_value_int(con, "state", item->active_child);
+      }
+      else if (meta->aggregate != NULL)
+      {
+         rest_output_value_str(con, "state", uhab_item_state_get_value(state, txt, sizeof(txt)));
+      }
+      else
+      {
+         rest_output_value_str(con, "state", "UNDEF");
+      }
    }
-   rest_output_value_str(con, "link", "%s/items/%s", rest_get_local_url(con, txt, sizeof(txt)), item->name);
 
-   switch(item->type)
+   if ((fields & REST_ITEM_FIELD_TYPE) && item->type == UHAB_ITEM_TYPE_COLOR)
+      rest_output_value_str(con, "category", "slider");
+
+   if (fields & REST_ITEM_FIELD_TAGS)
    {
-      case UHAB_ITEM_TYPE_SWITCH:
-         rest_output_value_str(con, "type", "Switch");
-         rest_output_value_str(con, "state", uhab_item_state_get_value(&item->state, txt, sizeof(txt)));
-         break;
+      rest_output_array_begin(con, "tags");
+      for (pp = meta->tag; pp != NULL && (pp = uhab_repository_next_tag(pp, txt, sizeof(txt))) != NULL;)
+         rest_output_array_value_str(con, "%s", txt);
+      rest_output_array_end(con);
+   }
 
-      case UHAB_ITEM_TYPE_DIMMER:
-         rest_output_value_str(con, "type", "Dimmer");
-         rest_output_value_str(con, "state", uhab_item_state_get_value(&item->state, txt, sizeof(txt)));
-         break;
+   if (fields & REST_ITEM_FIELD_GROUPS)
+   {
+      rest_output_array_begin(con, "groupNames");
+      for (ix = 0; ix < meta->groups.count; ix++)
+         rest_output_array_value_str(con, "%s", meta->groups.items[ix]->name);
+      rest_output_array_end(con);
+   }
 
-      case UHAB_ITEM_TYPE_CONTACT:
-         rest_output_value_str(con, "type", "Contact");
-         rest_output_value_str(con, "state", uhab_item_state_get_value(&item->state, txt, sizeof(txt)));
-         break;
+   rest_output_object_end(con);
 
-      case UHAB_ITEM_TYPE_NUMBER:
-         rest_output_value_str(con, "type", "Number");
-         rest_output_value_str(con, "state", uhab_item_state_get_value(&item->state, txt, sizeof(txt)));
-         break;
+   return 0;
+}
+
+
+/**
+ * Get items, optionally filtered by tag, group, type and state.
+ * Items are taken from the smallest index of the filter and checked by the rest of the filter.
+ */
+int rest_api_get_items(struct httpd_connection *con, const httpd_rest_call_t *restcall, const char *argv[], int argc)
+{
+   int ix, count, best, total;
+   uint32_t fields = REST_ITEM_FIELD_ALL, types = 0;
+   uhab_item_id_t id;
+   uhab_item_t *item, *group = NULL;
+   uhab_snapshot_t *snap;
+   const char *tag, *value, *param;
+   const uhab_item_array_t *arrays[UHAB_ITEM_TYPE_COUNT];
+   const uhab_item_array_t *array;
+
+   tag = httpd_get_param_value(con, "tag");
+   value = httpd_get_param_value(con, "state");
+
+   if ((param = httpd_get_param_value(con, "fields")) != NULL && parse_fields(param, &fields) != 0)
+   {
+      TRACE_ERROR("Not valid fields: %s", param);
+      return REST_API_ERR_FORMAT;
+   }
 
-      case UHAB_ITEM_TYPE_STRING:
-         rest_output_value_str(con, "type", "String");
-         rest_output_value_str(con, "state", uhab_item_state_get_value(&item->state, txt, sizeof(txt)));
-         break;
+   if ((param = httpd_get_param_value(con, "type")) != NULL && parse_types(param, &types) != 0)
+   {
+      TRACE_ERROR("Not valid item type: %s", param);
+      return REST_API_ERR_FORMAT;
+   }
 
-      case UHAB_ITEM_TYPE_GROUP:
+   if ((param = httpd_get_param_value(con, "group")) != NULL)
+   {
+      if ((group = uhab_repository_get_item(&repository, param)) == NULL || group->type != UHAB_ITEM_TYPE_GROUP)
       {
-         rest_output_value_str(con, "type", "Group");
+         TRACE_ERROR("Group '%s' not found", param);
+         return REST_API_ERR_NOTFOUND;
+      }
+   }
 
-         if (item->stereotype == UHAB_ITEM_STEREOTYPE_LIST)
-         {
-            int count;
-            uhab_child_item_t *child_item;
+   // Select the smallest candidates set, types are disjoint so several type arrays are joined
+   count = 0;
+   best = -1;
+
+   if (tag != NULL)
+   {
+      // Not indexed tag gives empty result
+      array = uhab_repository_get_tagged_items(&repository, tag);
+      arrays[count++] = array;
+      best = (array != NULL) ? array->count : 0;
+   }
 
-            // Count index of active item
-            for (count = 0, child_item = list_head(item->child_items); child_item != item->active_child_item; child_item = list_item_next(child_item), count++);
-         
-            rest_output_value_int(con, "state", count);
+   if (group != NULL && (best < 0 || uhab_item_get_meta(group)->children.count < best))
+   {
+      count = 0;
+      arrays[count++] = &uhab_item_get_meta(group)->children;
+      best = arrays[0]->count;
+   }
+
+   if (types != 0)
+   {
+      for (ix = 0, total = 0; ix < UHAB_ITEM_TYPE_COUNT; ix++)
+      {
+         if (types & (1U << ix))
+            total += uhab_repository_get_typed_items(&repository, ix)->count;
+      }
+
+      if (best < 0 || total < best)
+      {
+         for (ix = 0, count = 0; ix < UHAB_ITEM_TYPE_COUNT; ix++)
+         {
+            if (types & (1U << ix))
+               arrays[count++] = uhab_repository_get_typed_items(&repository, ix);
          }
-         else
+         best = total;
+      }
+   }
+
+   // All items are written from one consistent version of states
+   snap = uhab_snapshot_acquire();
+
+   rest_output_begin(con, REST_API_RESULT_OK, NULL);
+   
+   rest_output_array_begin(con, NULL);
+
+   if (best < 0)
+   {
+      for (id = 0; id < uhab_item_get_max_id(); id++)
+      {
+         if ((item = uhab_item_get(id)) != NULL && match_item(item, uhab_snapshot_get_state(snap, item), tag, group, types, value))
+            rest_output_item_fields(con, snap, item, fields, NULL);
+      }
+   }
+   else
+   {
+      for (ix = 0; ix < count; ix++)
+      {
+         for (id = 0; arrays[ix] != NULL && id < arrays[ix]->count; id++)
          {
-            rest_output_value_str(con, "state", "UNDEF");
+            item = arrays[ix]->items[id];
+
+            if (match_item(item, uhab_snapshot_get_state(snap, item), tag, group, types, value))
+               rest_output_item_fields(con, snap, item, fields, NULL);
          }
       }
-      break;
-
-      case UHAB_ITEM_TYPE_COLOR:
-         rest_output_value_str(con, "type", "Color");
-         rest_output_value_str(con, "state", uhab_item_state_get_value(&item->state, txt, sizeof(txt)));
-         rest_output_value_str(con, "category", "slider");
-         break;
-
-      case UHAB_ITEM_TYPE_ROLLERSHUTTER:
-         rest_output_value_str(con, "type", "Rollershutter");
-         rest_output_value_str(con, "state", uhab_item_state_get_value(&item->state, txt, sizeof(txt)));
-         break;
-
-      case UHAB_ITEM_TYPE_TIMER:
-         rest_output_value_str(con, "type", "Number");
-         rest_output_value_str(con, "state", uhab_item_state_get_value(&item->state, txt, sizeof(txt)));
-         break;
-
-      case UHAB_ITEM_TYPE_SCENE:
-         rest_output_value_str(con, "type", "Number");
-         rest_output_value_str(con, "state", uhab_item_state_get_value(&item->state, txt, sizeof(txt)));
-         break;
-
-      case UHAB_ITEM_TYPE_SYSTEM:
-         rest_output_value_str(con, "type", "Number");
-         rest_output_value_str(con, "state", uhab_item_state_get_value(&item->state, txt, sizeof(txt)));
-         break;
-         
-      default:
-         TRACE_ERROR("Not suported item type: %d", item->type);
-         return -1;
    }
 
-   // TODO:
-   rest_output_array_begin(con, "tags");
    rest_output_array_end(con);
 
-   // TODO:
-   rest_output_array_begin(con, "groupNames");
-   rest_output_array_end(con);
+   rest_output_end(con);
 
-   rest_output_object_end(con);
+   uhab_snapshot_release(snap);
 
    return 0;
 }
 
-
-/** Get items */
-int rest_api_get_items(struct httpd_connection *con, const httpd_rest_call_t *restcall, const char *argv[], int argc)
+/** Get items changed since the sequence number, optionally wait for change */
+int rest_api_get_items_changes(struct httpd_connection *con, const httpd_rest_call_t *restcall, const char *argv[], int argc)
 {
-   uhab_item_t *item;
+   int ix, count;
+   uint32_t since, wait, seq;
+   const char *param;
+   uhab_item_t *items[CFG_UHAB_BUS_MAX_CHANGES];
+   uhab_snapshot_t *snap;
+
+   since = ((param = httpd_get_param_value(con, "since")) != NULL) ? strtoul(param, NULL, 10) : 0;
+   wait = ((param = httpd_get_param_value(con, "wait")) != NULL) ? strtoul(param, NULL, 10) : 0;
+
+   if (wait > CFG_UHAB_UIPROVIDER_POOL_TIMEOUT)
+      wait = CFG_UHAB_UIPROVIDER_POOL_TIMEOUT;
+
+   if (uhab_bus_waitfor_journal(since, wait) != 0)
+   {
+      TRACE_ERROR("Wait for journal changes");
+      return -1;
+   }
+
+   count = uhab_bus_get_changes(since, items, CFG_UHAB_BUS_MAX_CHANGES, &seq);
+
+   // Snapshot taken after the journal contains all returned changes
+   snap = uhab_snapshot_acquire();
 
    rest_output_begin(con, REST_API_RESULT_OK, NULL);
-   
-   rest_output_array_begin(con, NULL);
-   for (item = list_head(repository.items); item != NULL; item = list_item_next(item))
+
+   rest_output_object_begin(con, NULL);
+   rest_output_value_int(con, "seq", seq);
+
+   // Since is out of the journal, client has to reload all items
+   rest_output_value_bool(con, "resync", count < 0);
+
+   rest_output_array_begin(con, "items");
+   for (ix = 0; ix < count; ix++)
    {
-      rest_output_item(con, item, NULL);
+      rest_output_item(con, snap, items[ix], NULL);
    }
    rest_output_array_end(con);
 
+   rest_output_object_end(con);
+
    rest_output_end(con);
 
+   uhab_snapshot_release(snap);
+
    return 0;
 }
 
@@ -139,6 +289,7 @@ int rest_api_get_items(struct httpd_connection *con, const httpd_rest_call_t *re
 int rest_api_get_item(struct httpd_connection *con, const httpd_rest_call_t *restcall, const char *argv[], int argc)
 {
    uhab_item_t *item;
+   uhab_snapshot_t *snap;
    
    REST_API_VERIFY_PARAMS(1);
    
@@ -148,10 +299,91 @@ int rest_api_get_item(struct httpd_connection *con, const httpd_rest_call_t *res
       return -1;
    }
 
+   snap = uhab_snapshot_acquire();
+
    rest_output_begin(con, REST_API_RESULT_OK, NULL);
-   rest_output_item(con, item, NULL);   
+   rest_output_item(con, snap, item, NULL);   
    rest_output_end(con);
 
+   uhab_snapshot_release(snap);
+
+   return 0;
+}
+
+/** Get item history downsampled to min/avg/max buckets, times are in seconds since epoch */
+int rest_api_get_item_history(struct httpd_connection *con, const httpd_rest_call_t *restcall, const char *argv[], int argc)
+{
+   int ix, count;
+   int64_t from, to, step;
+   const char *param;
+   uhab_item_t *item;
+   uhab_history_bucket_t *buckets;
+
+   REST_API_VERIFY_PARAMS(1);
+
+   if ((item = uhab_repository_get_item(&repository, argv[0])) == NULL)
+   {
+      TRACE_ERROR("Item '%s' not found", argv[0]);
+      return REST_API_ERR_NOTFOUND;
+   }
+
+   // Default is the last hour
+   to = ((param = httpd_get_param_value(con, "to")) != NULL) ? strtoll(param, NULL, 10) * 1000 : uhab_history_time();
+   from = ((param = httpd_get_param_value(con, "from")) != NULL) ? strtoll(param, NULL, 10) * 1000 : to - 3600 * 1000;
+   step = ((param = httpd_get_param_value(con, "step")) != NULL) ? strtoll(param, NULL, 10) * 1000 : (to - from) / CFG_UHAB_HISTORY_BUCKETS;
+
+   if (from >= to || step <= 0 || (to - from + step - 1) / step > CFG_UHAB_HISTORY_MAX_BUCKETS)
+   {
+      TRACE_ERROR("Bad history range from: %lld  to: %lld  step: %lld", (long long)from, (long long)to, (long long)step);
+      return REST_API_ERR_FORMAT;
+   }
+
+   count = (to - from + step - 1) / step;
+
+   if ((buckets = os_malloc(count * sizeof(uhab_history_bucket_t))) == NULL)
+   {
+      TRACE_ERROR("Alloc history buckets");
+      return -1;
+   }
+
+   if (uhab_history_query(item, from, to, step, buckets, count) != 0)
+   {
+      TRACE_ERROR("Item '%s' has no history", item->name);
+      os_free(buckets);
+      return REST_API_ERR_NOTFOUND;
+   }
+
+   rest_output_begin(con, REST_API_RESULT_OK, NULL);
+
+   rest_output_object_begin(con, NULL);
+   rest_output_value_str(con, "name", item->name);
+   rest_output_value_int(con, "from", from / 1000);
+   rest_output_value_int(con, "to", to / 1000);
+   rest_output_value_int(con, "step", step / 1000);
+
+   // Empty buckets are not sent
+   rest_output_array_begin(con, "buckets");
+   for (ix = 0; ix < count; ix++)
+   {
+      if (buckets[ix].count == 0)
+         continue;
+
+      rest_output_object_begin(con, NULL);
+      rest_output_value_int(con, "time", (from + ix * step) / 1000);
+      rest_output_value_int(con, "count", buckets[ix].count);
+      rest_output_value_double(con, "min", buckets[ix].min);
+      rest_output_value_double(con, "avg", buckets[ix].sum / buckets[ix].count);
+      rest_output_value_double(con, "max", buckets[ix].max);
+      rest_output_object_end(con);
+   }
+   rest_output_array_end(con);
+
+   rest_output_object_end(con);
+
+   rest_output_end(con);
+
+   os_free(buckets);
+
    return 0;
 }
 
@@ -275,3 +507,71 @@ int rest_api_delete_item_config(struct httpd_connection *con, const httpd_rest_c
      
    return REST_API_OK;   
 }
+
+/** Parse comma separated item fields names to the fields mask */
+static int parse_fields(const char *str, uint32_t *fields)
+{
+   int ix;
+   char name[32];
+
+   *fields = 0;
+
+   while ((str = uhab_repository_next_tag(str, name, sizeof(name))) != NULL)
+   {
+      for (ix = 0; item_field_names[ix] != NULL && strcmp(item_field_names[ix], name); ix++);
+
+      if (item_field_names[ix] == NULL)
+         return -1;
+
+      *fields |= (1U << ix);
+   }
+
+   return (*fields != 0) ? 0 : -1;
+}
+
+/** Parse comma separated REST type names to the item types mask */
+static int parse_types(const char *str, uint32_t *types)
+{
+   int ix;
+   char name[32];
+
+   *types = 0;
+
+   while ((str = uhab_repository_next_tag(str, name, sizeof(name))) != NULL)
+   {
+      for (ix = 0; ix < UHAB_ITEM_TYPE_COUNT; ix++)
+      {
+         if (!strcasecmp(item_type_names[ix], name))
+            *types |= (1U << ix);
+      }
+   }
+
+   return (*types != 0) ? 0 : -1;
+}
+
+/** Check item matches the filter, NULL or 0 filter values match any item */
+static int match_item(const uhab_item_t *item, const uhab_item_state_t *state, const char *tag, const uhab_item_t *group, uint32_t types, const char *value)
+{
+   int ix;
+   char txt[255];
+   const uhab_item_array_t *groups = &uhab_item_get_meta(item)->groups;
+
+   if (types != 0 && (types & (1U << item->type)) == 0)
+      return 0;
+
+   if (group != NULL)
+   {
+      for (ix = 0; ix < groups->count && groups->items[ix] != group; ix++);
+
+      if (ix == groups->count)
+         return 0;
+   }
+
+   if (tag != NULL && !uhab_repository_item_has_tag(item, tag))
+      return 0;
+
+   if (value != NULL && strcasecmp(uhab_item_state_get_value(state, txt, sizeof(txt)), value))
+      return 0;
+
+   return 1;
+}
@@ -2,9 +2,22 @@
 #ifndef __REST_API_ITEM_H
 #define __REST_API_ITEM_H
 
-int rest_output_item(struct httpd_connection *con, const uhab_item_t *item, const char *objname);
+/** Item output fields */
+#define REST_ITEM_FIELD_NAME        0x01
+#define REST_ITEM_FIELD_LABEL       0x02
+#define REST_ITEM_FIELD_LINK        0x04
+#define REST_ITEM_FIELD_TYPE        0x08
+#define REST_ITEM_FIELD_STATE       0x10
+#define REST_ITEM_FIELD_TAGS        0x20
+#define REST_ITEM_FIELD_GROUPS      0x40
+#define REST_ITEM_FIELD_ALL         0x7F
+
+int rest_output_item(struct httpd_connection *con, const uhab_snapshot_t *snap, const uhab_item_t *item, const char *objname);
+int rest_output_item_fields(struct httpd_connection *con, const uhab_snapshot_t *snap, const uhab_item_t *item, uint32_t fields, const char *objname);
 int rest_api_get_items(struct httpd_connection *con, const httpd_rest_call_t *restcall, const char *argv[], int argc);
+int rest_api_get_items_changes(struct httpd_connection *con, const httpd_rest_call_t *restcall, const char *argv[], int argc);
 int rest_api_get_item(struct httpd_connection *con, const httpd_rest_call_t *restcall, const char *argv[], int argc);
+int rest_api_get_item_history(struct httpd_connection *con, const httpd_rest_call_t *restcall, const char *argv[], int argc);
 int rest_api_set_item(struct httpd_connection *con, const httpd_rest_call_t *restcall, const char *argv[], int argc);
 
 int rest_api_get_items_config(struct httpd_connection *con, const httpd_rest_call_t *restcall, const char *argv[], int argc);
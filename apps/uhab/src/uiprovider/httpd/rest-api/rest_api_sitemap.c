@@ -6,10 +6,12 @@ TRACE_TAG(restapi_sitemap);
 #include "trace_undef.h"
 #endif
 
+#define CFG_SITEMAP_LOCALHOST_NAME        "http://localhost"
 
-static const char *widget_get_label(uhab_sitemap_widget_t *widget, char *buf, int bufsize)
+
+static const char *widget_get_label(const uhab_snapshot_t *snap, uhab_sitemap_widget_t *widget, char *buf, int bufsize)
 {
-   const char *label_fmt = (widget->label != NULL) ? widget->label : (widget->item != NULL) ? widget->item->label : NULL;
+   const char *label_fmt = (widget->label != NULL) ? widget->label : (widget->item != NULL) ? uhab_item_get_meta(widget->item)->label : NULL;
 
    if (label_fmt == NULL)
       label_fmt = "";
@@ -17,7 +19,7 @@ static const char *widget_get_label(uhab_sitemap_widget_t *widget, char *buf, in
    // Format label by type
    if (widget->item != NULL)
    {
-      uhab_item_state_get_value_fmt(&widget->item->state, widget->item->label, buf, bufsize);
+      uhab_item_state_get_value_fmt(uhab_snapshot_get_state(snap, widget->item), uhab_item_get_meta(widget->item)->label, buf, bufsize);
    }
    else
    {
@@ -28,13 +30,13 @@ static const char *widget_get_label(uhab_sitemap_widget_t *widget, char *buf, in
 }
 
 
-static int rest_output_widget(struct httpd_connection *con, uhab_sitemap_t *sitemap, uhab_sitemap_widget_t *widget)
+static int rest_output_widget(struct httpd_connection *con, const uhab_snapshot_t *snap, uhab_sitemap_t *sitemap, uhab_sitemap_widget_t *widget)
 {
    uhab_sitemap_widget_mapping_t *map;
    char label[255];
 
    // Get formated widget label
-   widget_get_label(widget, label, sizeof(label));
+   widget_get_label(snap, widget, label, sizeof(label));
 
    rest_output_value_str(con, "widgetId", "%d", widget->id);
 
@@ -111,10 +113,21 @@ static int rest_output_widget(struct httpd_connection *con, uhab_sitemap_t *site
 
       case UHAB_SITEMAP_WIDGET_IMAGE:
       {
+         const char *purl;
+         char ipaddr[64];
+
          rest_output_value_str(con, "type", "Image");
          rest_output_value_str(con, "icon", widget->icon != NULL ? widget->icon : "none");
          rest_output_value_str(con, "label", label);
-         rest_output_value_str(con, "url", widget->image.url);
+
+         // Localhost URL (replace localhost with local IP address and port)
+         if (widget->image.url != NULL && (purl = strstr(widget->image.url, CFG_SITEMAP_LOCALHOST_NAME)) != NULL)
+         {
+            rest_output_value_str(con, "url", "http://%s:%d%s", rest_get_local_ipaddr(ipaddr, sizeof(ipaddr)),
+                                  CFG_UHAB_UIPROVIDER_HTTP_PORT, purl + strlen(CFG_SITEMAP_LOCALHOST_NAME));
+         }
+         else
+            rest_output_value_str(con, "url", widget->image.url);
       }
       break;
 
@@ -134,7 +147,7 @@ static int rest_output_widget(struct httpd_connection *con, uhab_sitemap_t *site
    }
 
    if (widget->item != NULL)
-      rest_output_item(con, widget->item, "item");
+      rest_output_item(con, snap, widget->item, "item");
 
    // Mappings
    rest_output_array_begin(con, "mappings");
@@ -154,7 +167,7 @@ static int rest_output_widget(struct httpd_connection *con, uhab_sitemap_t *site
       {
          rest_output_object_begin(con, NULL);
 
-         if (rest_output_widget(con, sitemap, widget) != 0)
+         if (rest_output_widget(con, snap, sitemap, widget) != 0)
             return -1;
 
          rest_output_object_end(con);
@@ -247,9 +260,10 @@ int rest_api_get_sitemap(struct httpd_connection *con, const httpd_rest_call_t *
 
 int rest_api_get_sitemap_widget(struct httpd_connection *con, const httpd_rest_call_t *restcall, const char *argv[], int argc)
 {
-   int id;
+   int id, res = 0;
    uhab_sitemap_t *sitemap;
    uhab_sitemap_widget_t *widget;
+   uhab_snapshot_t *snap;
    char txt[255];
 
    REST_API_VERIFY_PARAMS(2);
@@ -282,18 +296,21 @@ int rest_api_get_sitemap_widget(struct httpd_connection *con, const httpd_rest_c
       uhab_bus_waitfor_changes(widget);
    }
 
+   // Page is rendered from one consistent version of states
+   snap = uhab_snapshot_acquire();
+
    rest_output_begin(con, REST_API_RESULT_OK, NULL);
    rest_output_object_begin(con, NULL);
 
    rest_output_value_str(con, "id", "%d", widget->id);
-   rest_output_value_str(con, "title", widget_get_label(widget, txt, sizeof(txt)));
+   rest_output_value_str(con, "title", widget_get_label(snap, widget, txt, sizeof(txt)));
    rest_output_value_str(con, "link", "%s/sitemaps/%s/%d", rest_get_local_url(con, txt, sizeof(txt)), sitemap->name, widget->id);
 
    if (widget->parent != NULL)
    {
       rest_output_object_begin(con, "parent");
       rest_output_value_int(con, "id", widget->parent->id);
-      rest_output_value_str(con, "title", widget_get_label(widget->parent, txt, sizeof(txt)));
+      rest_output_value_str(con, "title", widget_get_label(snap, widget->parent, txt, sizeof(txt)));
       rest_output_value_str(con, "link", "%s/sitemaps/%s/%d", rest_get_local_url(con, txt, sizeof(txt)), sitemap->name, widget->parent->id);
       rest_output_value_bool(con, "leaf", 0);
       rest_output_object_end(con);
@@ -306,11 +323,20 @@ int rest_api_get_sitemap_widget(struct httpd_connection *con, const httpd_rest_c
    {
       rest_output_object_begin(con, NULL);
 
-      if (rest_output_widget(con, sitemap, widget) != 0)
-         return -1;
+      if (rest_output_widget(con, snap, sitemap, widget) != 0)
+      {
+         res = -1;
+         break;
+      }
 
       rest_output_object_end(con);
    }
+
+   uhab_snapshot_release(snap);
+
+   if (res != 0)
+      return res;
+
    rest_output_array_end(con);
 
    rest_output_object_end(con);
@@ -18,6 +18,9 @@ extern char _sccmram;
 extern char _eccmram;     
 #define CCM_SEG_SIZE    0 //(&_eccmram - &_sccmram)
 
+// Prototypes:
+static void output_arena(struct httpd_connection *con, const uhab_arena_t *arena);
+
 
 /** Get system info */
 int rest_api_sys_get_info(struct httpd_connection *con, const httpd_rest_call_t *restcall, const char *argv[], int argc)
@@ -41,6 +44,14 @@ int rest_api_sys_get_info(struct httpd_connection *con, const httpd_rest_call_t
    rest_output_value_int(con, "bss_size", BSS_SEG_SIZE);
    rest_output_value_int(con, "ccm_size", CCM_SEG_SIZE);
    rest_output_value_int(con, "total_used_memory", (osMemGetTotalSize() - osMemGetFreeSize()) + DATA_SEG_SIZE + CCM_SEG_SIZE);
+
+   // Config objects arenas
+   rest_output_object_begin(con, "config_arenas");
+   output_arena(con, &repository.arena);
+   output_arena(con, &automation.arena);
+   output_arena(con, &uiprovider.arena);
+   rest_output_object_end(con);
+
    rest_output_object_end(con);
 
 
@@ -52,6 +63,94 @@ int rest_api_sys_get_info(struct httpd_connection *con, const httpd_rest_call_t
    return 0;
 }
 
+/** Get event bus statistics */
+int rest_api_sys_get_bus(struct httpd_connection *con, const httpd_rest_call_t *restcall, const char *argv[], int argc)
+{
+   int ix, lane;
+   uhab_item_id_t id;
+   uhab_item_t *item;
+   uhab_bus_stats_t stats;
+   uhab_item_state_stats_t state_stats;
+   uhab_snapshot_stats_t snapshot_stats;
+
+   rest_output_begin(con, REST_API_RESULT_OK, NULL);
+
+   rest_output_object_begin(con, NULL);
+   rest_output_array_begin(con, "workers");
+
+   for (ix = 0; uhab_bus_get_stats(ix, &stats) == 0; ix++)
+   {
+      rest_output_object_begin(con, NULL);
+      rest_output_value_int(con, "index", ix);
+      rest_output_value_int(con, "events", stats.events);
+      rest_output_value_int(con, "drains", stats.drains);
+      rest_output_value_int(con, "last_drain", stats.last_drain);
+      rest_output_value_int(con, "max_drain", stats.max_drain);
+      rest_output_value_int(con, "coalesced", stats.coalesced);
+      rest_output_value_int(con, "latency_last", stats.latency_last);
+      rest_output_value_int(con, "latency_max", stats.latency_max);
+      rest_output_value_int(con, "latency_avg", (stats.events > 0) ? (int)(stats.latency_total / stats.events) : 0);
+
+      rest_output_array_begin(con, "lanes");
+      for (lane = 0; lane < UHAB_BUS_LANE_COUNT; lane++)
+      {
+         rest_output_object_begin(con, NULL);
+         rest_output_value_str(con, "name", "%s", uhab_bus_get_lane_name(lane));
+         rest_output_value_int(con, "enqueued", stats.lanes[lane].enqueued);
+         rest_output_value_int(con, "dropped", stats.lanes[lane].dropped);
+         rest_output_value_int(con, "high_water", stats.lanes[lane].high_water);
+         rest_output_value_int(con, "full_waits", stats.lanes[lane].full_waits);
+         rest_output_object_end(con);
+      }
+      rest_output_array_end(con);
+
+      rest_output_object_end(con);
+   }
+
+   rest_output_array_end(con);
+
+   // Items with coalesced updates
+   rest_output_array_begin(con, "coalesced_items");
+
+   for (id = 0; id < uhab_item_get_max_id(); id++)
+   {
+      if ((item = uhab_item_get(id)) != NULL && uhab_item_get_bus(item)->pending.count > 0)
+      {
+         rest_output_object_begin(con, NULL);
+         rest_output_value_str(con, "name", "%s", item->name);
+         rest_output_value_int(con, "coalesced", uhab_item_get_bus(item)->pending.count);
+         rest_output_object_end(con);
+      }
+   }
+
+   rest_output_array_end(con);
+
+   // Items state access statistics
+   uhab_item_state_get_stats(&state_stats);
+
+   rest_output_object_begin(con, "item_state");
+   rest_output_value_int(con, "writes", state_stats.writes);
+   rest_output_value_int(con, "lock_spins", state_stats.lock_spins);
+   rest_output_value_int(con, "read_retries", state_stats.read_retries);
+   rest_output_object_end(con);
+
+   // Repository snapshots statistics
+   uhab_snapshot_get_stats(&snapshot_stats);
+
+   rest_output_object_begin(con, "snapshot");
+   rest_output_value_int(con, "version", snapshot_stats.version);
+   rest_output_value_int(con, "chunks_copied", snapshot_stats.chunks_copied);
+   rest_output_value_int(con, "failed", snapshot_stats.failed);
+   rest_output_value_int(con, "live", snapshot_stats.live);
+   rest_output_object_end(con);
+
+   rest_output_object_end(con);
+
+   rest_output_end(con);
+
+   return 0;
+}
+
 int rest_api_sys_restart(struct httpd_connection *con, const httpd_rest_call_t *restcall, const char *argv[], int argc)
 {
    rest_output_begin(con, REST_API_RESULT_OK, NULL);
@@ -195,4 +294,19 @@ fail:
    // Remove temp file
    unlink(path);
    return REST_API_ERR;   
-}
\ No newline at end of file
+}
+
+/** Output config arena usage */
+static void output_arena(struct httpd_connection *con, const uhab_arena_t *arena)
+{
+   // Not initialized module
+   if (arena->name == NULL)
+      return;
+
+   rest_output_object_begin(con, arena->name);
+   rest_output_value_int(con, "used", arena->used);
+   rest_output_value_int(con, "allocated", arena->allocated);
+   rest_output_value_int(con, "blocks", arena->blocks_count);
+   rest_output_value_int(con, "objects", arena->allocs);
+   rest_output_object_end(con);
+}
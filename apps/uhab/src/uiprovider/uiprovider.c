@@ -8,23 +8,58 @@ TRACE_TAG(uiprovider);
 #endif
 
 
+// Prototypes:
+static void load_thread(void *arg);
+static int wait_loader(uhab_uiprovider_t *uiprovider);
+static int load_sitemaps(uhab_uiprovider_t *uiprovider);
+static void uiprovider_reset(uhab_uiprovider_t *uiprovider);
+
+// Locals:
+static const osThreadDef(SITEMAP_LOAD, load_thread, CFG_CONFIG_LOAD_THREAD_PRIORITY, 0, CFG_CONFIG_LOAD_THREAD_STACK_SIZE);
+
+
 static void hal_net_event_handler(hal_netif_t netif, hal_netif_event_t event)
 {
 }
 
+/** Start sitemaps loading in background, loaded sitemaps are taken by uhab_uiprovider_init() */
+int uhab_uiprovider_load(uhab_uiprovider_t *uiprovider)
+{
+   uiprovider_reset(uiprovider);
+
+   if ((uiprovider->load_sem = osSemaphoreCreate(NULL, 1)) == NULL)
+   {
+      TRACE_ERROR("Create sitemaps loader semaphore");
+      throw_exception(fail_sem);
+   }
+   VERIFY(osSemaphoreWait(uiprovider->load_sem, osWaitForever) == osOK);
+
+   if (osThreadCreate(osThread(SITEMAP_LOAD), uiprovider) == 0)
+   {
+      TRACE_ERROR("Start sitemaps loader thread");
+      throw_exception(fail_thread);
+   }
+
+   return 0;
+
+fail_thread:
+   osSemaphoreDelete(uiprovider->load_sem);
+   uiprovider->load_sem = NULL;
+fail_sem:
+   return -1;
+}
+
 /** Initialize UI provider */
 int uhab_uiprovider_init(uhab_uiprovider_t *uiprovider)
 {
-   DIR *d = NULL;
-   struct dirent *dir;
-   uhab_sitemap_t *sitemap = NULL;
+   int res;
    int http_port = CFG_UHAB_UIPROVIDER_HTTP_PORT;
    hal_netif_config_t netconf = {.wifi.ssid = CFG_UIPROVIDER_DEFAULT_WIFI_SSID, .wifi.passwd = CFG_UIPROVIDER_DEFAULT_WIFI_PASSWD};
    char txt[255];
 
-   memset(uiprovider, 0, sizeof(uhab_uiprovider_t));
-   LIST_STRUCT_INIT(uiprovider, sitemaps);
-   uiprovider->netif = CFG_NETIF;
+   // Sitemaps may be already loading
+   if (uiprovider->load_sem == NULL)
+      uiprovider_reset(uiprovider);
 
    //
    // Get configuration
@@ -72,48 +107,29 @@ int uhab_uiprovider_init(uhab_uiprovider_t *uiprovider)
    }
    TRACE("HTTPD initialized");
 
-   // List sitemaps files
-   if ((d = opendir(CFG_UHAB_SITEMAP_CFG_DIR)) == NULL)
+   // Wait for the sitemaps loader or load sitemaps now
+   res = (uiprovider->load_sem != NULL) ? wait_loader(uiprovider) : load_sitemaps(uiprovider);
+   if (res != 0)
    {
-      TRACE_ERROR("Can't open dir %s", CFG_UHAB_SITEMAP_CFG_DIR);
+      TRACE_ERROR("Load sitemaps");
       throw_exception(fail);
    }
 
-   // Load sitemaps config
-   while ((dir = readdir(d)) != NULL)
+   // Index widgets by ID and items by sitemap pages
+   if (uhab_sitemap_widget_index_build(uiprovider->sitemaps) != 0)
    {
-      if (strstr(dir->d_name, ".sitemap") != NULL)
-      {
-         if ((sitemap = os_malloc(sizeof(uhab_sitemap_t))) == NULL)
-         {
-            TRACE_ERROR("Alloc sitemap");
-            throw_exception(fail);
-         }
-         os_memset(sitemap, 0, sizeof(uhab_sitemap_t));
-
-         snprintf(txt, sizeof(txt), "%s/%s", CFG_UHAB_SITEMAP_CFG_DIR, dir->d_name);
-         if (uhab_config_sitemap_load(txt, sitemap) != 0)
-         {
-            TRACE_ERROR("Load sitemap %s", txt);
-            throw_exception(fail);
-         }
-
-         list_add(uiprovider->sitemaps, sitemap);
-      }
+      TRACE_ERROR("Build sitemaps index");
+      throw_exception(fail);
    }
 
-   closedir(d);
-
-   TRACE("UI provider init, IP: %s", rest_get_local_ipaddr(txt, sizeof(txt)));
+   TRACE("UI provider init, IP: %s  config arena used: %d", rest_get_local_ipaddr(txt, sizeof(txt)), uiprovider->arena.used);
 
    return 0;
 
 fail:
-   if (sitemap != NULL)
-      os_free(sitemap);
-
-   if (d != NULL)
-      closedir(d);
+   // Loader doesn't run after failed init
+   if (uiprovider->load_sem != NULL)
+      wait_loader(uiprovider);
 
    return -1;
 }
@@ -121,6 +137,9 @@ fail:
 /** Deinitialize UI provider */
 int uhab_uiprovider_deinit(uhab_uiprovider_t *uiprovider)
 {
+   LIST_STRUCT_INIT(uiprovider, sitemaps);
+   uhab_arena_free(&uiprovider->arena);
+
    return 0;
 }
 
@@ -137,3 +156,93 @@ uhab_sitemap_t *uhab_provider_get_sitemap(uhab_uiprovider_t *uiprovider, const c
 
    return sitemap;
 }
+
+/** Sitemaps loader thread */
+static void load_thread(void *arg)
+{
+   uhab_uiprovider_t *uiprovider = arg;
+
+   ASSERT(uiprovider != NULL);
+
+   uiprovider->load_res = load_sitemaps(uiprovider);
+
+   osSemaphoreRelease(uiprovider->load_sem);
+
+   // Terminate loader thread
+   VERIFY(osThreadTerminate(osThreadGetId()) == osOK);
+}
+
+/** Wait for the sitemaps loader thread, returns its result */
+static int wait_loader(uhab_uiprovider_t *uiprovider)
+{
+   hal_time_t wait_time = hal_time_ms();
+
+   VERIFY(osSemaphoreWait(uiprovider->load_sem, osWaitForever) == osOK);
+   osSemaphoreDelete(uiprovider->load_sem);
+   uiprovider->load_sem = NULL;
+
+   TRACE("Sitemaps loader waited %d ms", (int)(hal_time_ms() - wait_time));
+
+   return uiprovider->load_res;
+}
+
+/** Load sitemaps config, repository items are only read */
+static int load_sitemaps(uhab_uiprovider_t *uiprovider)
+{
+   DIR *d;
+   struct dirent *dir;
+   uhab_sitemap_t *sitemap;
+   hal_time_t start_time = hal_time_ms();
+   int count = 0;
+   char txt[255];
+
+   // List sitemaps files
+   if ((d = opendir(CFG_UHAB_SITEMAP_CFG_DIR)) == NULL)
+   {
+      TRACE_ERROR("Can't open dir %s", CFG_UHAB_SITEMAP_CFG_DIR);
+      throw_exception(fail_opendir);
+   }
+
+   // Load sitemaps config
+   while ((dir = readdir(d)) != NULL)
+   {
+      if (strstr(dir->d_name, ".sitemap") != NULL)
+      {
+         if ((sitemap = uhab_arena_alloc(&uiprovider->arena, sizeof(uhab_sitemap_t))) == NULL)
+         {
+            TRACE_ERROR("Alloc sitemap");
+            throw_exception(fail_load);
+         }
+
+         snprintf(txt, sizeof(txt), "%s/%s", CFG_UHAB_SITEMAP_CFG_DIR, dir->d_name);
+         if (uhab_config_sitemap_load(txt, &uiprovider->arena, sitemap) != 0)
+         {
+            TRACE_ERROR("Load sitemap %s", txt);
+            throw_exception(fail_load);
+         }
+
+         list_add(uiprovider->sitemaps, sitemap);
+         count++;
+      }
+   }
+
+   closedir(d);
+
+   TRACE("Sitemaps: %d files loaded in %d ms", count, (int)(hal_time_ms() - start_time));
+
+   return 0;
+
+fail_load:
+   closedir(d);
+fail_opendir:
+   return -1;
+}
+
+/** Clear UI provider before sitemaps are loaded */
+static void uiprovider_reset(uhab_uiprovider_t *uiprovider)
+{
+   memset(uiprovider, 0, sizeof(uhab_uiprovider_t));
+   LIST_STRUCT_INIT(uiprovider, sitemaps);
+   uhab_arena_init(&uiprovider->arena, "sitemaps");
+   uiprovider->netif = CFG_NETIF;
+}
@@ -14,10 +14,20 @@ typedef struct
 
    /** Sitemaps */
    LIST_STRUCT(sitemaps);
+
+   /** Sitemaps config */
+   uhab_arena_t arena;
+
+   /** Sitemaps loader running in parallel to the automation init */
+   osSemaphoreId load_sem;
+   int load_res;
    
 } uhab_uiprovider_t;
 
 
+/** Start sitemaps loading in background, loaded sitemaps are taken by uhab_uiprovider_init() */
+int uhab_uiprovider_load(uhab_uiprovider_t *uiprovider);
+
 /** Initialize UI provider */
 int uhab_uiprovider_init(uhab_uiprovider_t *uiprovider);
 
@@ -3,16 +3,24 @@
 
 TRACE_GROUP(uiprovider);
 
+// Prototypes:
+static void index_widgets(uhab_sitemap_widget_t *parent, int pass);
+static void add_item_page(uhab_item_t *item, uhab_sitemap_widget_t *page, int pass);
+
+// Locals:
 static int widget_id_pool = 0;
 
-/** Alloc sitemap widget */
-uhab_sitemap_widget_t *uhab_sitemap_widget_alloc(uhab_sitemap_widget_type_t type)
+/** Dense widgets index by widget ID */
+static uhab_sitemap_widget_t **widget_index = NULL;
+static int widget_index_size = 0;
+
+/** Alloc sitemap widget in the config arena */
+uhab_sitemap_widget_t *uhab_sitemap_widget_alloc(uhab_arena_t *arena, uhab_sitemap_widget_type_t type)
 {
    uhab_sitemap_widget_t *widget;
    
-   if ((widget = os_malloc(sizeof(uhab_sitemap_widget_t))) != NULL)
+   if ((widget = uhab_arena_alloc(arena, sizeof(uhab_sitemap_widget_t))) != NULL)
    {
-      os_memset(widget, 0, sizeof(uhab_sitemap_widget_t));
       widget->type = type;
       widget->id = widget_id_pool++;
       LIST_STRUCT_INIT(widget, mappings);
@@ -22,16 +30,21 @@ uhab_sitemap_widget_t *uhab_sitemap_widget_alloc(uhab_sitemap_widget_type_t type
    return widget;
 }
 
-/** Free sitemap widget */
-void uhab_sitemap_widget_free(uhab_sitemap_widget_t *widget)
-{
-   os_free(widget);
-}
-
 /** Find widget by ID */
 uhab_sitemap_widget_t *uhab_sitemap_widget_find(uhab_sitemap_widget_t *parent, int id)
 {
    uhab_sitemap_widget_t *widget, *widget2;
+
+   if (widget_index != NULL)
+   {
+      if (id < 0 || id >= widget_index_size || (widget = widget_index[id]) == NULL)
+         return NULL;
+
+      // Widget must be nested in the parent
+      for (widget2 = widget->parent; widget2 != NULL && widget2 != parent; widget2 = widget2->parent);
+
+      return (widget2 != NULL) ? widget : NULL;
+   }
    
    for (widget = list_head(parent->widgets); widget != NULL; widget = list_item_next(widget))
    {
@@ -60,7 +73,7 @@ void uhab_sitemap_widgets_print(uhab_sitemap_widget_t *parent, int nested_count)
       {
          TRACE_PRINTF(" ");
       }
-      TRACE_PRINTF("%d - %s  %s\n", widget->type, (widget->label != NULL) ? widget->label : (widget->item != NULL) ? widget->item->label : "", widget->item != NULL ? widget->item->name : "null");
+      TRACE_PRINTF("%d - %s  %s\n", widget->type, (widget->label != NULL) ? widget->label : (widget->item != NULL) ? uhab_item_get_meta(widget->item)->label : "", widget->item != NULL ? widget->item->name : "null");
       
       uhab_sitemap_widgets_print(widget, nested_count+1);
    }
@@ -90,3 +103,92 @@ uhab_sitemap_widget_t *uhab_sitemap_find_item_widget(uhab_sitemap_widget_t *pare
    return widget;
 }
 
+/** Build widgets index of all loaded sitemaps and items pages */
+int uhab_sitemap_widget_index_build(list_t sitemaps)
+{
+   int pass;
+   uhab_item_t *item;
+   uhab_item_bus_t *bus;
+   uhab_sitemap_t *sitemap;
+
+   if ((widget_index = os_malloc(widget_id_pool * sizeof(uhab_sitemap_widget_t *))) == NULL)
+   {
+      TRACE_ERROR("Alloc widgets index");
+      return -1;
+   }
+   os_memset(widget_index, 0, widget_id_pool * sizeof(uhab_sitemap_widget_t *));
+   widget_index_size = widget_id_pool;
+
+   // First pass counts items pages, second pass fills them
+   for (pass = 0; pass < 2; pass++)
+   {
+      for (sitemap = list_head(sitemaps); sitemap != NULL; sitemap = list_item_next(sitemap))
+      {
+         widget_index[sitemap->root->id] = sitemap->root;
+         index_widgets(sitemap->root, pass);
+      }
+
+      if (pass == 0)
+      {
+         for (item = uhab_item_first(); item != NULL; item = uhab_item_next(item))
+         {
+            bus = uhab_item_get_bus(item);
+
+            if (bus->pages.count > 0)
+            {
+               if ((bus->pages.widgets = os_malloc(bus->pages.count * sizeof(uhab_sitemap_widget_t *))) == NULL)
+               {
+                  TRACE_ERROR("Alloc item: %s pages", item->name);
+                  return -1;
+               }
+
+               bus->pages.count = 0;
+            }
+         }
+      }
+   }
+
+   return 0;
+}
+
+/** Index nested widgets */
+static void index_widgets(uhab_sitemap_widget_t *parent, int pass)
+{
+   uhab_sitemap_widget_t *widget, *page;
+
+   for (widget = list_head(parent->widgets); widget != NULL; widget = list_item_next(widget))
+   {
+      widget_index[widget->id] = widget;
+
+      // Item is visible on the widget and all its parents
+      if (widget->item != NULL)
+      {
+         for (page = widget; page != NULL; page = page->parent)
+            add_item_page((uhab_item_t *)widget->item, page, pass);
+      }
+
+      index_widgets(widget, pass);
+   }
+}
+
+/** Add page widget to the item */
+static void add_item_page(uhab_item_t *item, uhab_sitemap_widget_t *page, int pass)
+{
+   int ix;
+   uhab_item_bus_t *bus = uhab_item_get_bus(item);
+
+   if (pass == 0)
+   {
+      // Count only
+      bus->pages.count++;
+      return;
+   }
+
+   for (ix = 0; ix < bus->pages.count; ix++)
+   {
+      if (bus->pages.widgets[ix] == page)
+         return;
+   }
+
+   bus->pages.widgets[bus->pages.count++] = page;
+}
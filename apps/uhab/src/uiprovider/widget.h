@@ -2,6 +2,9 @@
 #ifndef __UHAB_WIDGET_H
 #define __UHAB_WIDGET_H
 
+// Forward decl.
+struct uhab_bus_waitstate;
+
 /** Widget types */
 typedef enum
 {
@@ -58,6 +61,9 @@ typedef struct uhab_sitemap_widget
 
    /** Childs widgets list */
    LIST_STRUCT(widgets);
+
+   /** Bus waitstates waiting for changes on this page */
+   struct uhab_bus_waitstate *waitstates;
    
    /** Widget private data */
    union
@@ -87,11 +93,8 @@ typedef struct uhab_sitemap_widget
 } uhab_sitemap_widget_t;
 
 
-/** Alloc sitemap widget */
-uhab_sitemap_widget_t *uhab_sitemap_widget_alloc(uhab_sitemap_widget_type_t type);
-
-/** Free sitemap widget */
-void uhab_sitemap_widget_free(uhab_sitemap_widget_t *widget);
+/** Alloc sitemap widget in the config arena */
+uhab_sitemap_widget_t *uhab_sitemap_widget_alloc(uhab_arena_t *arena, uhab_sitemap_widget_type_t type);
 
 /** Find widget by ID */
 uhab_sitemap_widget_t *uhab_sitemap_widget_find(uhab_sitemap_widget_t *parent, int id);
@@ -102,5 +105,8 @@ void uhab_sitemap_widgets_print(uhab_sitemap_widget_t *parent, int nested_count)
 /** Find widget by item in parent widget */
 uhab_sitemap_widget_t *uhab_sitemap_find_item_widget(uhab_sitemap_widget_t *parent, uhab_item_t *item);
 
+/** Build widgets index of all loaded sitemaps and items pages */
+int uhab_sitemap_widget_index_build(list_t sitemaps);
+
 
 #endif // __UHAB_WIDGET_H
\ No newline at end of file
@@ -0,0 +1,27 @@
+#!/bin/bash
+
+source ./config.sh
+
+name=$1
+from=$2
+to=$3
+step=$4
+
+if [ "$1" == "" ]; then
+   echo "usage: $0 item_name [from] [to] [step]"
+   exit 1
+fi
+
+if [ "$3" == "" ]; then
+   to=`date +%s`
+fi
+
+if [ "$2" == "" ]; then
+   from=$((to - 3600))
+fi
+
+if [ "$4" == "" ]; then
+   step=60
+fi
+
+curl $CURL_OPTIONS -X GET "$URL_API/items/$name/history?from=$from&to=$to&step=$step" | jq
@@ -0,0 +1,16 @@
+#!/bin/bash
+
+source ./config.sh
+
+since=$1
+wait=$2
+
+if [ "$1" == "" ]; then
+   since=0
+fi
+
+if [ "$2" == "" ]; then
+   wait=10000
+fi
+
+curl $CURL_OPTIONS -X GET "$URL_API/items/changes?since=$since&wait=$wait" | jq
@@ -0,0 +1,10 @@
+#!/bin/bash
+
+source ./config.sh
+
+if [ "$1" == "" ]; then
+   echo "usage: $0 'tag=X&group=Y&type=Switch&state=ON&fields=name,state'"
+   exit 1
+fi
+
+curl $CURL_OPTIONS -X GET "$URL_API/items?$1" | jq
@@ -0,0 +1,6 @@
+#!/bin/bash
+
+source ./config.sh
+
+curl $CURL_OPTIONS -X GET $URL_API/system/bus | jq
+